@@ -1,6 +1,8 @@
 #pragma once
 #include <cstddef>
+#include <deque>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <capnp/serialize.h>
@@ -84,7 +86,9 @@ public:
   uint64_t rcv_time(const char *name) const;
   cereal::Event::Reader &operator[](const char *name) const;
 
-private:
+protected:
+  SubMaster(const std::vector<const char *> &service_list, const char *address,
+            const std::vector<const char *> &ignore_alive, bool conflate);
   bool all_(const std::vector<const char *> &service_list, bool valid, bool alive);
   Poller *poller_ = nullptr;
   struct SubMessage;
@@ -92,6 +96,36 @@ private:
   std::map<std::string, SubMessage *> services_;
 };
 
+// SubMaster that receives every message on its sockets instead of only the latest one,
+// and hands them out in logMonoTime order across all services. A message is held back
+// until window_ns after it arrived, so messages from other services that were sent
+// earlier but arrive a little later still get in front of it. The window is timed by
+// the local clock, logMonoTime only orders, so replayed logs from another boot work too.
+// Messages arriving after the window has passed them are returned in the next batch.
+class OrderedSubMaster : public SubMaster {
+public:
+  OrderedSubMaster(const std::vector<const char *> &service_list, uint64_t window_ns,
+                   const char *address = nullptr, const std::vector<const char *> &ignore_alive = {});
+  // Returns the released messages sorted by logMonoTime. The readers stay valid until the next call,
+  // sm[name] until name receives a newer message.
+  const std::vector<std::pair<std::string, cereal::Event::Reader>> &update(int timeout = 1000);
+  void drain();
+
+private:
+  struct PendingMessage {
+    std::string name;
+    kj::Array<capnp::word> words;
+    std::unique_ptr<capnp::FlatArrayMessageReader> reader;
+  };
+  uint64_t window_ns_;
+  std::multimap<uint64_t, PendingMessage> pending_;
+  // local arrival time and logMonoTime of every pending message, in arrival order
+  std::deque<std::pair<uint64_t, uint64_t>> arrivals_;
+  std::vector<PendingMessage> released_;
+  std::map<std::string, PendingMessage> latest_;
+  std::vector<std::pair<std::string, cereal::Event::Reader>> events_;
+};
+
 class MessageBuilder : public capnp::MallocMessageBuilder {
 public:
   MessageBuilder() = default;
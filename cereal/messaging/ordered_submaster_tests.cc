@@ -0,0 +1,58 @@
+#include "catch2/catch.hpp"
+
+#include <time.h>
+
+#include <vector>
+
+#include "messaging.h"
+
+static uint64_t nanos_now() {
+  struct timespec t;
+  clock_gettime(CLOCK_BOOTTIME, &t);
+  return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void send(PubMaster &pm, const char *name, uint64_t log_mono_time) {
+  MessageBuilder msg;
+  auto event = msg.initEvent();
+  if (std::string(name) == "sensorEvents") {
+    event.initSensorEvents(0);
+  } else {
+    event.initCameraOdometry();
+  }
+  event.setLogMonoTime(log_mono_time);
+  pm.send(name, msg);
+}
+
+TEST_CASE("OrderedSubMaster holds messages by their local arrival time") {
+  const uint64_t window_ns = 50 * 1000000ULL;
+  const uint64_t hour_ns = 3600 * 1000000000ULL;
+
+  // replayed logs carry another boot's clock, far ahead of or behind this one
+  uint64_t base = 0;
+  SECTION("stamps ahead of the local clock") { base = nanos_now() + hour_ns; }
+  SECTION("stamps behind the local clock") { base = 1000; }
+
+  OrderedSubMaster sm({"sensorEvents", "cameraOdometry"}, window_ns);
+  PubMaster pm({"sensorEvents", "cameraOdometry"});
+
+  const uint64_t t_send = nanos_now();
+  send(pm, "cameraOdometry", base + 2);
+  send(pm, "sensorEvents", base + 3);
+  send(pm, "sensorEvents", base + 1);
+
+  std::vector<uint64_t> released;
+  uint64_t t_first = 0, t_last = 0;
+  while (released.size() < 3 && nanos_now() - t_send < 1000000000ULL) {
+    for (auto &[name, event] : sm.update(10)) {
+      released.push_back(event.getLogMonoTime());
+      t_last = nanos_now();
+      if (t_first == 0) t_first = t_last;
+    }
+  }
+
+  // in logMonoTime order, not before the window has passed and not held much longer
+  REQUIRE(released == std::vector<uint64_t>{base + 1, base + 2, base + 3});
+  REQUIRE(t_first - t_send >= window_ns);
+  REQUIRE(t_last - t_send < window_ns + 100 * 1000000ULL);
+}
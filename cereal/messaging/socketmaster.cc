@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <string>
 #include <mutex>
+#include <algorithm>
 
 #include "services.h"
 #include "messaging.h"
@@ -57,12 +58,16 @@ struct SubMaster::SubMessage {
 };
 
 SubMaster::SubMaster(const std::vector<const char *> &service_list, const char *address,
-                     const std::vector<const char *> &ignore_alive) {
+                     const std::vector<const char *> &ignore_alive)
+    : SubMaster(service_list, address, ignore_alive, true) {}
+
+SubMaster::SubMaster(const std::vector<const char *> &service_list, const char *address,
+                     const std::vector<const char *> &ignore_alive, bool conflate) {
   poller_ = Poller::create();
   for (auto name : service_list) {
     const service *serv = get_service(name);
     assert(serv != nullptr);
-    SubSocket *socket = SubSocket::create(message_context.context(), name, address ? address : "127.0.0.1", true);
+    SubSocket *socket = SubSocket::create(message_context.context(), name, address ? address : "127.0.0.1", conflate);
     assert(socket != 0);
     poller_->registerSocket(socket);
     SubMessage *m = new SubMessage{
@@ -78,8 +83,6 @@ SubMaster::SubMaster(const std::vector<const char *> &service_list, const char *
 }
 
 void SubMaster::update(int timeout) {
-  for (auto &kv : messages_) kv.second->updated = false;
-
   auto sockets = poller_->poll(timeout);
   uint64_t current_time = nanos_since_boot();
 
@@ -105,6 +108,8 @@ void SubMaster::update(int timeout) {
 void SubMaster::update_msgs(uint64_t current_time, const std::vector<std::pair<std::string, cereal::Event::Reader>> &messages){
   if (++frame == UINT64_MAX) frame = 1;
 
+  // callers that feed messages directly, like OrderedSubMaster, go through here too
+  for (auto &kv : messages_) kv.second->updated = false;
   for(auto &kv : messages) {
     auto m_find = services_.find(kv.first);
     if (m_find == services_.end()){
@@ -186,6 +191,75 @@ SubMaster::~SubMaster() {
   }
 }
 
+OrderedSubMaster::OrderedSubMaster(const std::vector<const char *> &service_list, uint64_t window_ns,
+                                   const char *address, const std::vector<const char *> &ignore_alive)
+    : SubMaster(service_list, address, ignore_alive, false), window_ns_(window_ns) {}
+
+const std::vector<std::pair<std::string, cereal::Event::Reader>> &OrderedSubMaster::update(int timeout) {
+  events_.clear();
+  // operator[] keeps reading the newest message of every service, even when this
+  // batch has none for it, so those are kept until the service gets a newer one
+  for (auto &m : released_) {
+    latest_[m.name] = std::move(m);
+  }
+  released_.clear();
+
+  // don't sleep past the moment the oldest pending message is due
+  if (!arrivals_.empty()) {
+    uint64_t now = nanos_since_boot();
+    uint64_t due = arrivals_.front().first + window_ns_;
+    int wait_ms = due <= now ? 0 : (due - now + 999999) / 1000000;
+    if (timeout < 0 || wait_ms < timeout) timeout = wait_ms;
+  }
+
+  for (auto s : poller_->poll(timeout)) {
+    const std::string &name = messages_.at(s)->name;
+    const uint64_t arrival = nanos_since_boot();
+    // sockets aren't conflated, read everything that queued up since the last poll
+    while (Message *msg = s->receive(true)) {
+      PendingMessage m = {.name = name, .words = kj::heapArray<capnp::word>(msg->getSize() / sizeof(capnp::word) + 1)};
+      memcpy(m.words.begin(), msg->getData(), msg->getSize());
+      delete msg;
+
+      capnp::ReaderOptions options;
+      options.traversalLimitInWords = kj::maxValue; // Don't limit
+      m.reader = std::make_unique<capnp::FlatArrayMessageReader>(m.words.asPtr(), options);
+      uint64_t log_mono_time = m.reader->getRoot<cereal::Event>().getLogMonoTime();
+      // equal timestamps keep their arrival order
+      pending_.emplace(log_mono_time, std::move(m));
+      arrivals_.push_back({arrival, log_mono_time});
+    }
+  }
+
+  // The window runs on the local clock from when a message arrived, logMonoTime comes from
+  // the sender's clock, which in a replay is another boot's. Everything sent before the
+  // newest message that is due goes out with it.
+  uint64_t current_time = nanos_since_boot();
+  bool due = false;
+  uint64_t release_until = 0;
+  while (!arrivals_.empty() && arrivals_.front().first + window_ns_ <= current_time) {
+    release_until = due ? std::max(release_until, arrivals_.front().second) : arrivals_.front().second;
+    due = true;
+    arrivals_.pop_front();
+  }
+  while (due && !pending_.empty() && pending_.begin()->first <= release_until) {
+    released_.push_back(std::move(pending_.begin()->second));
+    pending_.erase(pending_.begin());
+  }
+  for (auto &m : released_) {
+    events_.push_back({m.name, m.reader->getRoot<cereal::Event>()});
+  }
+
+  update_msgs(current_time, events_);
+  return events_;
+}
+
+void OrderedSubMaster::drain() {
+  SubMaster::drain();
+  pending_.clear();
+  arrivals_.clear();
+}
+
 PubMaster::PubMaster(const std::vector<const char *> &service_list) {
   for (auto name : service_list) {
     assert(get_service(name) != nullptr);
@@ -62,6 +62,10 @@ services = {
   "managerState": (True, 2., 1),
   "uploaderState": (True, 0., 1),
   "liveMapData": (False, 0.),
+  "boarddLoopStats": (True, 0.2, 1),
+  "sensordLoopStats": (True, 0.2, 1),
+  "modeldLoopStats": (True, 0.2, 1),
+  "locationdLoopStats": (True, 0.2, 1),
 
   # debug
   "testJoystick": (False, 0.),
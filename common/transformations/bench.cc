@@ -0,0 +1,112 @@
+// Compares the single point conversions called in a loop against the batch versions.
+//
+//   ./bench [points]...
+//
+// Runs 10k, 100k and 1M points by default.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <eigen3/Eigen/Dense>
+
+#include "coordinates.hpp"
+#include "orientation.hpp"
+
+template <typename F>
+static double time_us(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char *name, size_t n, double single_us, double batch_us) {
+  printf("  %-14s single %8.3f us/pt  batch %8.3f us/pt  x%.1f\n", name, single_us / n, batch_us / n, single_us / batch_us);
+}
+
+static void bench(size_t n) {
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> u(0., 1.);
+  std::vector<double> geodetic(3 * n), euler(3 * n);
+  for (size_t i = 0; i < n; i++) {
+    geodetic[3 * i] = -89 + 178 * u(gen);
+    geodetic[3 * i + 1] = -180 + 360 * u(gen);
+    geodetic[3 * i + 2] = -100 + 9000 * u(gen);
+    euler[3 * i] = -3 + 6 * u(gen);
+    euler[3 * i + 1] = -1.5 + 3 * u(gen);
+    euler[3 * i + 2] = -3 + 6 * u(gen);
+  }
+  std::vector<double> ecef(3 * n), out3(3 * n), quat(4 * n), out4(4 * n), rot(9 * n);
+  geodetic2ecef(geodetic.data(), ecef.data(), n);
+  euler2quat(euler.data(), quat.data(), n);
+  LocalCoord lc((Geodetic){37., -122., 10.});
+
+  printf("%zu points\n", n);
+  double single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      ECEF e = geodetic2ecef((Geodetic){geodetic[3 * i], geodetic[3 * i + 1], geodetic[3 * i + 2]});
+      out3[3 * i] = e.x, out3[3 * i + 1] = e.y, out3[3 * i + 2] = e.z;
+    }
+  });
+  report("geodetic2ecef", n, single, time_us([&] { geodetic2ecef(geodetic.data(), out3.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      Geodetic g = ecef2geodetic((ECEF){ecef[3 * i], ecef[3 * i + 1], ecef[3 * i + 2]});
+      out3[3 * i] = g.lat, out3[3 * i + 1] = g.lon, out3[3 * i + 2] = g.alt;
+    }
+  });
+  report("ecef2geodetic", n, single, time_us([&] { ecef2geodetic(ecef.data(), out3.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      NED ned = lc.ecef2ned((ECEF){ecef[3 * i], ecef[3 * i + 1], ecef[3 * i + 2]});
+      out3[3 * i] = ned.n, out3[3 * i + 1] = ned.e, out3[3 * i + 2] = ned.d;
+    }
+  });
+  report("ecef2ned", n, single, time_us([&] { lc.ecef2ned(ecef.data(), out3.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      Eigen::Quaterniond q = euler2quat(Eigen::Vector3d(euler[3 * i], euler[3 * i + 1], euler[3 * i + 2]));
+      out4[4 * i] = q.w(), out4[4 * i + 1] = q.x(), out4[4 * i + 2] = q.y(), out4[4 * i + 3] = q.z();
+    }
+  });
+  report("euler2quat", n, single, time_us([&] { euler2quat(euler.data(), out4.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      Eigen::Vector3d e = quat2euler(Eigen::Quaterniond(quat[4 * i], quat[4 * i + 1], quat[4 * i + 2], quat[4 * i + 3]));
+      out3[3 * i] = e(0), out3[3 * i + 1] = e(1), out3[3 * i + 2] = e(2);
+    }
+  });
+  report("quat2euler", n, single, time_us([&] { quat2euler(quat.data(), out3.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      Eigen::Matrix3d r = quat2rot(Eigen::Quaterniond(quat[4 * i], quat[4 * i + 1], quat[4 * i + 2], quat[4 * i + 3]));
+      Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>> m(&rot[9 * i]);
+      m = r;
+    }
+  });
+  report("quat2rot", n, single, time_us([&] { quat2rot(quat.data(), rot.data(), n); }));
+
+  single = time_us([&] {
+    for (size_t i = 0; i < n; i++) {
+      Eigen::Vector3d e = rot2euler(Eigen::Map<Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(&rot[9 * i]));
+      out3[3 * i] = e(0), out3[3 * i + 1] = e(1), out3[3 * i + 2] = e(2);
+    }
+  });
+  report("rot2euler", n, single, time_us([&] { rot2euler(rot.data(), out3.data(), n); }));
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1) {
+    for (int i = 1; i < argc; i++) bench(atol(argv[i]));
+  } else {
+    for (size_t n : {10000, 100000, 1000000}) bench(n);
+  }
+  return 0;
+}
@@ -8,18 +8,13 @@
 
 
 
-double a = 6378137; // lgtm [cpp/short-global-name]
-double b = 6356752.3142; // lgtm [cpp/short-global-name]
-double esq = 6.69437999014 * 0.001; // lgtm [cpp/short-global-name]
-double e1sq = 6.73949674228 * 0.001;
+// const, so the batch loops don't reload them for every point
+const double a = 6378137; // lgtm [cpp/short-global-name]
+const double b = 6356752.3142; // lgtm [cpp/short-global-name]
+const double esq = 6.69437999014 * 0.001; // lgtm [cpp/short-global-name]
+const double e1sq = 6.73949674228 * 0.001;
 
 
-static Geodetic to_degrees(Geodetic geodetic){
-  geodetic.lat = RAD2DEG(geodetic.lat);
-  geodetic.lon = RAD2DEG(geodetic.lon);
-  return geodetic;
-}
-
 static Geodetic to_radians(Geodetic geodetic){
   geodetic.lat = DEG2RAD(geodetic.lat);
   geodetic.lon = DEG2RAD(geodetic.lon);
@@ -27,40 +22,71 @@ static Geodetic to_radians(Geodetic geodetic){
 }
 
 
-ECEF geodetic2ecef(Geodetic g){
-  g = to_radians(g);
-  double xi = sqrt(1.0 - esq * pow(sin(g.lat), 2));
-  double x = (a / xi + g.alt) * cos(g.lat) * cos(g.lon);
-  double y = (a / xi + g.alt) * cos(g.lat) * sin(g.lon);
-  double z = (a / xi * (1.0 - esq) + g.alt) * sin(g.lat);
-  return {x, y, z};
+// The conversions of a single point, shared by the single point and the batch functions.
+// Branch free with no calls besides the math functions, so the batch loops can be unrolled
+// and the compiler is free to vectorize what it can.
+static inline void geodetic2ecef_point(const double *g, double *e){
+  double lat = DEG2RAD(g[0]);
+  double lon = DEG2RAD(g[1]);
+  double alt = g[2];
+
+  double sin_lat = sin(lat), cos_lat = cos(lat);
+  double xi = sqrt(1.0 - esq * sin_lat * sin_lat);
+  e[0] = (a / xi + alt) * cos_lat * cos(lon);
+  e[1] = (a / xi + alt) * cos_lat * sin(lon);
+  e[2] = (a / xi * (1.0 - esq) + alt) * sin_lat;
 }
 
-Geodetic ecef2geodetic(ECEF e){
+static inline void ecef2geodetic_point(const double *e, double *g){
   // Convert from ECEF to geodetic using Ferrari's methods
   // https://en.wikipedia.org/wiki/Geographic_coordinate_conversion#Ferrari.27s_solution
-  double x = e.x;
-  double y = e.y;
-  double z = e.z;
+  double x = e[0];
+  double y = e[1];
+  double z = e[2];
 
   double r = sqrt(x * x + y * y);
   double Esq = a * a - b * b;
   double F = 54 * b * b * z * z;
   double G = r * r + (1 - esq) * z * z - esq * Esq;
-  double C = (esq * esq * F * r * r) / (pow(G, 3));
+  double C = (esq * esq * F * r * r) / (G * G * G);
   double S = cbrt(1 + C + sqrt(C * C + 2 * C));
-  double P = F / (3 * pow((S + 1 / S + 1), 2) * G * G);
+  double S1 = S + 1 / S + 1;
+  double P = F / (3 * (S1 * S1) * G * G);
   double Q = sqrt(1 + 2 * esq * esq * P);
   double r_0 = -(P * esq * r) / (1 + Q) + sqrt(0.5 * a * a*(1 + 1.0 / Q) - P * (1 - esq) * z * z / (Q * (1 + Q)) - 0.5 * P * r * r);
-  double U = sqrt(pow((r - esq * r_0), 2) + z * z);
-  double V = sqrt(pow((r - esq * r_0), 2) + (1 - esq) * z * z);
+  double r_e = r - esq * r_0;
+  double U = sqrt(r_e * r_e + z * z);
+  double V = sqrt(r_e * r_e + (1 - esq) * z * z);
   double Z_0 = b * b * z / (a * V);
   double h = U * (1 - b * b / (a * V));
 
-  double lat = atan((z + e1sq * Z_0) / r);
-  double lon = atan2(y, x);
+  g[0] = RAD2DEG(atan((z + e1sq * Z_0) / r));
+  g[1] = RAD2DEG(atan2(y, x));
+  g[2] = h;
+}
+
+ECEF geodetic2ecef(Geodetic g){
+  double in[3] = {g.lat, g.lon, g.alt}, out[3];
+  geodetic2ecef_point(in, out);
+  return {out[0], out[1], out[2]};
+}
+
+Geodetic ecef2geodetic(ECEF e){
+  double in[3] = {e.x, e.y, e.z}, out[3];
+  ecef2geodetic_point(in, out);
+  return {out[0], out[1], out[2]};
+}
+
+void geodetic2ecef(const double *geodetic, double *ecef, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    geodetic2ecef_point(&geodetic[3 * i], &ecef[3 * i]);
+  }
+}
 
-  return to_degrees({lat, lon, h});
+void ecef2geodetic(const double *ecef, double *geodetic, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    ecef2geodetic_point(&ecef[3 * i], &geodetic[3 * i]);
+  }
 }
 
 LocalCoord::LocalCoord(Geodetic g, ECEF e){
@@ -100,3 +126,38 @@ Geodetic LocalCoord::ned2geodetic(NED n){
   ECEF e = ned2ecef(n);
   return ::ecef2geodetic(e);
 }
+
+// The batch versions apply the matrices with plain loops over the points, instead of
+// going through an Eigen vector per point
+void LocalCoord::ecef2ned(const double *ecef, double *ned, size_t n) {
+  const Eigen::Matrix3d &m = ecef2ned_matrix;
+  const double x0 = init_ecef[0], y0 = init_ecef[1], z0 = init_ecef[2];
+  for (size_t i = 0; i < n; i++) {
+    double x = ecef[3 * i] - x0, y = ecef[3 * i + 1] - y0, z = ecef[3 * i + 2] - z0;
+    ned[3 * i] = m(0, 0) * x + m(0, 1) * y + m(0, 2) * z;
+    ned[3 * i + 1] = m(1, 0) * x + m(1, 1) * y + m(1, 2) * z;
+    ned[3 * i + 2] = m(2, 0) * x + m(2, 1) * y + m(2, 2) * z;
+  }
+}
+
+void LocalCoord::ned2ecef(const double *ned, double *ecef, size_t n) {
+  const Eigen::Matrix3d &m = ned2ecef_matrix;
+  const double x0 = init_ecef[0], y0 = init_ecef[1], z0 = init_ecef[2];
+  for (size_t i = 0; i < n; i++) {
+    double x = ned[3 * i], y = ned[3 * i + 1], z = ned[3 * i + 2];
+    ecef[3 * i] = m(0, 0) * x + m(0, 1) * y + m(0, 2) * z + x0;
+    ecef[3 * i + 1] = m(1, 0) * x + m(1, 1) * y + m(1, 2) * z + y0;
+    ecef[3 * i + 2] = m(2, 0) * x + m(2, 1) * y + m(2, 2) * z + z0;
+  }
+}
+
+void LocalCoord::geodetic2ned(const double *geodetic, double *ned, size_t n) {
+  // in place through the output buffer
+  ::geodetic2ecef(geodetic, ned, n);
+  ecef2ned(ned, ned, n);
+}
+
+void LocalCoord::ned2geodetic(const double *ned, double *geodetic, size_t n) {
+  ned2ecef(ned, geodetic, n);
+  ::ecef2geodetic(geodetic, geodetic, n);
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #define DEG2RAD(x) ((x) * M_PI / 180.0)
 #define RAD2DEG(x) ((x) * 180.0 / M_PI)
 
@@ -25,6 +27,11 @@ struct Geodetic {
 ECEF geodetic2ecef(Geodetic g);
 Geodetic ecef2geodetic(ECEF e);
 
+// Batch versions on n points, stored as contiguous (x, y, z), (n, e, d) or (lat, lon, alt)
+// triples like an n x 3 numpy array. Input and output may be the same buffer.
+void geodetic2ecef(const double *geodetic, double *ecef, size_t n);
+void ecef2geodetic(const double *ecef, double *geodetic, size_t n);
+
 class LocalCoord {
 public:
   Eigen::Matrix3d ned2ecef_matrix;
@@ -38,4 +45,9 @@ public:
   ECEF ned2ecef(NED n);
   NED geodetic2ned(Geodetic g);
   Geodetic ned2geodetic(NED n);
+
+  void ecef2ned(const double *ecef, double *ned, size_t n);
+  void ned2ecef(const double *ned, double *ecef, size_t n);
+  void geodetic2ned(const double *geodetic, double *ned, size_t n);
+  void ned2geodetic(const double *ned, double *geodetic, size_t n);
 };
@@ -7,6 +7,51 @@
 #include "orientation.hpp"
 #include "coordinates.hpp"
 
+// The conversions of a single point, shared by the single point and the batch functions.
+// Quaternions are (w, x, y, z), rotation matrices row major.
+static inline void euler2quat_point(const double *euler, double *quat){
+  // Rz(yaw) * Ry(pitch) * Rx(roll) written out, instead of multiplying three angle axis quaternions
+  double cr = cos(euler[0] / 2), sr = sin(euler[0] / 2);
+  double cp = cos(euler[1] / 2), sp = sin(euler[1] / 2);
+  double cy = cos(euler[2] / 2), sy = sin(euler[2] / 2);
+  double w = cr * cp * cy + sr * sp * sy;
+  double x = sr * cp * cy - cr * sp * sy;
+  double y = cr * sp * cy + sr * cp * sy;
+  double z = cr * cp * sy - sr * sp * cy;
+
+  // ensure_unique
+  double sign = w > 0 ? 1.0 : -1.0;
+  quat[0] = sign * w;
+  quat[1] = sign * x;
+  quat[2] = sign * y;
+  quat[3] = sign * z;
+}
+
+static inline void quat2euler_point(const double *quat, double *euler){
+  double w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+  euler[0] = atan2(2 * (w * x + y * z), 1 - 2 * (x * x + y * y));
+  euler[1] = asin(std::clamp(2 * (w * y - z * x), -1.0, 1.0));
+  euler[2] = atan2(2 * (w * z + x * y), 1 - 2 * (y * y + z * z));
+}
+
+static inline void quat2rot_point(const double *quat, double *rot){
+  // same operations as Eigen's toRotationMatrix
+  double w = quat[0], x = quat[1], y = quat[2], z = quat[3];
+  double tx = 2 * x, ty = 2 * y, tz = 2 * z;
+  double twx = tx * w, twy = ty * w, twz = tz * w;
+  double txx = tx * x, txy = ty * x, txz = tz * x;
+  double tyy = ty * y, tyz = tz * y, tzz = tz * z;
+  rot[0] = 1 - (tyy + tzz);
+  rot[1] = txy - twz;
+  rot[2] = txz + twy;
+  rot[3] = txy + twz;
+  rot[4] = 1 - (txx + tzz);
+  rot[5] = tyz - twx;
+  rot[6] = txz - twy;
+  rot[7] = tyz + twx;
+  rot[8] = 1 - (txx + tyy);
+}
+
 Eigen::Quaterniond ensure_unique(Eigen::Quaterniond quat){
   if (quat.w() > 0){
     return quat;
@@ -16,12 +61,9 @@ Eigen::Quaterniond ensure_unique(Eigen::Quaterniond quat){
 }
 
 Eigen::Quaterniond euler2quat(Eigen::Vector3d euler){
-  Eigen::Quaterniond q;
-
-  q = Eigen::AngleAxisd(euler(2), Eigen::Vector3d::UnitZ())
-    * Eigen::AngleAxisd(euler(1), Eigen::Vector3d::UnitY())
-    * Eigen::AngleAxisd(euler(0), Eigen::Vector3d::UnitX());
-  return ensure_unique(q);
+  double q[4];
+  euler2quat_point(euler.data(), q);
+  return Eigen::Quaterniond(q[0], q[1], q[2], q[3]);
 }
 
 
@@ -29,11 +71,10 @@ Eigen::Vector3d quat2euler(Eigen::Quaterniond quat){
   // TODO: switch to eigen implementation if the range of the Euler angles doesn't matter anymore
   // Eigen::Vector3d euler = quat.toRotationMatrix().eulerAngles(2, 1, 0);
   // return {euler(2), euler(1), euler(0)};
-  double gamma = atan2(2 * (quat.w() * quat.x() + quat.y() * quat.z()), 1 - 2 * (quat.x()*quat.x() + quat.y()*quat.y()));
-  double asin_arg_clipped = std::clamp(2 * (quat.w() * quat.y() - quat.z() * quat.x()), -1.0, 1.0);
-  double theta = asin(asin_arg_clipped);
-  double psi = atan2(2 * (quat.w() * quat.z() + quat.x() * quat.y()), 1 - 2 * (quat.y()*quat.y() + quat.z()*quat.z()));
-  return {gamma, theta, psi};
+  double q[4] = {quat.w(), quat.x(), quat.y(), quat.z()};
+  Eigen::Vector3d euler;
+  quat2euler_point(q, euler.data());
+  return euler;
 }
 
 Eigen::Matrix3d quat2rot(Eigen::Quaterniond quat){
@@ -56,6 +97,51 @@ Eigen::Matrix3d rot_matrix(double roll, double pitch, double yaw){
   return euler2rot({roll, pitch, yaw});
 }
 
+void euler2quat(const double *euler, double *quat, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    euler2quat_point(&euler[3 * i], &quat[4 * i]);
+  }
+}
+
+void quat2euler(const double *quat, double *euler, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    quat2euler_point(&quat[4 * i], &euler[3 * i]);
+  }
+}
+
+void quat2rot(const double *quat, double *rot, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    quat2rot_point(&quat[4 * i], &rot[9 * i]);
+  }
+}
+
+void rot2quat(const double *rot, double *quat, size_t n){
+  // Eigen's conversion branches on the trace, the loop just saves the per call overhead
+  for (size_t i = 0; i < n; i++) {
+    Eigen::Quaterniond q = rot2quat(Eigen::Map<const Eigen::Matrix<double, 3, 3, Eigen::RowMajor>>(&rot[9 * i]));
+    quat[4 * i] = q.w();
+    quat[4 * i + 1] = q.x();
+    quat[4 * i + 2] = q.y();
+    quat[4 * i + 3] = q.z();
+  }
+}
+
+void euler2rot(const double *euler, double *rot, size_t n){
+  for (size_t i = 0; i < n; i++) {
+    double q[4];
+    euler2quat_point(&euler[3 * i], q);
+    quat2rot_point(q, &rot[9 * i]);
+  }
+}
+
+void rot2euler(const double *rot, double *euler, size_t n){
+  double q[4];
+  for (size_t i = 0; i < n; i++) {
+    rot2quat(&rot[9 * i], q, 1);
+    quat2euler_point(q, &euler[3 * i]);
+  }
+}
+
 Eigen::Matrix3d rot(Eigen::Vector3d axis, double angle){
   Eigen::Quaterniond q;
   q = Eigen::AngleAxisd(angle, axis);
@@ -54,6 +54,10 @@ cdef Geodetic list2geodetic(geodetic):
     g.alt = geodetic[2]
     return g
 
+cdef batch_output(const double[:, ::1] inp, int in_size, int out_size):
+    assert inp.shape[1] == in_size
+    return np.empty((inp.shape[0], out_size))
+
 def euler2quat_single(euler):
     cdef Vector3 e = Vector3(euler[0], euler[1], euler[2])
     cdef Quaternion q = euler2quat_c(e)
@@ -84,6 +88,49 @@ def rot2euler_single(rot):
     cdef Vector3 e = rot2euler_c(r)
     return [e(0), e(1), e(2)]
 
+# Batch versions on an n x k array, e.g. n x 3 euler angles or n x 9 rotation matrices
+def euler2quat_batch(const double[:, ::1] euler):
+    out = batch_output(euler, 3, 4)
+    cdef double[:, ::1] q = out
+    if q.shape[0] > 0:
+        euler2quat_c(&euler[0, 0], &q[0, 0], q.shape[0])
+    return out
+
+def quat2euler_batch(const double[:, ::1] quat):
+    out = batch_output(quat, 4, 3)
+    cdef double[:, ::1] e = out
+    if e.shape[0] > 0:
+        quat2euler_c(&quat[0, 0], &e[0, 0], e.shape[0])
+    return out
+
+def quat2rot_batch(const double[:, ::1] quat):
+    out = batch_output(quat, 4, 9)
+    cdef double[:, ::1] r = out
+    if r.shape[0] > 0:
+        quat2rot_c(&quat[0, 0], &r[0, 0], r.shape[0])
+    return out
+
+def rot2quat_batch(const double[:, ::1] rot):
+    out = batch_output(rot, 9, 4)
+    cdef double[:, ::1] q = out
+    if q.shape[0] > 0:
+        rot2quat_c(&rot[0, 0], &q[0, 0], q.shape[0])
+    return out
+
+def euler2rot_batch(const double[:, ::1] euler):
+    out = batch_output(euler, 3, 9)
+    cdef double[:, ::1] r = out
+    if r.shape[0] > 0:
+        euler2rot_c(&euler[0, 0], &r[0, 0], r.shape[0])
+    return out
+
+def rot2euler_batch(const double[:, ::1] rot):
+    out = batch_output(rot, 9, 3)
+    cdef double[:, ::1] e = out
+    if e.shape[0] > 0:
+        rot2euler_c(&rot[0, 0], &e[0, 0], e.shape[0])
+    return out
+
 def rot_matrix(roll, pitch, yaw):
     return matrix2numpy(rot_matrix_c(roll, pitch, yaw))
 
@@ -111,6 +158,20 @@ def ecef2geodetic_single(ecef):
     cdef Geodetic g = ecef2geodetic_c(e)
     return [g.lat, g.lon, g.alt]
 
+def geodetic2ecef_batch(const double[:, ::1] geodetic):
+    out = batch_output(geodetic, 3, 3)
+    cdef double[:, ::1] e = out
+    if e.shape[0] > 0:
+        geodetic2ecef_c(&geodetic[0, 0], &e[0, 0], e.shape[0])
+    return out
+
+def ecef2geodetic_batch(const double[:, ::1] ecef):
+    out = batch_output(ecef, 3, 3)
+    cdef double[:, ::1] g = out
+    if g.shape[0] > 0:
+        ecef2geodetic_c(&ecef[0, 0], &g[0, 0], g.shape[0])
+    return out
+
 
 cdef class LocalCoord:
     cdef LocalCoord_c * lc
@@ -170,5 +231,37 @@ cdef class LocalCoord:
         cdef Geodetic g = self.lc.ned2geodetic(n)
         return [g.lat, g.lon, g.alt]
 
+    def ecef2ned_batch(self, const double[:, ::1] ecef):
+        assert self.lc
+        out = batch_output(ecef, 3, 3)
+        cdef double[:, ::1] n = out
+        if n.shape[0] > 0:
+            self.lc.ecef2ned(&ecef[0, 0], &n[0, 0], n.shape[0])
+        return out
+
+    def ned2ecef_batch(self, const double[:, ::1] ned):
+        assert self.lc
+        out = batch_output(ned, 3, 3)
+        cdef double[:, ::1] e = out
+        if e.shape[0] > 0:
+            self.lc.ned2ecef(&ned[0, 0], &e[0, 0], e.shape[0])
+        return out
+
+    def geodetic2ned_batch(self, const double[:, ::1] geodetic):
+        assert self.lc
+        out = batch_output(geodetic, 3, 3)
+        cdef double[:, ::1] n = out
+        if n.shape[0] > 0:
+            self.lc.geodetic2ned(&geodetic[0, 0], &n[0, 0], n.shape[0])
+        return out
+
+    def ned2geodetic_batch(self, const double[:, ::1] ned):
+        assert self.lc
+        out = batch_output(ned, 3, 3)
+        cdef double[:, ::1] g = out
+        if g.shape[0] > 0:
+            self.lc.ned2geodetic(&ned[0, 0], &g[0, 0], g.shape[0])
+        return out
+
     def __dealloc__(self):
         del self.lc
@@ -20,43 +20,67 @@ namespace EKFS {
 
 typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixXdr;
 
-typedef struct Observation {
+// Observations vary in size by kind, MAX_DIM_Z bounds them so they can be stored without allocating
+template <int MAX_DIM_Z>
+struct ObservationT {
+  typedef Eigen::Matrix<double, Eigen::Dynamic, 1, Eigen::ColMajor, MAX_DIM_Z, 1> VectorZ;
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor, MAX_DIM_Z, MAX_DIM_Z> MatrixR;
+
   double t;
   int kind;
-  std::vector<Eigen::VectorXd> z;
-  std::vector<MatrixXdr> R;
+  std::vector<VectorZ> z;
+  std::vector<MatrixR> R;
   std::vector<std::vector<double>> extra_args;
-} Observation;
+};
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+struct EstimateT {
+  typedef typename ObservationT<MAX_DIM_Z>::VectorZ VectorZ;
 
-typedef struct Estimate {
-  Eigen::VectorXd xk1;
-  Eigen::VectorXd xk;
-  MatrixXdr Pk1;
-  MatrixXdr Pk;
+  Eigen::Matrix<double, DIM_X, 1> xk1;
+  Eigen::Matrix<double, DIM_X, 1> xk;
+  Eigen::Matrix<double, DIM_ERR, DIM_ERR, Eigen::RowMajor> Pk1;
+  Eigen::Matrix<double, DIM_ERR, DIM_ERR, Eigen::RowMajor> Pk;
   double t;
   int kind;
-  std::vector<Eigen::VectorXd> y;
-  std::vector<Eigen::VectorXd> z;
+  std::vector<VectorZ> y;
+  std::vector<VectorZ> z;
   std::vector<std::vector<double>> extra_args;
-} Estimate;
+};
 
-class EKFSym {
+// EKF on the sympy generated functions. By default all dimensions are dynamic, filters with a
+// known layout can fix them at compile time so the state, covariance and observations live
+// inline instead of on the heap.
+template <int DIM_X = Eigen::Dynamic, int DIM_ERR = Eigen::Dynamic, int MAX_DIM_Z = Eigen::Dynamic>
+class EKFSymT {
 public:
-  EKFSym(std::string name, Eigen::Map<MatrixXdr> Q, Eigen::Map<Eigen::VectorXd> x_initial,
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  typedef Eigen::Matrix<double, DIM_X, 1> VectorX;
+  typedef Eigen::Matrix<double, DIM_ERR, DIM_ERR, Eigen::RowMajor> MatrixP;
+  typedef ObservationT<MAX_DIM_Z> Observation;
+  typedef EstimateT<DIM_X, DIM_ERR, MAX_DIM_Z> Estimate;
+  typedef typename Observation::VectorZ VectorZ;
+  typedef typename Observation::MatrixR MatrixR;
+
+  EKFSymT(std::string name, Eigen::Map<MatrixXdr> Q, Eigen::Map<Eigen::VectorXd> x_initial,
       Eigen::Map<MatrixXdr> P_initial, int dim_main, int dim_main_err, int N = 0, int dim_augment = 0,
       int dim_augment_err = 0, std::vector<int> maha_test_kinds = std::vector<int>(),
       std::vector<int> quaternion_idxs = std::vector<int>(),
-      std::vector<std::string> global_vars = std::vector<std::string>(), double max_rewind_age = 1.0);
+      std::vector<std::string> global_vars = std::vector<std::string>(), double max_rewind_age = 1.0,
+      int checkpoint_interval = 1);
   void init_state(Eigen::Map<Eigen::VectorXd> state, Eigen::Map<MatrixXdr> covs, double filter_time);
 
-  Eigen::VectorXd state();
-  MatrixXdr covs();
+  VectorX state();
+  MatrixP covs();
   void set_filter_time(double t);
   double get_filter_time();
   void normalize_quaternions();
   void normalize_slice(int slice_start, int slice_end_ex);
   void set_global(std::string global_var, double val);
   void reset_rewind();
+  uint64_t get_rewind_count();
+  uint64_t get_dropped_count();
 
   void predict(double t);
   std::optional<Estimate> predict_and_update_batch(double t, int kind, std::vector<Eigen::Map<Eigen::VectorXd>> z,
@@ -65,17 +89,24 @@ public:
   extra_routine_t get_extra_routine(const std::string& routine);
 
 private:
-  std::deque<Observation> rewind(double t);
+  struct Snapshot {
+    uint64_t seq;  // last observation applied
+    double t;
+    VectorX x;
+    MatrixP P;
+  };
+
+  int rewind(double t);
   void checkpoint(Observation& obs);
 
-  Estimate predict_and_update_batch(Observation& obs, bool augment);
-  Eigen::VectorXd update(int kind, Eigen::VectorXd z, MatrixXdr R, std::vector<double> extra_args);
+  void predict_and_update_batch(Observation& obs, bool augment, Estimate *res);
+  VectorZ update(int kind, const VectorZ &z, MatrixR &R, std::vector<double> &extra_args);
 
   // stuct with linked sympy generated functions
   const EKF *ekf = NULL;
 
-  Eigen::VectorXd x;  // state
-  MatrixXdr P;  // covs
+  VectorX x;  // state
+  MatrixP P;  // covs
 
   bool msckf;
   int N;
@@ -96,17 +127,332 @@ private:
   std::vector<std::string> global_vars;
 
   // process noise
-  MatrixXdr Q;
+  MatrixP Q;
 
-  // rewind stuff
+  // rewind stuff, preallocated rings indexed by sequence number. The state is only
+  // saved every checkpoint_interval observations, a rewind restores the nearest
+  // snapshot and replays the observations after it.
   double max_rewind_age;
-  std::deque<double> rewind_t;
-  std::deque<std::pair<Eigen::VectorXd, MatrixXdr>> rewind_states;
-  std::deque<Observation> rewind_obscache;
+  int checkpoint_interval;
+  std::vector<Observation> rewind_obs;
+  uint64_t rewind_obs_begin;
+  uint64_t rewind_obs_end;
+  std::vector<Snapshot> rewind_snapshots;
+  uint64_t rewind_snapshots_begin;
+  uint64_t rewind_snapshots_end;
+  std::vector<Observation> replay;
+  Observation new_obs;
+  uint64_t rewind_count = 0;
+  uint64_t dropped_count = 0;  // too old to rewind to
 
   Eigen::VectorXd augment_times;
 
   std::vector<int> feature_track_kinds;
 };
 
+typedef ObservationT<Eigen::Dynamic> Observation;
+typedef EstimateT<Eigen::Dynamic, Eigen::Dynamic, Eigen::Dynamic> Estimate;
+typedef EKFSymT<> EKFSym;
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::EKFSymT(std::string name, Eigen::Map<MatrixXdr> Q, Eigen::Map<Eigen::VectorXd> x_initial,
+    Eigen::Map<MatrixXdr> P_initial, int dim_main, int dim_main_err, int N, int dim_augment, int dim_augment_err,
+    std::vector<int> maha_test_kinds, std::vector<int> quaternion_idxs, std::vector<std::string> global_vars,
+    double max_rewind_age, int checkpoint_interval)
+{
+  // TODO: add logger
+
+  this->ekf = ekf_lookup(name);
+  assert(this->ekf);
+
+  this->msckf = N > 0;
+  this->N = N;
+  this->dim_augment = dim_augment;
+  this->dim_augment_err = dim_augment_err;
+  this->dim_main = dim_main;
+  this->dim_main_err = dim_main_err;
+
+  this->dim_x = x_initial.rows();
+  this->dim_err = P_initial.rows();
+
+  assert(dim_main + dim_augment * N == dim_x);
+  assert(dim_main_err + dim_augment_err * N == this->dim_err);
+  assert(Q.rows() == P_initial.rows() && Q.cols() == P_initial.cols());
+  assert(DIM_X == Eigen::Dynamic || DIM_X == this->dim_x);
+  assert(DIM_ERR == Eigen::Dynamic || DIM_ERR == this->dim_err);
+
+  // kinds that should get mahalanobis distance
+  // tested for outlier rejection
+  this->maha_test_kinds = maha_test_kinds;
+
+  // quaternions need normalization
+  this->quaternion_idxs = quaternion_idxs;
+
+  this->global_vars = global_vars;
+
+  // Process noise
+  this->Q = Q;
+
+  this->max_rewind_age = max_rewind_age;
+  assert(checkpoint_interval >= 1);
+  this->checkpoint_interval = checkpoint_interval;
+  this->rewind_obs.resize(REWIND_TO_KEEP);
+  this->rewind_snapshots.resize(REWIND_TO_KEEP / checkpoint_interval + 1);
+  for (Snapshot &snapshot : this->rewind_snapshots) {
+    snapshot.x.resize(this->dim_x);
+    snapshot.P.resize(this->dim_err, this->dim_err);
+  }
+  this->replay.resize(REWIND_TO_KEEP);
+
+  this->init_state(x_initial, P_initial, NAN);
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::init_state(Eigen::Map<Eigen::VectorXd> state, Eigen::Map<MatrixXdr> covs, double filter_time) {
+  this->x = state;
+  this->P = covs;
+  this->filter_time = filter_time;
+  this->augment_times = Eigen::VectorXd::Zero(this->N);
+  this->reset_rewind();
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+typename EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::VectorX EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::state() {
+  return this->x;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+typename EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::MatrixP EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::covs() {
+  return this->P;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::set_filter_time(double t) {
+  this->filter_time = t;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+double EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::get_filter_time() {
+  return this->filter_time;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::normalize_quaternions() {
+  for(std::size_t i = 0; i < this->quaternion_idxs.size(); ++i) {
+    this->normalize_slice(this->quaternion_idxs[i], this->quaternion_idxs[i] + 4);
+  }
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::normalize_slice(int slice_start, int slice_end_ex) {
+  this->x.block(slice_start, 0, slice_end_ex - slice_start, this->x.cols()).normalize();
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+uint64_t EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::get_rewind_count() {
+  return this->rewind_count;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+uint64_t EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::get_dropped_count() {
+  return this->dropped_count;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::set_global(std::string global_var, double val) {
+  this->ekf->sets.at(global_var)(val);
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+std::optional<typename EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::Estimate> EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::predict_and_update_batch(
+    double t, int kind, std::vector<Eigen::Map<Eigen::VectorXd>> z_map, std::vector<Eigen::Map<MatrixXdr>> R_map,
+    std::vector<std::vector<double>> extra_args, bool augment)
+{
+  // TODO handle rewinding at this level
+
+  int rewound = 0;
+  if (!std::isnan(this->filter_time) && t < this->filter_time) {
+    rewound = this->rewind(t);
+    if (rewound < 0) {
+      this->dropped_count++;
+      std::cout << "observation too old at " << t << " with filter at " << this->filter_time << ", ignoring" << std::endl;
+      return std::nullopt;
+    }
+    this->rewind_count++;
+  }
+
+  // reuse the storage of the last observation
+  Observation &obs = this->new_obs;
+  obs.t = t;
+  obs.kind = kind;
+  obs.extra_args = extra_args;
+  obs.z.assign(z_map.begin(), z_map.end());
+  obs.R.assign(R_map.begin(), R_map.end());
+
+  // replay what came after the restored snapshot in time order
+  int i = 0;
+  for (; i < rewound && this->replay[i].t <= t; i++) {
+    this->predict_and_update_batch(this->replay[i], false, nullptr);
+  }
+
+  std::optional<Estimate> res = std::make_optional<Estimate>();
+  this->predict_and_update_batch(obs, augment, &res.value());
+
+  // optional fast forward
+  for (; i < rewound; i++) {
+    this->predict_and_update_batch(this->replay[i], false, nullptr);
+  }
+
+  return res;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::reset_rewind() {
+  this->rewind_obs_begin = this->rewind_obs_end = 0;
+  this->rewind_snapshots_begin = this->rewind_snapshots_end = 0;
+}
+
+// Restores the newest snapshot at or before t. Returns the number of observations after
+// it, copied to replay in order, or -1 if t is too far back.
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+int EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::rewind(double t) {
+  if (this->rewind_obs_begin == this->rewind_obs_end) {
+    return -1;
+  }
+  const Observation &last = this->rewind_obs[(this->rewind_obs_end - 1) % this->rewind_obs.size()];
+  if (t < last.t - this->max_rewind_age) {
+    return -1;
+  }
+
+  // newest snapshot at or before t, it also needs all observations after it
+  uint64_t snapshot_idx = this->rewind_snapshots_end;
+  while (snapshot_idx > this->rewind_snapshots_begin &&
+         this->rewind_snapshots[(snapshot_idx - 1) % this->rewind_snapshots.size()].t > t) {
+    snapshot_idx--;
+  }
+  if (snapshot_idx == this->rewind_snapshots_begin) {
+    return -1;
+  }
+  const Snapshot &snapshot = this->rewind_snapshots[(snapshot_idx - 1) % this->rewind_snapshots.size()];
+  if (snapshot.seq + 1 < this->rewind_obs_begin) {
+    return -1;
+  }
+
+  // set the state to the time of the snapshot
+  this->filter_time = snapshot.t;
+  this->x = snapshot.x;
+  this->P = snapshot.P;
+
+  // everything after it is applied again
+  int rewound = 0;
+  for (uint64_t seq = snapshot.seq + 1; seq < this->rewind_obs_end; seq++) {
+    this->replay[rewound++] = this->rewind_obs[seq % this->rewind_obs.size()];
+  }
+  this->rewind_obs_end = snapshot.seq + 1;
+  this->rewind_snapshots_end = snapshot_idx;
+
+  return rewound;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::checkpoint(Observation& obs) {
+  // push to rewinder, overwriting the oldest entries in place
+  const uint64_t seq = this->rewind_obs_end++;
+  this->rewind_obs[seq % this->rewind_obs.size()] = obs;
+  if (this->rewind_obs_end - this->rewind_obs_begin > this->rewind_obs.size()) {
+    this->rewind_obs_begin++;
+  }
+
+  if ((seq + 1) % this->checkpoint_interval == 0) {
+    Snapshot &snapshot = this->rewind_snapshots[this->rewind_snapshots_end++ % this->rewind_snapshots.size()];
+    snapshot.seq = seq;
+    snapshot.t = this->filter_time;
+    snapshot.x = this->x;
+    snapshot.P = this->P;
+    if (this->rewind_snapshots_end - this->rewind_snapshots_begin > this->rewind_snapshots.size()) {
+      this->rewind_snapshots_begin++;
+    }
+  }
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::predict_and_update_batch(Observation& obs, bool augment, Estimate *res) {
+  assert(obs.z.size() == obs.R.size());
+  assert(obs.z.size() == obs.extra_args.size());
+
+  this->predict(obs.t);
+
+  if (res != nullptr) {
+    res->t = obs.t;
+    res->kind = obs.kind;
+    res->z = obs.z;
+    res->extra_args = obs.extra_args;
+    res->xk1 = this->x;
+    res->Pk1 = this->P;
+    res->y.reserve(obs.z.size());
+  }
+
+  // update batch
+  for (int i = 0; i < obs.z.size(); i++) {
+    assert(obs.z[i].rows() == obs.R[i].rows());
+    assert(obs.z[i].rows() == obs.R[i].cols());
+
+    // update state
+    VectorZ y = this->update(obs.kind, obs.z[i], obs.R[i], obs.extra_args[i]);
+    if (res != nullptr) {
+      res->y.push_back(y);
+    }
+  }
+
+  if (res != nullptr) {
+    res->xk = this->x;
+    res->Pk = this->P;
+  }
+
+  assert(!augment); // TODO
+  // if (augment) {
+  //   this->augment();
+  // }
+
+  this->checkpoint(obs);
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+void EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::predict(double t) {
+  // initialize time
+  if (std::isnan(this->filter_time)) {
+    this->filter_time = t;
+  }
+
+  // predict
+  double dt = t - this->filter_time;
+  assert(dt >= 0.0);
+
+  this->ekf->predict(this->x.data(), this->P.data(), this->Q.data(), dt);
+  this->normalize_quaternions();
+  this->filter_time = t;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+typename EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::VectorZ EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::update(int kind, const VectorZ &z,
+    MatrixR &R, std::vector<double> &extra_args)
+{
+  // the generated update writes the innovation back into z
+  VectorZ y = z;
+  this->ekf->updates.at(kind)(this->x.data(), this->P.data(), y.data(), R.data(), extra_args.data());
+  this->normalize_quaternions();
+
+  if (this->msckf && std::find(this->feature_track_kinds.begin(), this->feature_track_kinds.end(), kind) != this->feature_track_kinds.end()) {
+    return y.head(y.rows() - extra_args.size());
+  }
+  return y;
+}
+
+template <int DIM_X, int DIM_ERR, int MAX_DIM_Z>
+extra_routine_t EKFSymT<DIM_X, DIM_ERR, MAX_DIM_Z>::get_extra_routine(const std::string& routine) {
+  return this->ekf->extra_routines.at(routine);
+}
+
+extern template class EKFSymT<>;
+
 }
@@ -20,6 +20,7 @@
 #include "cereal/gen/cpp/car.capnp.h"
 #include "cereal/messaging/messaging.h"
 #include "selfdrive/common/params.h"
+#include "selfdrive/common/ratekeeper.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
@@ -226,27 +227,23 @@ void can_recv_thread(Panda *panda) {
   LOGD("start recv thread");
 
   // can = 8006
-  PubMaster pm({"can"});
+  PubMaster pm({"can", "boarddLoopStats"});
 
   // run at 100hz
-  const uint64_t dt = 10000000ULL;
-  uint64_t next_frame_time = nanos_since_boot() + dt;
+  RateKeeper rk("boardd can recv", 100);
 
   while (!do_exit && panda->connected) {
     can_recv(panda, pm);
 
-    uint64_t cur_time = nanos_since_boot();
-    int64_t remaining = next_frame_time - cur_time;
-    if (remaining > 0) {
-      std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
-    } else {
-      if (ignition) {
-        LOGW("missed cycles (%d) %lld", (int)-1*remaining/dt, remaining);
-      }
-      next_frame_time = cur_time;
+    if (rk.statsReady()) {
+      MessageBuilder msg;
+      rk.fillStats(msg.initEvent().initBoarddLoopStats());
+      pm.send("boarddLoopStats", msg);
     }
 
-    next_frame_time += dt;
+    if (rk.keepTime() && ignition) {
+      LOGW("missed cycles %.2f ms", -rk.remaining() * 1000);
+    }
   }
 }
 
@@ -7,14 +7,14 @@
 #include <chrono>
 #include <thread>
 
-#include "libyuv.h"
-#include <jpeglib.h>
-
+#include "selfdrive/camerad/cameras/thumbnail_pool.h"
+#include "selfdrive/camerad/imgproc/stats.h"
 #include "selfdrive/camerad/imgproc/utils.h"
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/modeldata.h"
 #include "selfdrive/common/params.h"
 #include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/hardware/hw.h"
 
@@ -30,20 +30,28 @@
 
 const int YUV_COUNT = 100;
 
-static cl_program build_debayer_program(cl_device_id device_id, cl_context context, const CameraInfo *ci, const CameraBuf *b, const CameraState *s) {
+static cl_program build_debayer_program(cl_device_id device_id, cl_context context, const CameraInfo *ci, const CameraBuf *b, const CameraState *s, bool fused_yuv) {
   char args[4096];
   snprintf(args, sizeof(args),
            "-cl-fast-relaxed-math -cl-denorms-are-zero "
            "-DFRAME_WIDTH=%d -DFRAME_HEIGHT=%d -DFRAME_STRIDE=%d "
            "-DRGB_WIDTH=%d -DRGB_HEIGHT=%d -DRGB_STRIDE=%d "
-           "-DBAYER_FLIP=%d -DHDR=%d -DCAM_NUM=%d",
+           "-DBAYER_FLIP=%d -DHDR=%d -DCAM_NUM=%d -DFUSED_YUV=%d -DRGB_SIZE=%d",
            ci->frame_width, ci->frame_height, ci->frame_stride,
            b->rgb_width, b->rgb_height, b->rgb_stride,
-           ci->bayer_flip, ci->hdr, s->camera_num);
+           ci->bayer_flip, ci->hdr, s->camera_num, fused_yuv, b->rgb_width * b->rgb_height);
   const char *cl_file = Hardware::TICI() ? "cameras/real_debayer.cl" : "cameras/debayer.cl";
   return cl_program_from_file(context, device_id, cl_file, args);
 }
 
+// time between starting and finishing a command, the queue has profiling enabled
+static float event_time(cl_event event) {
+  cl_ulong start = 0, end = 0;
+  CL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL));
+  CL_CHECK(clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL));
+  return (end - start) * 1e-9;
+}
+
 void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s, VisionIpcServer * v, int frame_cnt, VisionStreamType rgb_type, VisionStreamType yuv_type, release_cb release_callback) {
   vipc_server = v;
   this->rgb_type = rgb_type;
@@ -80,18 +88,22 @@ void CameraBuf::init(cl_device_id device_id, cl_context context, CameraState *s,
 
   vipc_server->create_buffers(yuv_type, YUV_COUNT, false, rgb_width, rgb_height);
 
+  // only the full resolution debayer on tici can write yuv, it has the whole 2x2 block in a work group
+  fused_yuv = Hardware::TICI() && ci->bayer;
   if (ci->bayer) {
-    cl_program prg_debayer = build_debayer_program(device_id, context, ci, this, s);
+    cl_program prg_debayer = build_debayer_program(device_id, context, ci, this, s, fused_yuv);
     krnl_debayer = CL_CHECK_ERR(clCreateKernel(prg_debayer, "debayer10", &err));
     CL_CHECK(clReleaseProgram(prg_debayer));
   }
 
-  rgb2yuv = std::make_unique<Rgb2Yuv>(context, device_id, rgb_width, rgb_height, rgb_stride);
+  if (!fused_yuv) {
+    rgb2yuv = std::make_unique<Rgb2Yuv>(context, device_id, rgb_width, rgb_height, rgb_stride);
+  }
 
 #ifdef __APPLE__
-  q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+  q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &err));
 #else
-  const cl_queue_properties props[] = {0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
+  const cl_queue_properties props[] = {CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0};  //CL_QUEUE_PRIORITY_KHR, CL_QUEUE_PRIORITY_HIGH_KHR, 0};
   q = CL_CHECK_ERR(clCreateCommandQueueWithProperties(context, device_id, props, &err));
 #endif
 }
@@ -107,6 +119,7 @@ CameraBuf::~CameraBuf() {
 
 bool CameraBuf::acquire() {
   if (!safe_queue.try_pop(cur_buf_idx, 1)) return false;
+  const double start_time = seconds_since_boot();
 
   if (camera_bufs_metadata[cur_buf_idx].frame_id == -1) {
     LOGE("no frame data? wtf");
@@ -116,8 +129,10 @@ bool CameraBuf::acquire() {
 
   cur_frame_data = camera_bufs_metadata[cur_buf_idx];
   cur_rgb_buf = vipc_server->get_buffer(rgb_type);
+  cur_yuv_buf = vipc_server->get_buffer(yuv_type);
 
-  cl_event debayer_event;
+  // the stages are chained on the gpu, the host only waits to send each buffer
+  cl_event debayer_event, yuv_event;
   cl_mem camrabuf_cl = camera_bufs[cur_buf_idx].buf_cl;
   if (camera_state->ci.bayer) {
     CL_CHECK(clSetKernelArg(krnl_debayer, 0, sizeof(cl_mem), &camrabuf_cl));
@@ -127,6 +142,10 @@ bool CameraBuf::acquire() {
     const size_t globalWorkSize[] = {size_t(camera_state->ci.frame_width), size_t(camera_state->ci.frame_height)};
     const size_t localWorkSize[] = {DEBAYER_LOCAL_WORKSIZE, DEBAYER_LOCAL_WORKSIZE};
     CL_CHECK(clSetKernelArg(krnl_debayer, 2, localMemSize, 0));
+    if (fused_yuv) {
+      CL_CHECK(clSetKernelArg(krnl_debayer, 3, sizeof(cl_mem), &cur_yuv_buf->buf_cl));
+      CL_CHECK(clSetKernelArg(krnl_debayer, 4, DEBAYER_LOCAL_WORKSIZE * DEBAYER_LOCAL_WORKSIZE * sizeof(cl_uchar4), 0));
+    }
     CL_CHECK(clEnqueueNDRangeKernel(q, krnl_debayer, 2, NULL, globalWorkSize, localWorkSize,
                                     0, 0, &debayer_event));
 #else
@@ -145,20 +164,31 @@ bool CameraBuf::acquire() {
                                cur_rgb_buf->len, 0, 0, &debayer_event));
   }
 
-  clWaitForEvents(1, &debayer_event);
-  CL_CHECK(clReleaseEvent(debayer_event));
-
-  cur_yuv_buf = vipc_server->get_buffer(yuv_type);
-  rgb2yuv->queue(q, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl);
+  if (fused_yuv) {
+    yuv_event = debayer_event;
+    CL_CHECK(clRetainEvent(yuv_event));
+  } else {
+    rgb2yuv->queue(q, cur_rgb_buf->buf_cl, cur_yuv_buf->buf_cl, debayer_event, &yuv_event);
+  }
 
   VisionIpcBufExtra extra = {
                         cur_frame_data.frame_id,
                         cur_frame_data.timestamp_sof,
                         cur_frame_data.timestamp_eof,
   };
+
+  // the rgb buffer goes out while the yuv conversion is still running
+  CL_CHECK(clWaitForEvents(1, &debayer_event));
   vipc_server->send(cur_rgb_buf, &extra);
+  CL_CHECK(clWaitForEvents(1, &yuv_event));
   vipc_server->send(cur_yuv_buf, &extra);
 
+  cur_frame_data.debayer_time = event_time(debayer_event);
+  cur_frame_data.yuv_time = fused_yuv ? 0 : event_time(yuv_event);
+  cur_frame_data.processing_time = seconds_since_boot() - start_time;
+  CL_CHECK(clReleaseEvent(debayer_event));
+  CL_CHECK(clReleaseEvent(yuv_event));
+
   return true;
 }
 
@@ -188,6 +218,9 @@ void fill_frame_data(cereal::FrameData::Builder &framed, const FrameMetadata &fr
   framed.setLensSag(frame_data.lens_sag);
   framed.setLensErr(frame_data.lens_err);
   framed.setLensTruePos(frame_data.lens_true_pos);
+  framed.setProcessingTime(frame_data.processing_time);
+  framed.setDebayerTime(frame_data.debayer_time);
+  framed.setYuvTime(frame_data.yuv_time);
 }
 
 kj::Array<uint8_t> get_frame_image(const CameraBuf *b) {
@@ -209,120 +242,24 @@ kj::Array<uint8_t> get_frame_image(const CameraBuf *b) {
   uint8_t *resized_dat = frame_image.begin();
   int goff = x_min*3 + y_min*b->rgb_stride;
   for (int r=0;r<new_height;r++) {
+    const uint8_t *src = &dat[goff+r*b->rgb_stride*scale];
+    uint8_t *dst = &resized_dat[r*new_width*3];
+    if (scale == 1) {
+      memcpy(dst, src, new_width*3);
+      continue;
+    }
     for (int c=0;c<new_width;c++) {
-      memcpy(&resized_dat[(r*new_width+c)*3], &dat[goff+r*b->rgb_stride*scale+c*3*scale], 3*sizeof(uint8_t));
+      dst[c*3+0] = src[c*3*scale+0];
+      dst[c*3+1] = src[c*3*scale+1];
+      dst[c*3+2] = src[c*3*scale+2];
     }
   }
   return kj::mv(frame_image);
 }
 
-static kj::Array<capnp::byte> yuv420_to_jpeg(const CameraBuf *b, int thumbnail_width, int thumbnail_height) {
-  // make the buffer big enough. jpeg_write_raw_data requires 16-pixels aligned height to be used.
-  std::unique_ptr<uint8[]> buf(new uint8_t[(thumbnail_width * ((thumbnail_height + 15) & ~15) * 3) / 2]);
-  uint8_t *y_plane = buf.get();
-  uint8_t *u_plane = y_plane + thumbnail_width * thumbnail_height;
-  uint8_t *v_plane = u_plane + (thumbnail_width * thumbnail_height) / 4;
-  {
-    int result = libyuv::I420Scale(
-        b->cur_yuv_buf->y, b->rgb_width, b->cur_yuv_buf->u, b->rgb_width / 2, b->cur_yuv_buf->v, b->rgb_width / 2,
-        b->rgb_width, b->rgb_height,
-        y_plane, thumbnail_width, u_plane, thumbnail_width / 2, v_plane, thumbnail_width / 2,
-        thumbnail_width, thumbnail_height, libyuv::kFilterNone);
-    if (result != 0) {
-      LOGE("Generate YUV thumbnail failed.");
-      return {};
-    }
-  }
-
-  struct jpeg_compress_struct cinfo;
-  struct jpeg_error_mgr jerr;
-  cinfo.err = jpeg_std_error(&jerr);
-  jpeg_create_compress(&cinfo);
-
-  uint8_t *thumbnail_buffer = nullptr;
-  size_t thumbnail_len = 0;
-  jpeg_mem_dest(&cinfo, &thumbnail_buffer, &thumbnail_len);
-
-  cinfo.image_width = thumbnail_width;
-  cinfo.image_height = thumbnail_height;
-  cinfo.input_components = 3;
-
-  jpeg_set_defaults(&cinfo);
-  jpeg_set_colorspace(&cinfo, JCS_YCbCr);
-  // configure sampling factors for yuv420.
-  cinfo.comp_info[0].h_samp_factor = 2;  // Y
-  cinfo.comp_info[0].v_samp_factor = 2;
-  cinfo.comp_info[1].h_samp_factor = 1;  // U
-  cinfo.comp_info[1].v_samp_factor = 1;
-  cinfo.comp_info[2].h_samp_factor = 1;  // V
-  cinfo.comp_info[2].v_samp_factor = 1;
-  cinfo.raw_data_in = TRUE;
-
-  jpeg_set_quality(&cinfo, 50, TRUE);
-  jpeg_start_compress(&cinfo, TRUE);
-
-  JSAMPROW y[16], u[8], v[8];
-  JSAMPARRAY planes[3]{y, u, v};
-
-  for (int line = 0; line < cinfo.image_height; line += 16) {
-    for (int i = 0; i < 16; ++i) {
-      y[i] = y_plane + (line + i) * cinfo.image_width;
-      if (i % 2 == 0) {
-        int offset = (cinfo.image_width / 2) * ((i + line) / 2);
-        u[i / 2] = u_plane + offset;
-        v[i / 2] = v_plane + offset;
-      }
-    }
-    jpeg_write_raw_data(&cinfo, planes, 16);
-  }
-
-  jpeg_finish_compress(&cinfo);
-  jpeg_destroy_compress(&cinfo);
-
-  kj::Array<capnp::byte> dat = kj::heapArray<capnp::byte>(thumbnail_buffer, thumbnail_len);
-  free(thumbnail_buffer);
-  return dat;
-}
-
-static void publish_thumbnail(PubMaster *pm, const CameraBuf *b) {
-  auto thumbnail = yuv420_to_jpeg(b, b->rgb_width / 4, b->rgb_height / 4);
-  if (thumbnail.size() == 0) return;
-
-  MessageBuilder msg;
-  auto thumbnaild = msg.initEvent().initThumbnail();
-  thumbnaild.setFrameId(b->cur_frame_data.frame_id);
-  thumbnaild.setTimestampEof(b->cur_frame_data.timestamp_eof);
-  thumbnaild.setThumbnail(thumbnail);
-
-  pm->send("thumbnail", msg);
-}
-
 float set_exposure_target(const CameraBuf *b, int x_start, int x_end, int x_skip, int y_start, int y_end, int y_skip) {
-  int lum_med;
-  uint32_t lum_binning[256] = {0};
-  const uint8_t *pix_ptr = b->cur_yuv_buf->y;
-
-  unsigned int lum_total = 0;
-  for (int y = y_start; y < y_end; y += y_skip) {
-    for (int x = x_start; x < x_end; x += x_skip) {
-      uint8_t lum = pix_ptr[(y * b->rgb_width) + x];
-      lum_binning[lum]++;
-      lum_total += 1;
-    }
-  }
-
-
-  // Find mean lumimance value
-  unsigned int lum_cur = 0;
-  for (lum_med = 255; lum_med >= 0; lum_med--) {
-    lum_cur += lum_binning[lum_med];
-
-    if (lum_cur >= lum_total / 2) {
-      break;
-    }
-  }
-
-  return lum_med / 256.0;
+  const LumaHistogram hist = luma_histogram(b->cur_yuv_buf->y, b->rgb_width, x_start, x_end, x_skip, y_start, y_end, y_skip);
+  return hist.percentile(0.5) / 256.0;
 }
 
 extern ExitHandler do_exit;
@@ -338,15 +275,19 @@ void *processing_thread(MultiCameraState *cameras, CameraState *cs, process_thre
   }
   set_thread_name(thread_name);
 
+  std::unique_ptr<ThumbnailPool> thumbnails;
+  if (cs == &(cameras->road_cam) && cameras->pm) {
+    thumbnails = std::make_unique<ThumbnailPool>(cameras->pm);
+  }
+
   uint32_t cnt = 0;
   while (!do_exit) {
     if (!cs->buf.acquire()) continue;
 
     callback(cameras, cs, cnt);
 
-    if (cs == &(cameras->road_cam) && cameras->pm && cnt % 100 == 3) {
-      // this takes 10ms???
-      publish_thumbnail(cameras->pm, &(cs->buf));
+    if (thumbnails && cnt % 100 == 3) {
+      thumbnails->push(&(cs->buf));
     }
     cs->buf.release();
     ++cnt;
@@ -84,6 +84,11 @@ typedef struct FrameMetadata {
   float lens_sag;
   float lens_err;
   float lens_true_pos;
+
+  // Processing, in seconds
+  float processing_time;  // from dequeuing the raw frame to sending the yuv buffer
+  float debayer_time;     // gpu time of the debayer, includes rgb to yuv when fused
+  float yuv_time;         // gpu time of rgb to yuv, 0 when fused
 } FrameMetadata;
 
 typedef struct CameraExpInfo {
@@ -100,6 +105,8 @@ private:
   CameraState *camera_state;
   cl_kernel krnl_debayer;
 
+  // the debayer kernel writes the yuv buffer too, rgb2yuv is only used without it
+  bool fused_yuv;
   std::unique_ptr<Rgb2Yuv> rgb2yuv;
 
   VisionStreamType rgb_type, yuv_type;
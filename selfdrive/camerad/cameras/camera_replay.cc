@@ -1,9 +1,15 @@
 #include "selfdrive/camerad/cameras/camera_replay.h"
 
 #include <cassert>
+#include <optional>
 #include <thread>
 
-#include "selfdrive/common/clutil.h"
+#include "libyuv.h"
+
+#include "selfdrive/common/modeldata.h"
+#include "selfdrive/common/ratekeeper.h"
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 
 extern ExitHandler do_exit;
@@ -14,6 +20,16 @@ namespace {
 
 const char *BASE_URL = "https://commadataci.blob.core.windows.net/openpilotci/";
 
+// same as the yuv buffers of the real cameras, modeld and the encoders may hold on to a few
+const int YUV_BUF_COUNT = 100;
+
+// REPLAY_RATE scales the camera fps, 0 sends as fast as the frames decode.
+// REPLAY_LOCKSTEP waits for modelV2 of every frame before sending the next one.
+// REPLAY_SKIP_RGB only sends yuv, for consumers that don't need the rgb stream
+const float replay_rate = util::getenv("REPLAY_RATE", 1.0f);
+const bool replay_lockstep = getenv("REPLAY_LOCKSTEP") != NULL;
+const bool replay_skip_rgb = getenv("REPLAY_SKIP_RGB") != NULL;
+
 const std::string road_camera_route = "0c94aa1e1296d7c6|2021-05-05--19-48-37";
 // const std::string driver_camera_route = "534ccd8a0950a00c|2021-06-08--12-15-37";
 
@@ -38,54 +54,111 @@ void camera_init(VisionIpcServer *v, CameraState *s, int camera_id, unsigned int
   s->ci = ci;
   s->camera_num = camera_id;
   s->fps = fps;
-  s->buf.init(device_id, ctx, s, v, FRAME_BUF_COUNT, rgb_type, yuv_type);
+  s->vipc_server = v;
+  s->rgb_type = rgb_type;
+  s->yuv_type = yuv_type;
+
+  if (!replay_skip_rgb) {
+    v->create_buffers(rgb_type, UI_BUF_COUNT, true, ci.frame_width, ci.frame_height);
+  }
+  v->create_buffers(yuv_type, YUV_BUF_COUNT, false, ci.frame_width, ci.frame_height);
 }
 
 void camera_close(CameraState *s) {
   delete s->frame;
 }
 
-void run_camera(CameraState *s) {
+void wait_for_model(SubMaster &sm, uint32_t frame_id) {
+  // modeld may not be up yet, don't hold the stream for it
+  const double timeout = sm.rcv_frame("modelV2") > 0 ? 10. : 1.;
+  const double start = seconds_since_boot();
+  while (!do_exit && (sm.rcv_frame("modelV2") == 0 || sm["modelV2"].getModelV2().getFrameId() < frame_id)) {
+    if (seconds_since_boot() - start > timeout) {
+      LOGW("no modelV2 for frame %u after %.1f s, sending the next frame", frame_id, timeout);
+      return;
+    }
+    sm.update(100);
+  }
+}
+
+void publish_frame(MultiCameraState *s, const FrameMetadata &frame_data, const VisionBuf *yuv_buf) {
+  static const mat3 yuv_transform = get_model_yuv_transform(false);
+
+  MessageBuilder msg;
+  auto framed = msg.initEvent().initRoadCameraState();
+  fill_frame_data(framed, frame_data);
+  framed.setImage(kj::arrayPtr((const uint8_t *)yuv_buf->addr, yuv_buf->len));
+  framed.setTransform(yuv_transform.v);
+  s->pm->send("roadCameraState", msg);
+}
+
+void run_camera(MultiCameraState *m, CameraState *s) {
+  std::optional<RateKeeper> rk;
+  if (replay_rate > 0) {
+    rk.emplace("replay_road_camera", s->fps * replay_rate);
+  }
+  std::unique_ptr<SubMaster> sm;
+  if (replay_lockstep) {
+    sm = std::make_unique<SubMaster>(std::vector<const char *>{"modelV2"});
+  }
+
+  const int w = s->ci.frame_width, h = s->ci.frame_height;
   uint32_t stream_frame_id = 0, frame_id = 0;
-  size_t buf_idx = 0;
   while (!do_exit) {
     if (stream_frame_id == s->frame->getFrameCount()) {
       // loop stream
       stream_frame_id = 0;
     }
-    uint8_t *dat = s->frame->get(stream_frame_id++);
-    if (dat) {
-      s->buf.camera_bufs_metadata[buf_idx] = {.frame_id = frame_id};
-      auto &buf = s->buf.camera_bufs[buf_idx];
-      CL_CHECK(clEnqueueWriteBuffer(buf.copy_q, buf.buf_cl, CL_TRUE, 0, s->frame->getRGBSize(), dat, 0, NULL, NULL));
-      s->buf.queue(buf_idx);
+
+    const double start_time = seconds_since_boot();
+    VisionBuf *yuv_buf = s->vipc_server->get_buffer(s->yuv_type);
+    if (s->frame->get(stream_frame_id++, nullptr, (uint8_t *)yuv_buf->addr)) {
+      const uint64_t timestamp = nanos_since_boot();
+      VisionIpcBufExtra extra = {
+          .frame_id = frame_id,
+          .timestamp_sof = timestamp,
+          .timestamp_eof = timestamp,
+      };
+      FrameMetadata frame_data = {
+          .frame_id = frame_id,
+          .timestamp_sof = extra.timestamp_sof,
+          .timestamp_eof = extra.timestamp_eof,
+      };
+
+      if (!replay_skip_rgb) {
+        // the rgb buffer's stride can be wider than w * 3, so the reader can't write it
+        VisionBuf *rgb_buf = s->vipc_server->get_buffer(s->rgb_type);
+        libyuv::I420ToRGB24(yuv_buf->y, w, yuv_buf->u, w / 2, yuv_buf->v, w / 2,
+                            (uint8_t *)rgb_buf->addr, rgb_buf->stride, w, h);
+        s->vipc_server->send(rgb_buf, &extra, false);
+      }
+      // written by the cpu, nothing to sync from the device
+      s->vipc_server->send(yuv_buf, &extra, false);
+      frame_data.processing_time = seconds_since_boot() - start_time;
+      publish_frame(m, frame_data, yuv_buf);
+
+      if (sm) {
+        wait_for_model(*sm, frame_id);
+      }
       ++frame_id;
-      buf_idx = (buf_idx + 1) % FRAME_BUF_COUNT;
     }
-    util::sleep_for(1000 / s->fps);
+
+    if (rk) {
+      rk->keepTime();
+    }
   }
 }
 
-void road_camera_thread(CameraState *s) {
+void road_camera_thread(MultiCameraState *m, CameraState *s) {
   set_thread_name("replay_road_camera_thread");
-  run_camera(s);
+  run_camera(m, s);
 }
 
-// void driver_camera_thread(CameraState *s) {
+// void driver_camera_thread(MultiCameraState *m, CameraState *s) {
 //   set_thread_name("replay_driver_camera_thread");
-//   run_camera(s);
+//   run_camera(m, s);
 // }
 
-void process_road_camera(MultiCameraState *s, CameraState *c, int cnt) {
-  const CameraBuf *b = &c->buf;
-  MessageBuilder msg;
-  auto framed = msg.initEvent().initRoadCameraState();
-  fill_frame_data(framed, b->cur_frame_data);
-  framed.setImage(kj::arrayPtr((const uint8_t *)b->cur_yuv_buf->addr, b->cur_yuv_buf->len));
-  framed.setTransform(b->yuv_transform.v);
-  s->pm->send("roadCameraState", msg);
-}
-
 // void process_driver_camera(MultiCameraState *s, CameraState *c, int cnt) {
 //   MessageBuilder msg;
 //   auto framed = msg.initEvent().initDriverCameraState();
@@ -101,7 +174,7 @@ void cameras_init(VisionIpcServer *v, MultiCameraState *s, cl_device_id device_i
               VISION_STREAM_RGB_BACK, VISION_STREAM_YUV_BACK, get_url(road_camera_route, "fcamera", 0));
   // camera_init(v, &s->driver_cam, CAMERA_ID_LGC615, 10, device_id, ctx,
   //             VISION_STREAM_RGB_FRONT, VISION_STREAM_YUV_FRONT, get_url(driver_camera_route, "dcamera", 0));
-  s->pm = new PubMaster({"roadCameraState", "driverCameraState", "thumbnail"});
+  s->pm = new PubMaster({"roadCameraState", "driverCameraState"});
 }
 
 void cameras_open(MultiCameraState *s) {}
@@ -114,10 +187,8 @@ void cameras_close(MultiCameraState *s) {
 
 void cameras_run(MultiCameraState *s) {
   std::vector<std::thread> threads;
-  threads.push_back(start_process_thread(s, &s->road_cam, process_road_camera));
-  // threads.push_back(start_process_thread(s, &s->driver_cam, process_driver_camera));
-  // threads.push_back(std::thread(driver_camera_thread, &s->driver_cam));
-  road_camera_thread(&s->road_cam);
+  // threads.push_back(std::thread(driver_camera_thread, s, &s->driver_cam));
+  road_camera_thread(s, &s->road_cam);
 
   for (auto &t : threads) t.join();
 
@@ -3,8 +3,6 @@
 #include "selfdrive/camerad/cameras/camera_common.h"
 #include "selfdrive/ui/replay/framereader.h"
 
-#define FRAME_BUF_COUNT 16
-
 typedef struct CameraState {
   int camera_num;
   CameraInfo ci;
@@ -12,8 +10,11 @@ typedef struct CameraState {
   int fps;
   float digital_gain = 0;
 
+  // frames are decoded straight into the VisionIpc buffers, buf is unused
   CameraBuf buf;
   FrameReader *frame = nullptr;
+  VisionIpcServer *vipc_server = nullptr;
+  VisionStreamType rgb_type, yuv_type;
 } CameraState;
 
 typedef struct MultiCameraState {
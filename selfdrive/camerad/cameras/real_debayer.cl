@@ -2,6 +2,14 @@
 
 const half black_level = 42.0;
 
+#if FUSED_YUV
+// same conversion as transforms/rgb_to_yuv.cl, U and V take the sum of two pixels
+#define RGB_TO_Y(r, g, b) ((((mul24(b, 13) + mul24(g, 65) + mul24(r, 33)) + 64) >> 7) + 16)
+#define RGB_TO_U(r, g, b) ((mul24(b, 56) - mul24(g, 37) - mul24(r, 19) + 0x8080) >> 8)
+#define RGB_TO_V(r, g, b) ((mul24(r, 56) - mul24(g, 47) - mul24(b, 9) + 0x8080) >> 8)
+#define AVERAGE(x, y, z, w) ((convert_ushort(x) + convert_ushort(y) + convert_ushort(z) + convert_ushort(w) + 1) >> 1)
+#endif
+
 const __constant half3 color_correction[3] = {
   // post wb CCM
   (half3)(1.82717181, -0.31231438, 0.07307673),
@@ -90,6 +98,10 @@ half phi(half x) {
 __kernel void debayer10(const __global uchar * in,
                         __global uchar * out,
                         __local half * cached
+#if FUSED_YUV
+                        , __global uchar * out_yuv,
+                        __local uchar4 * rgb_cached
+#endif
                        )
 {
   const int x_global = get_global_id(0);
@@ -105,96 +117,98 @@ __kernel void debayer10(const __global uchar * in,
   half pv = val_from_10(in, x_global, y_global);
   cached[localOffset] = pv;
 
-  // don't care
-  if (x_global < 1 || x_global >= RGB_WIDTH - 1 || y_global < 1 || y_global >= RGB_HEIGHT - 1) {
-    return;
-  }
-
-  // cache padding
-  int localColOffset = -1;
-  int globalColOffset = -1;
-
-  // cache padding
-  if (x_local < 1) {
-    localColOffset = x_local;
-    globalColOffset = -1;
-    cached[(y_local + 1) * localRowLen + x_local] = val_from_10(in, x_global-1, y_global);
-  } else if (x_local >= get_local_size(0) - 1) {
-    localColOffset = x_local + 2;
-    globalColOffset = 1;
-    cached[localOffset + 1] = val_from_10(in, x_global+1, y_global);
-  }
-
-  if (y_local < 1) {
-    cached[y_local * localRowLen + x_local + 1] = val_from_10(in, x_global, y_global-1);
-    if (localColOffset != -1) {
-      cached[y_local * localRowLen + localColOffset] = val_from_10(in, x_global+globalColOffset, y_global-1);
+  // the outermost pixels have no neighbours to interpolate from, they are left grey.
+  // they still take part in the barriers below
+  const bool border = x_global < 1 || x_global >= RGB_WIDTH - 1 || y_global < 1 || y_global >= RGB_HEIGHT - 1;
+
+  if (!border) {
+    // cache padding
+    int localColOffset = -1;
+    int globalColOffset = -1;
+
+    // cache padding
+    if (x_local < 1) {
+      localColOffset = x_local;
+      globalColOffset = -1;
+      cached[(y_local + 1) * localRowLen + x_local] = val_from_10(in, x_global-1, y_global);
+    } else if (x_local >= get_local_size(0) - 1) {
+      localColOffset = x_local + 2;
+      globalColOffset = 1;
+      cached[localOffset + 1] = val_from_10(in, x_global+1, y_global);
     }
-  } else if (y_local >= get_local_size(1) - 1) {
-    cached[(y_local + 2) * localRowLen + x_local + 1] = val_from_10(in, x_global, y_global+1);
-    if (localColOffset != -1) {
-      cached[(y_local + 2) * localRowLen + localColOffset] = val_from_10(in, x_global+globalColOffset, y_global+1);
+
+    if (y_local < 1) {
+      cached[y_local * localRowLen + x_local + 1] = val_from_10(in, x_global, y_global-1);
+      if (localColOffset != -1) {
+        cached[y_local * localRowLen + localColOffset] = val_from_10(in, x_global+globalColOffset, y_global-1);
+      }
+    } else if (y_local >= get_local_size(1) - 1) {
+      cached[(y_local + 2) * localRowLen + x_local + 1] = val_from_10(in, x_global, y_global+1);
+      if (localColOffset != -1) {
+        cached[(y_local + 2) * localRowLen + localColOffset] = val_from_10(in, x_global+globalColOffset, y_global+1);
+      }
     }
   }
 
   // sync
   barrier(CLK_LOCAL_MEM_FENCE);
 
-  half d1 = cached[localOffset - localRowLen - 1];
-  half d2 = cached[localOffset - localRowLen + 1];
-  half d3 = cached[localOffset + localRowLen - 1];
-  half d4 = cached[localOffset + localRowLen + 1];
-  half n1 = cached[localOffset - localRowLen];
-  half n2 = cached[localOffset + 1];
-  half n3 = cached[localOffset + localRowLen];
-  half n4 = cached[localOffset - 1];
-
-  half3 rgb;
-
-  // a simplified version of https://opensignalprocessingjournal.com/contents/volumes/V6/TOSIGPJ-6-1/TOSIGPJ-6-1.pdf
-  if (x_global % 2 == 0) {
-    if (y_global % 2 == 0) {
-      rgb.y = pv; // G1(R)
-      half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
-      half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
-      half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
-      half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
-      // R_G1
-      rgb.x = (k2*n2+k4*n4)/(k2+k4);
-      // B_G1
-      rgb.z = (k1*n1+k3*n3)/(k1+k3);
-    } else {
-      rgb.z = pv; // B
-      half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
-      half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
-      half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
-      half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
-      // G_B
-      rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
-      // R_B
-      rgb.x = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
-    }
-  } else {
-    if (y_global % 2 == 0) {
-      rgb.x = pv; // R
-      half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
-      half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
-      half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
-      half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
-      // G_R
-      rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
-      // B_R
-      rgb.z = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
+  half3 rgb = (half3)(pv);
+  if (!border) {
+    half d1 = cached[localOffset - localRowLen - 1];
+    half d2 = cached[localOffset - localRowLen + 1];
+    half d3 = cached[localOffset + localRowLen - 1];
+    half d4 = cached[localOffset + localRowLen + 1];
+    half n1 = cached[localOffset - localRowLen];
+    half n2 = cached[localOffset + 1];
+    half n3 = cached[localOffset + localRowLen];
+    half n4 = cached[localOffset - 1];
+
+    // a simplified version of https://opensignalprocessingjournal.com/contents/volumes/V6/TOSIGPJ-6-1/TOSIGPJ-6-1.pdf
+    if (x_global % 2 == 0) {
+      if (y_global % 2 == 0) {
+        rgb.y = pv; // G1(R)
+        half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
+        half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
+        half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
+        half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
+        // R_G1
+        rgb.x = (k2*n2+k4*n4)/(k2+k4);
+        // B_G1
+        rgb.z = (k1*n1+k3*n3)/(k1+k3);
+      } else {
+        rgb.z = pv; // B
+        half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
+        half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
+        half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
+        half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
+        // G_B
+        rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
+        // R_B
+        rgb.x = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
+      }
     } else {
-      rgb.y = pv; // G2(B)
-      half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
-      half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
-      half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
-      half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
-      // R_G2
-      rgb.x = (k1*n1+k3*n3)/(k1+k3);
-      // B_G2
-      rgb.z = (k2*n2+k4*n4)/(k2+k4);
+      if (y_global % 2 == 0) {
+        rgb.x = pv; // R
+        half k1 = phi(fabs_diff(d1, d3) + fabs_diff(d2, d4));
+        half k2 = phi(fabs_diff(n1, n4) + fabs_diff(n2, n3));
+        half k3 = phi(fabs_diff(d1, d2) + fabs_diff(d3, d4));
+        half k4 = phi(fabs_diff(n1, n2) + fabs_diff(n3, n4));
+        // G_R
+        rgb.y = (k1*(n1+n3)*0.5+k3*(n2+n4)*0.5)/(k1+k3);
+        // B_R
+        rgb.z = (k2*(d2+d3)*0.5+k4*(d1+d4)*0.5)/(k2+k4);
+      } else {
+        rgb.y = pv; // G2(B)
+        half k1 = phi(fabs_diff(d1, pv) + fabs_diff(d2, pv));
+        half k2 = phi(fabs_diff(d2, pv) + fabs_diff(d4, pv));
+        half k3 = phi(fabs_diff(d3, pv) + fabs_diff(d4, pv));
+        half k4 = phi(fabs_diff(d1, pv) + fabs_diff(d3, pv));
+        // R_G2
+        rgb.x = (k1*n1+k3*n3)/(k1+k3);
+        // B_G2
+        rgb.z = (k2*n2+k4*n4)/(k2+k4);
+      }
     }
   }
 
@@ -204,4 +218,27 @@ __kernel void debayer10(const __global uchar * in,
   out[out_idx + 0] = (uchar)(rgb.z);
   out[out_idx + 1] = (uchar)(rgb.y);
   out[out_idx + 2] = (uchar)(rgb.x);
+
+#if FUSED_YUV
+  // I420, every pixel writes its Y and the top left pixel of each 2x2 block its U and V.
+  // work groups start at even coordinates, so a block never spans two of them
+  const uchar4 p = (uchar4)((uchar)(rgb.x), (uchar)(rgb.y), (uchar)(rgb.z), 0);
+  out_yuv[y_global * RGB_WIDTH + x_global] = RGB_TO_Y(p.x, p.y, p.z);
+
+  const int rgbOffset = y_local * get_local_size(0) + x_local;
+  rgb_cached[rgbOffset] = p;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if (x_global % 2 == 0 && y_global % 2 == 0) {
+    const uchar4 p1 = rgb_cached[rgbOffset + 1];
+    const uchar4 p2 = rgb_cached[rgbOffset + get_local_size(0)];
+    const uchar4 p3 = rgb_cached[rgbOffset + get_local_size(0) + 1];
+    const short ar = AVERAGE(p.x, p1.x, p2.x, p3.x);
+    const short ag = AVERAGE(p.y, p1.y, p2.y, p3.y);
+    const short ab = AVERAGE(p.z, p1.z, p2.z, p3.z);
+    const int uv_idx = (y_global / 2) * (RGB_WIDTH / 2) + x_global / 2;
+    out_yuv[RGB_SIZE + uv_idx] = RGB_TO_U(ar, ag, ab);
+    out_yuv[RGB_SIZE + RGB_SIZE / 4 + uv_idx] = RGB_TO_V(ar, ag, ab);
+  }
+#endif
 }
@@ -0,0 +1,152 @@
+#include "selfdrive/camerad/cameras/thumbnail_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "libyuv.h"
+#include <jpeglib.h>
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+
+static kj::Array<capnp::byte> yuv420_to_jpeg(uint8_t *yuv, int width, int height) {
+  uint8_t *y_plane = yuv;
+  uint8_t *u_plane = y_plane + width * height;
+  uint8_t *v_plane = u_plane + (width * height) / 4;
+
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  uint8_t *thumbnail_buffer = nullptr;
+  size_t thumbnail_len = 0;
+  jpeg_mem_dest(&cinfo, &thumbnail_buffer, &thumbnail_len);
+
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+  // configure sampling factors for yuv420.
+  cinfo.comp_info[0].h_samp_factor = 2;  // Y
+  cinfo.comp_info[0].v_samp_factor = 2;
+  cinfo.comp_info[1].h_samp_factor = 1;  // U
+  cinfo.comp_info[1].v_samp_factor = 1;
+  cinfo.comp_info[2].h_samp_factor = 1;  // V
+  cinfo.comp_info[2].v_samp_factor = 1;
+  cinfo.raw_data_in = TRUE;
+
+  jpeg_set_quality(&cinfo, 50, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+
+  JSAMPROW y[16], u[8], v[8];
+  JSAMPARRAY planes[3]{y, u, v};
+
+  for (int line = 0; line < cinfo.image_height; line += 16) {
+    for (int i = 0; i < 16; ++i) {
+      y[i] = y_plane + (line + i) * cinfo.image_width;
+      if (i % 2 == 0) {
+        int offset = (cinfo.image_width / 2) * ((i + line) / 2);
+        u[i / 2] = u_plane + offset;
+        v[i / 2] = v_plane + offset;
+      }
+    }
+    jpeg_write_raw_data(&cinfo, planes, 16);
+  }
+
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  kj::Array<capnp::byte> dat = kj::heapArray<capnp::byte>(thumbnail_buffer, thumbnail_len);
+  free(thumbnail_buffer);
+  return dat;
+}
+
+ThumbnailPool::ThumbnailPool(PubMaster *pm, int num_workers, int max_queued) : pm(pm), max_queued(max_queued) {
+  for (int i = 0; i < num_workers; ++i) {
+    workers.push_back(std::thread(&ThumbnailPool::workerThread, this));
+  }
+}
+
+ThumbnailPool::~ThumbnailPool() {
+  {
+    std::unique_lock lk(lock);
+    exit_ = true;
+  }
+  cv.notify_all();
+  for (auto &t : workers) t.join();
+}
+
+void ThumbnailPool::push(const CameraBuf *b) {
+  auto job = std::make_unique<Job>();
+  job->frame_id = b->cur_frame_data.frame_id;
+  job->timestamp_eof = b->cur_frame_data.timestamp_eof;
+  job->width = b->rgb_width / 4;
+  job->height = b->rgb_height / 4;
+  job->queued_time = seconds_since_boot();
+
+  // make the buffer big enough. jpeg_write_raw_data requires 16-pixels aligned height to be used.
+  const int w = job->width, h = job->height;
+  job->yuv = std::make_unique<uint8_t[]>((w * ((h + 15) & ~15) * 3) / 2);
+  uint8_t *y_plane = job->yuv.get();
+  uint8_t *u_plane = y_plane + w * h;
+  uint8_t *v_plane = u_plane + (w * h) / 4;
+  int result = libyuv::I420Scale(
+      b->cur_yuv_buf->y, b->rgb_width, b->cur_yuv_buf->u, b->rgb_width / 2, b->cur_yuv_buf->v, b->rgb_width / 2,
+      b->rgb_width, b->rgb_height,
+      y_plane, w, u_plane, w / 2, v_plane, w / 2,
+      w, h, libyuv::kFilterNone);
+  if (result != 0) {
+    LOGE("Generate YUV thumbnail failed.");
+    return;
+  }
+
+  {
+    std::unique_lock lk(lock);
+    if ((int)jobs.size() >= max_queued) {
+      dropped++;
+      LOGW("thumbnail encoder busy, dropping frame %d (%u dropped)", jobs.front()->frame_id, dropped);
+      jobs.pop_front();
+    }
+    jobs.push_back(std::move(job));
+  }
+  cv.notify_one();
+}
+
+void ThumbnailPool::workerThread() {
+  set_thread_name("ThumbnailEnc");
+  // encoding is best effort, keep it off camerad's realtime core
+  if (set_default_scheduling() != 0) {
+    LOGW("ThumbnailEnc: failed to reset scheduling");
+  }
+  while (true) {
+    std::unique_ptr<Job> job;
+    {
+      std::unique_lock lk(lock);
+      cv.wait(lk, [this] { return exit_ || !jobs.empty(); });
+      if (exit_) break;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+
+    auto thumbnail = yuv420_to_jpeg(job->yuv.get(), job->width, job->height);
+    if (thumbnail.size() == 0) continue;
+
+    MessageBuilder msg;
+    auto thumbnaild = msg.initEvent().initThumbnail();
+    thumbnaild.setFrameId(job->frame_id);
+    thumbnaild.setTimestampEof(job->timestamp_eof);
+    thumbnaild.setThumbnail(thumbnail);
+    pm->send("thumbnail", msg);
+
+    const double latency = seconds_since_boot() - job->queued_time;
+    std::unique_lock lk(lock);
+    encoded++;
+    max_latency = std::max(max_latency, latency);
+    LOGD("thumbnail %d published after %.2f ms (%u encoded, %u dropped, max %.2f ms)",
+         job->frame_id, latency * 1000, encoded, dropped, max_latency * 1000);
+  }
+}
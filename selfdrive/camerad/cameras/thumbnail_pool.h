@@ -0,0 +1,47 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "selfdrive/camerad/cameras/camera_common.h"
+
+// Encodes and publishes thumbnails on worker threads. The camera processing
+// thread only downscales the frame into a job, which the workers compress to
+// jpeg and send.
+//
+// When all workers are busy and max_queued jobs are waiting, the oldest
+// waiting job is dropped, a newer thumbnail is more useful than a late one.
+class ThumbnailPool {
+public:
+  ThumbnailPool(PubMaster *pm, int num_workers = 1, int max_queued = 2);
+  ~ThumbnailPool();
+  // queues a quarter resolution copy of the current yuv buffer
+  void push(const CameraBuf *b);
+
+private:
+  struct Job {
+    uint32_t frame_id;
+    uint64_t timestamp_eof;
+    int width, height;
+    std::unique_ptr<uint8_t[]> yuv;  // I420, padded to a multiple of 16 rows for libjpeg
+    double queued_time;
+  };
+
+  void workerThread();
+
+  PubMaster *pm;
+  const int max_queued;
+  std::vector<std::thread> workers;
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<std::unique_ptr<Job>> jobs;
+  bool exit_ = false;
+  uint32_t encoded = 0, dropped = 0;
+  double max_latency = 0;
+};
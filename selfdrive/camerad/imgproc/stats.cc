@@ -0,0 +1,113 @@
+#include "selfdrive/camerad/imgproc/stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "luma_histogram reads pixels as little endian words");
+
+// consecutive pixels go to different banks, so runs of the same value don't
+// wait on the increment of a single counter
+typedef std::array<std::array<uint32_t, 256>, 4> HistogramBanks;
+
+static inline uint64_t load_word(const uint8_t *p) {
+  uint64_t w;
+  memcpy(&w, p, sizeof(w));
+  return w;
+}
+
+static void add_row(HistogramBanks &banks, const uint8_t *row, int len, int skip) {
+  int i = 0;
+  if (skip == 1) {
+    for (; i + 8 <= len; i += 8) {
+      const uint64_t w = load_word(row + i);
+      banks[0][w & 0xff]++;
+      banks[1][(w >> 8) & 0xff]++;
+      banks[2][(w >> 16) & 0xff]++;
+      banks[3][(w >> 24) & 0xff]++;
+      banks[0][(w >> 32) & 0xff]++;
+      banks[1][(w >> 40) & 0xff]++;
+      banks[2][(w >> 48) & 0xff]++;
+      banks[3][w >> 56]++;
+    }
+  } else if (skip == 2) {
+    for (; i + 8 <= len; i += 8) {
+      const uint64_t w = load_word(row + i);
+      banks[0][w & 0xff]++;
+      banks[1][(w >> 16) & 0xff]++;
+      banks[2][(w >> 32) & 0xff]++;
+      banks[3][(w >> 48) & 0xff]++;
+    }
+  }
+  for (int bank = 0; i < len; i += skip, bank = (bank + 1) % 4) {
+    banks[bank][row[i]]++;
+  }
+}
+
+LumaHistogram luma_histogram(const uint8_t *y_plane, int stride,
+                             int x_start, int x_end, int x_skip,
+                             int y_start, int y_end, int y_skip) {
+  LumaHistogram hist;
+  if (x_end <= x_start || y_end <= y_start) return hist;
+
+  HistogramBanks banks = {};
+  for (int y = y_start; y < y_end; y += y_skip) {
+    add_row(banks, y_plane + y * stride + x_start, x_end - x_start, x_skip);
+  }
+
+  for (int v = 0; v < 256; v++) {
+    hist.bins[v] = banks[0][v] + banks[1][v] + banks[2][v] + banks[3][v];
+  }
+  hist.count = ((x_end - x_start + x_skip - 1) / x_skip) * ((y_end - y_start + y_skip - 1) / y_skip);
+  return hist;
+}
+
+float LumaHistogram::mean() const {
+  if (count == 0) return 0;
+
+  uint64_t sum = 0;
+  for (int v = 0; v < 256; v++) {
+    sum += (uint64_t)v * bins[v];
+  }
+  return (double)sum / count;
+}
+
+float LumaHistogram::variance() const {
+  if (count == 0) return 0;
+
+  uint64_t sum = 0, sum_sq = 0;
+  for (int v = 0; v < 256; v++) {
+    sum += (uint64_t)v * bins[v];
+    sum_sq += (uint64_t)v * v * bins[v];
+  }
+  const double mean = (double)sum / count;
+  return (double)sum_sq / count - mean * mean;
+}
+
+int LumaHistogram::percentile(float p) const {
+  const uint32_t target = count * (1.0f - p);
+  uint32_t cur = 0;
+  for (int v = 255; v > 0; v--) {
+    cur += bins[v];
+    if (cur >= target) return v;
+  }
+  return 0;
+}
+
+uint16_t laplacian_sharpness(const int16_t *lap, int size) {
+  // one pass over the samples, the variance around the truncated mean is
+  // expanded as sum(l^2) - 2 * mean * sum(l) + size * mean^2
+  int16_t max = 0;
+  int64_t sum = 0, sum_sq = 0;
+  for (int i = 0; i < size; ++i) {
+    const int64_t v = lap[i];
+    sum += v;
+    sum_sq += v * v;
+    max = std::max(max, lap[i]);
+  }
+
+  const int64_t mean = (int16_t)(sum / size);
+  const int64_t var = sum_sq - 2 * mean * sum + size * mean * mean;
+
+  const float fvar = (float)var / size;
+  return std::min(5 * fvar + max, (float)65535);
+}
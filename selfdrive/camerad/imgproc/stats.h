@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Histogram of the luminance in a region of a Y plane. The mean, variance and
+// percentiles all come from the bins, so the pixels are only read once.
+struct LumaHistogram {
+  std::array<uint32_t, 256> bins = {};
+  uint32_t count = 0;
+
+  float mean() const;
+  float variance() const;
+  // highest value that at least (1 - p) of the samples are at or above
+  int percentile(float p) const;
+};
+
+// samples every x_skip-th pixel of every y_skip-th row in [x_start, x_end) x [y_start, y_end)
+LumaHistogram luma_histogram(const uint8_t *y_plane, int stride,
+                             int x_start, int x_end, int x_skip,
+                             int y_start, int y_end, int y_skip);
+
+// sharpness score of a laplacian filtered region, 5 * variance + max
+uint16_t laplacian_sharpness(const int16_t *lap, int size);
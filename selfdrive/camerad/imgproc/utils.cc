@@ -3,37 +3,14 @@
 #include <algorithm>
 #include <cassert>
 #include <cstdio>
-#include <cmath>
 #include <cstring>
 
+#include "selfdrive/camerad/imgproc/stats.h"
+
 const int16_t lapl_conv_krnl[9] = {0, 1, 0,
                                    1, -4, 1,
                                    0, 1, 0};
 
-// calculate score based on laplacians in one area
-uint16_t get_lapmap_one(const int16_t *lap, int x_pitch, int y_pitch) {
-  const int size = x_pitch * y_pitch;
-  // avg and max of roi
-  int16_t max = 0;
-  int sum = 0;
-  for (int i = 0; i < size; ++i) {
-    const int16_t v = lap[i];
-    sum += v;
-    if (v > max) max = v;
-  }
-
-  const int16_t mean = sum / size;
-
-  // var of roi
-  int var = 0;
-  for (int i = 0; i < size; ++i) {
-    var += std::pow(lap[i] - mean, 2);
-  }
-
-  const float fvar = (float)var / size;
-  return std::min(5 * fvar + max, (float)65535);
-}
-
 bool is_blur(const uint16_t *lapmap, const size_t size) {
   float bad_sum = 0;
   for (int i = 0; i < size; i++) {
@@ -102,5 +79,5 @@ uint16_t LapConv::Update(cl_command_queue q, const uint8_t *rgb_buf, const int r
   CL_CHECK(clEnqueueReadBuffer(q, result_cl, CL_TRUE, 0,
                                result_buf.size() * sizeof(result_buf[0]), result_buf.data(), 0, 0, 0));
 
-  return get_lapmap_one(result_buf.data(), width, height);
+  return laplacian_sharpness(result_buf.data(), width * height);
 }
@@ -30,3 +30,18 @@ int gpio_set(int pin_nr, bool high) {
   }
   return util::write_file(pin_val_path, (void*)(high ? "1" : "0"), 1);
 }
+
+int gpio_get_irq_fd(int pin_nr) {
+  char pin_path[50];
+  int pin_path_len = snprintf(pin_path, sizeof(pin_path),
+                       "/sys/class/gpio/gpio%d/edge", pin_nr);
+  if(pin_path_len <= 0) {
+    return -1;
+  }
+  if(gpio_init(pin_nr, false) != 0 || util::write_file(pin_path, (void*)"rising", 6) != 0) {
+    return -1;
+  }
+
+  snprintf(pin_path, sizeof(pin_path), "/sys/class/gpio/gpio%d/value", pin_nr);
+  return HANDLE_EINTR(open(pin_path, O_RDONLY));
+}
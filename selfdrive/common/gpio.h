@@ -8,6 +8,8 @@
   #define GPIO_UBLOX_PWR_EN     34
   #define GPIO_STM_RST_N        124
   #define GPIO_STM_BOOT0        134
+  // LSM6DS3 INT1, sensord polls if it never fires
+  #define GPIO_LSM_INT          84
 #else
   #define GPIO_HUB_RST_N        0
   #define GPIO_UBLOX_RST_N      0
@@ -15,7 +17,12 @@
   #define GPIO_UBLOX_PWR_EN     0
   #define GPIO_STM_RST_N        0
   #define GPIO_STM_BOOT0        0
+  #define GPIO_LSM_INT          0
 #endif
 
 int gpio_init(int pin_nr, bool output);
 int gpio_set(int pin_nr, bool high);
+
+// Configures an input pin to raise an event on rising edges. Returns a fd
+// that polls as POLLPRI on each edge, or -1 on failure.
+int gpio_get_irq_fd(int pin_nr);
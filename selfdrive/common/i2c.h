@@ -8,10 +8,16 @@ class I2CBus {
   private:
     int i2c_fd;
 
+  protected:
+    // for simulated buses
+    I2CBus() : i2c_fd(-1) {}
+
   public:
     I2CBus(uint8_t bus_id);
-    ~I2CBus();
+    virtual ~I2CBus();
 
-    int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
-    int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    virtual int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len);
+    virtual int set_register(uint8_t device_address, uint register_address, uint8_t data);
+    // Reads len bytes starting at register_address in a single transaction, not limited to an SMBus block
+    virtual int read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len);
 };
@@ -0,0 +1,100 @@
+#include "selfdrive/common/ratekeeper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
+
+const double STATS_INTERVAL = 5.0;  // seconds
+
+void TimingHistogram::add(double ms) {
+  ms = std::max(ms, 0.);
+  int bin = std::upper_bound(EDGES.begin(), EDGES.end(), ms) - EDGES.begin();
+  counts[bin]++;
+  max = std::max(max, (float)ms);
+}
+
+void TimingHistogram::reset() {
+  counts.fill(0);
+  max = 0;
+}
+
+void TimingHistogram::fill(cereal::LoopStats::Histogram::Builder histogram) const {
+  histogram.setCounts(kj::ArrayPtr<const uint32_t>(counts.data(), counts.size()));
+  histogram.setMax(max);
+}
+
+RateKeeper::RateKeeper(const std::string &name, float rate, float print_delay_threshold)
+    : name(name), interval(1. / rate), print_delay_threshold(print_delay_threshold) {
+  last_wakeup = stats_start = seconds_since_boot();
+  next_frame_time = last_wakeup + interval;
+}
+
+bool RateKeeper::keepTime() {
+  bool missed = monitorTime();
+  if (remaining_ > 0) {
+    std::this_thread::sleep_for(std::chrono::duration<double>(remaining_));
+  }
+
+  // the next period started at the deadline of this one
+  double now = seconds_since_boot();
+  if (remaining_ > 0) {
+    wakeup_jitter.add((now - (next_frame_time - interval)) * 1e3);
+  }
+  last_wakeup = now;
+  return missed;
+}
+
+bool RateKeeper::monitorTime() {
+  double now = seconds_since_boot();
+  remaining_ = next_frame_time - now;
+  run_time.add((now - last_wakeup) * 1e3);
+
+  bool missed = remaining_ < 0;
+  if (missed) {
+    overrun.add(-remaining_ * 1e3);
+    stats_missed++;
+    if (print_delay_threshold > 0 && remaining_ < -print_delay_threshold) {
+      LOGW("%s lagging by %.2f ms", name.c_str(), -remaining_ * 1000);
+    }
+    // start over instead of running the missed iterations back to back
+    next_frame_time = now;
+  }
+  next_frame_time += interval;
+
+  frame_++;
+  stats_frames++;
+  return missed;
+}
+
+void RateKeeper::wakeup() {
+  double now = seconds_since_boot();
+  wakeup_jitter.add((now - (next_frame_time - interval)) * 1e3);
+  last_wakeup = now;
+  next_frame_time = now + interval;
+}
+
+bool RateKeeper::statsReady() const {
+  return seconds_since_boot() - stats_start >= STATS_INTERVAL;
+}
+
+void RateKeeper::fillStats(cereal::LoopStats::Builder stats) {
+  double now = seconds_since_boot();
+  stats.setName(name);
+  stats.setRate(1. / interval);
+  stats.setDuration(now - stats_start);
+  stats.setFrames(stats_frames);
+  stats.setMissed(stats_missed);
+  stats.setBinEdges(kj::ArrayPtr<const float>(TimingHistogram::EDGES.data(), TimingHistogram::EDGES.size()));
+  wakeup_jitter.fill(stats.initWakeupJitter());
+  run_time.fill(stats.initRunTime());
+  overrun.fill(stats.initOverrun());
+
+  stats_start = now;
+  stats_frames = stats_missed = 0;
+  wakeup_jitter.reset();
+  run_time.reset();
+  overrun.reset();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "cereal/gen/cpp/log.capnp.h"
+
+// Counts of durations in ms
+class TimingHistogram {
+public:
+  // upper bin edges, the last bin has none
+  static constexpr std::array<float, 11> EDGES = {0.05, 0.1, 0.2, 0.5, 1, 2, 5, 10, 20, 50, 100};
+
+  void add(double ms);
+  void reset();
+  void fill(cereal::LoopStats::Histogram::Builder histogram) const;
+
+private:
+  std::array<uint32_t, EDGES.size() + 1> counts = {};
+  float max = 0;
+};
+
+// Keeps a loop at a fixed rate like common/realtime.py's Ratekeeper, and
+// records how well it meets its deadlines. Every iteration has a deadline of
+// one period after it should have started.
+//
+// Loops paced by time call keepTime() at the end of every iteration. Loops
+// paced by their input (frames, interrupts, messages) call wakeup() when the
+// input arrives and monitorTime() when they are done with it.
+//
+// The stats are meant to be published as a LoopStats message when
+// statsReady(), fillStats() starts the next window.
+class RateKeeper {
+public:
+  RateKeeper(const std::string &name, float rate, float print_delay_threshold = 0);
+
+  // sleeps until the next period starts, returns true if the deadline was missed
+  bool keepTime();
+  // only checks the deadline, returns true if it was missed
+  bool monitorTime();
+  // the input of an iteration arrived, its deadline is one period from now
+  void wakeup();
+
+  inline uint64_t frame() const { return frame_; }
+  inline double remaining() const { return remaining_; }
+
+  bool statsReady() const;
+  void fillStats(cereal::LoopStats::Builder stats);
+
+private:
+  std::string name;
+  double interval;
+  float print_delay_threshold;
+
+  double next_frame_time;
+  double last_wakeup;
+  double remaining_ = 0;
+  uint64_t frame_ = 0;
+
+  double stats_start;
+  uint32_t stats_frames = 0, stats_missed = 0;
+  TimingHistogram wakeup_jitter, run_time, overrun;
+};
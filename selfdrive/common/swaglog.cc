@@ -4,10 +4,16 @@
 
 #include "selfdrive/common/swaglog.h"
 
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <cstdarg>
 #include <cstring>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <zmq.h>
 #include "json11.hpp"
@@ -16,6 +22,35 @@
 #include "selfdrive/common/version.h"
 #include "selfdrive/hardware/hw.h"
 
+// Logging is split in two halves. cloudlog_e formats the message into a ring owned by
+// the calling thread and returns, without locks, allocations or JSON. A log thread drains
+// the rings, renders the JSON (with the context serialized once per cloudlog_bind),
+// prints and sends it to logmessaged. Errors and critical records are the exceptions: an
+// error that finds its ring full is sent by the caller, and a critical record is drained
+// by the caller before cloudlog_e returns.
+
+const int LOG_RING_SIZE = 256;  // records per thread, power of two
+const int LOG_MSG_SIZE = 472;   // records are 512 bytes
+
+struct LogRecord {
+  int levelnum;
+  int lineno;
+  const char* filename;
+  const char* func;
+  double created;
+  char* long_msg;  // heap allocated when the message doesn't fit in msg
+  char msg[LOG_MSG_SIZE];
+};
+
+// single producer (the owning thread), single consumer (the log thread)
+struct LogRing {
+  LogRecord records[LOG_RING_SIZE];
+  std::atomic<uint32_t> head = 0;  // next record written
+  std::atomic<uint32_t> tail = 0;  // next record read
+  std::atomic<int> dropped = 0;
+  std::atomic<bool> closed = false;  // owning thread exited
+};
+
 class LogState {
  public:
   LogState() = default;
@@ -23,20 +58,124 @@ class LogState {
   std::mutex lock;
   bool inited;
   json11::Json::object ctx_j;
+  std::string ctx_s;
   void *zctx;
   void *sock;
   int print_level;
-};
 
-LogState::~LogState() {
-  zmq_close(sock);
-  zmq_ctx_destroy(zctx);
-}
+  std::vector<std::shared_ptr<LogRing>> rings;
+  std::thread thread;
+  std::condition_variable wake_cv;
+  std::atomic<bool> waiting;
+  bool exit;
+};
 
 static LogState s = {};
 
+// the ring of the calling thread, closed when the thread exits
+struct ThreadRing {
+  std::shared_ptr<LogRing> ring;
+  ~ThreadRing() {
+    if (ring) ring->closed = true;
+  }
+};
+static thread_local ThreadRing thread_ring;
+
 static void cloudlog_bind_locked(const char* k, const char* v) {
   s.ctx_j[k] = v;
+  s.ctx_s = json11::Json(s.ctx_j).dump();
+}
+
+static void send_record(const LogRecord& r) {
+  const char* msg = r.long_msg ? r.long_msg : r.msg;
+  if (r.levelnum >= s.print_level) {
+    printf("%s: %s\n", r.filename, msg);
+  }
+
+  json11::Json log_j = json11::Json::object {
+    {"msg", msg},
+    {"levelnum", r.levelnum},
+    {"filename", r.filename},
+    {"lineno", r.lineno},
+    {"funcname", r.func},
+    {"created", r.created}
+  };
+  std::string log_s = log_j.dump();
+  log_s.insert(1, "\"ctx\": " + s.ctx_s + ", ");
+  log_s.insert(log_s.begin(), (char)r.levelnum);
+  zmq_send(s.sock, log_s.data(), log_s.length(), ZMQ_NOBLOCK);
+}
+
+// sends everything written so far, returns false if there was nothing to send
+static bool drain_locked() {
+  bool sent = false;
+  for (auto it = s.rings.begin(); it != s.rings.end();) {
+    LogRing* ring = it->get();
+    // read closed first, so no record can be written after an empty closed ring is dropped
+    bool closed = ring->closed.load(std::memory_order_acquire);
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t head = ring->head.load(std::memory_order_acquire);
+
+    if (int dropped = ring->dropped.exchange(0)) {
+      LogRecord r = {};
+      r.levelnum = CLOUDLOG_WARNING;
+      r.lineno = __LINE__;
+      r.filename = __FILE__;
+      r.func = __func__;
+      r.created = seconds_since_epoch();
+      snprintf(r.msg, sizeof(r.msg), "cloudlog: %d messages dropped", dropped);
+      send_record(r);
+    }
+
+    for (; tail != head; tail++) {
+      LogRecord& r = ring->records[tail % LOG_RING_SIZE];
+      send_record(r);
+      free(r.long_msg);
+      ring->tail.store(tail + 1, std::memory_order_release);
+      sent = true;
+    }
+
+    if (closed) {
+      it = s.rings.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return sent;
+}
+
+static void log_thread() {
+  // started by the first LOG of the process, which may come from a realtime thread
+  set_thread_name("swaglog");
+  set_default_scheduling();
+
+  std::unique_lock lk(s.lock);
+  while (true) {
+    if (drain_locked()) continue;
+    if (s.exit) break;
+
+    // check the rings again after setting waiting: a producer either sees waiting and
+    // wakes us, or wrote its record before and it is sent here
+    s.waiting = true;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!drain_locked()) {
+      s.wake_cv.wait(lk);
+    }
+    s.waiting = false;
+  }
+}
+
+LogState::~LogState() {
+  if (inited) {
+    {
+      std::lock_guard lk(lock);
+      exit = true;
+    }
+    wake_cv.notify_one();
+    thread.join();
+  }
+  zmq_close(sock);
+  zmq_ctx_destroy(zctx);
 }
 
 static void cloudlog_init() {
@@ -78,42 +217,80 @@ static void cloudlog_init() {
   } else {
     cloudlog_bind_locked("device", "pc");
   }
+  s.ctx_s = json11::Json(s.ctx_j).dump();
 
+  s.thread = std::thread(log_thread);
   s.inited = true;
 }
 
-void log(int levelnum, const char* filename, int lineno, const char* func, const char* msg, const std::string& log_s) {
-  std::lock_guard lk(s.lock);
-  cloudlog_init();
-  if (levelnum >= s.print_level) {
-    printf("%s: %s\n", filename, msg);
+static LogRing* get_thread_ring() {
+  if (!thread_ring.ring) {
+    std::lock_guard lk(s.lock);
+    cloudlog_init();
+    if (s.exit) return nullptr;
+    thread_ring.ring = std::make_shared<LogRing>();
+    s.rings.push_back(thread_ring.ring);
   }
-  char levelnum_c = levelnum;
-  zmq_send(s.sock, (levelnum_c + log_s).c_str(), log_s.length() + 1, ZMQ_NOBLOCK);
+  return thread_ring.ring.get();
+}
+
+static void fill_record(LogRecord& r, int levelnum, const char* filename, int lineno, const char* func,
+                        const char* fmt, va_list args) {
+  r.levelnum = levelnum;
+  r.lineno = lineno;
+  r.filename = filename;
+  r.func = func;
+  r.created = seconds_since_epoch();
+  r.long_msg = nullptr;
+
+  va_list args_long;
+  va_copy(args_long, args);
+  int len = vsnprintf(r.msg, sizeof(r.msg), fmt, args);
+  if (len >= (int)sizeof(r.msg) && vasprintf(&r.long_msg, fmt, args_long) < 0) {
+    r.long_msg = nullptr;
+  }
+  va_end(args_long);
 }
 
 void cloudlog_e(int levelnum, const char* filename, int lineno, const char* func,
                 const char* fmt, ...) {
-  char* msg_buf = nullptr;
+  LogRing* ring = get_thread_ring();
+  if (!ring) return;
+
   va_list args;
   va_start(args, fmt);
-  vasprintf(&msg_buf, fmt, args);
-  va_end(args);
+  uint32_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) == LOG_RING_SIZE) {
+    if (levelnum < CLOUDLOG_ERROR) {
+      ring->dropped++;
+    } else {
+      // errors are never dropped, send what is queued before them and then the error itself
+      LogRecord r;
+      fill_record(r, levelnum, filename, lineno, func, fmt, args);
+      std::lock_guard lk(s.lock);
+      drain_locked();
+      send_record(r);
+      free(r.long_msg);
+    }
+    va_end(args);
+    return;
+  }
 
-  if (!msg_buf) return;
+  fill_record(ring->records[head % LOG_RING_SIZE], levelnum, filename, lineno, func, fmt, args);
+  va_end(args);
 
-  json11::Json log_j = json11::Json::object {
-    {"msg", msg_buf},
-    {"ctx", s.ctx_j},
-    {"levelnum", levelnum},
-    {"filename", filename},
-    {"lineno", lineno},
-    {"funcname", func},
-    {"created", seconds_since_epoch()}
-  };
-  std::string log_s = log_j.dump();
-  log(levelnum, filename, lineno, func, msg_buf, log_s);
-  free(msg_buf);
+  ring->head.store(head + 1, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (levelnum >= CLOUDLOG_CRITICAL) {
+    // sent before returning, so it isn't lost to a following abort. This drains on the
+    // calling thread instead of waiting for the log thread, which runs at normal priority
+    std::lock_guard lk(s.lock);
+    drain_locked();
+  } else if (s.waiting.load(std::memory_order_relaxed)) {
+    // the log thread is idle, only the first record after that takes the lock
+    { std::lock_guard lk(s.lock); }
+    s.wake_cv.notify_one();
+  }
 }
 
 void cloudlog_bind(const char* k, const char* v) {
@@ -0,0 +1,52 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <zmq.h>
+
+#include <string>
+#include <thread>
+
+#include "selfdrive/common/swaglog.h"
+
+const char *LOG_ADDR = "ipc:///tmp/logmessage";
+
+// receives until a record containing msg arrives, or nothing came for a second
+static bool recv_until(void *sock, const std::string &msg) {
+  char buf[4096];
+  while (true) {
+    int len = zmq_recv(sock, buf, sizeof(buf) - 1, 0);
+    if (len < 0) return false;
+    if (std::string(buf, std::min(len, (int)sizeof(buf) - 1)).find(msg) != std::string::npos) return true;
+  }
+}
+
+TEST_CASE("errors are sent when the ring is full") {
+  void *ctx = zmq_ctx_new();
+  void *sock = zmq_socket(ctx, ZMQ_PULL);
+  int timeout = 1000, hwm = 0;
+  zmq_setsockopt(sock, ZMQ_RCVTIMEO, &timeout, sizeof(timeout));
+  zmq_setsockopt(sock, ZMQ_RCVHWM, &hwm, sizeof(hwm));
+  REQUIRE(zmq_bind(sock, LOG_ADDR) == 0);
+
+  // a new thread gets an empty ring, and logs faster than the log thread sends
+  std::thread t([] {
+    for (int i = 0; i < 4096; i++) {
+      LOGD("filling the ring %d", i);
+    }
+    LOGE("error after a full ring");
+  });
+  REQUIRE(recv_until(sock, "error after a full ring"));
+  t.join();
+
+  t = std::thread([] {
+    for (int i = 0; i < 4096; i++) {
+      LOGD("filling the ring %d", i);
+    }
+    cloudlog(CLOUDLOG_CRITICAL, "critical after a full ring");
+  });
+  REQUIRE(recv_until(sock, "critical after a full ring"));
+  t.join();
+
+  zmq_close(sock);
+  zmq_ctx_destroy(ctx);
+}
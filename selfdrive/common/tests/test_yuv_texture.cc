@@ -0,0 +1,185 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "selfdrive/common/visionimg.h"
+
+// camerad's rgb_to_yuv.cl on the cpu, rgb is bgr24
+#define RGB_TO_Y(r, g, b) ((((b) * 13 + (g) * 65 + (r) * 33 + 64) >> 7) + 16)
+#define RGB_TO_U(r, g, b) (((b) * 56 - (g) * 37 - (r) * 19 + 0x8080) >> 8)
+#define RGB_TO_V(r, g, b) (((r) * 56 - (g) * 47 - (b) * 9 + 0x8080) >> 8)
+
+static std::vector<uint8_t> rgb_to_yuv(const std::vector<uint8_t> &bgr, int width, int height) {
+  std::vector<uint8_t> yuv(width * height * 3 / 2);
+  uint8_t *u = &yuv[width * height], *v = u + (width / 2) * (height / 2);
+  for (int r = 0; r < height; r++) {
+    for (int c = 0; c < width; c++) {
+      const uint8_t *p = &bgr[(r * width + c) * 3];
+      yuv[r * width + c] = RGB_TO_Y(p[2], p[1], p[0]);
+    }
+  }
+  for (int r = 0; r < height / 2; r++) {
+    for (int c = 0; c < width / 2; c++) {
+      int sum[3] = {};
+      for (int i = 0; i < 4; i++) {
+        const uint8_t *p = &bgr[((2 * r + i / 2) * width + 2 * c + i % 2) * 3];
+        for (int ch = 0; ch < 3; ch++) sum[ch] += p[ch];
+      }
+      // AVERAGE() keeps one more bit, the U/V coefficients are halved for it
+      const int b = (sum[0] + 1) >> 1, g = (sum[1] + 1) >> 1, rr = (sum[2] + 1) >> 1;
+      u[r * (width / 2) + c] = RGB_TO_U(rr, g, b);
+      v[r * (width / 2) + c] = RGB_TO_V(rr, g, b);
+    }
+  }
+  return yuv;
+}
+
+static bool init_egl() {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) return false;
+
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs == 0) return false;
+  eglBindAPI(EGL_OPENGL_ES_API);
+  const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_NONE};
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+  return context != EGL_NO_CONTEXT && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+static GLuint compile_program() {
+  const char vertex_shader[] =
+    GLSL_VERSION
+    "in vec4 aPosition;\n"
+    "out vec4 vTexCoord;\n"
+    "void main() {\n"
+    "  gl_Position = aPosition;\n"
+    "  vTexCoord = vec4(aPosition.xy * 0.5 + 0.5, 0.0, 0.0);\n"
+    "}\n";
+  const char *sources[2] = {vertex_shader, YUVTexture::fragment_shader};
+  const GLenum types[2] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+  GLuint program = glCreateProgram();
+  for (int i = 0; i < 2; i++) {
+    GLuint shader = glCreateShader(types[i]);
+    glShaderSource(shader, 1, &sources[i], NULL);
+    glCompileShader(shader);
+    GLint ok = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    REQUIRE(ok);
+    glAttachShader(program, shader);
+    glDeleteShader(shader);
+  }
+  glBindAttribLocation(program, 0, "aPosition");
+  glLinkProgram(program);
+  GLint ok = 0;
+  glGetProgramiv(program, GL_LINK_STATUS, &ok);
+  REQUIRE(ok);
+  return program;
+}
+
+// uploads the frame through the YUVTexture and draws it with its shader into the bound framebuffer
+static std::vector<uint8_t> draw(YUVTexture &tex, GLuint program, std::vector<uint8_t> &yuv, int width, int height) {
+  VisionBuf buf;
+  buf.width = width;
+  buf.height = height;
+  buf.y = yuv.data();
+  buf.u = buf.y + width * height;
+  buf.v = buf.u + (width / 2) * (height / 2);
+  REQUIRE(tex.upload(&buf));
+
+  glViewport(0, 0, width, height);
+  glUseProgram(program);
+  const char *samplers[3] = {"uTextureY", "uTextureU", "uTextureV"};
+  for (int i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, tex.textures[i]);
+    glUniform1i(glGetUniformLocation(program, samplers[i]), i);
+  }
+  glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+  // rows come back bottom up, which is also how the texture coordinates run
+  std::vector<uint8_t> rgba(width * height * 4);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+  REQUIRE(glGetError() == GL_NO_ERROR);
+  return rgba;
+}
+
+TEST_CASE("YUVTexture draws camerad's yuv back to its rgb") {
+  if (!init_egl()) {
+    WARN("no surfaceless EGL, skipping");
+    return;
+  }
+
+  // odd chroma widths leave the u and v planes unaligned
+  const int width = 2 * 37, height = 2 * 23;
+  GLuint fbo, color;
+  glGenTextures(1, &color);
+  glBindTexture(GL_TEXTURE_2D, color);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+  REQUIRE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+  const float quad[] = {-1, -1, 1, -1, -1, 1, 1, 1};
+  GLuint vao, vbo;
+  glGenVertexArrays(1, &vao);
+  glBindVertexArray(vao);
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+  GLuint program = compile_program();
+  YUVTexture tex;
+
+  // several frames so both pixel buffers are used and reused
+  std::mt19937 rng(0);
+  for (int frame = 0; frame < 3; frame++) {
+    // 2x2 blocks of one color, so the chroma subsampling is lossless
+    std::vector<uint8_t> bgr(width * height * 3);
+    for (int r = 0; r < height; r += 2) {
+      for (int c = 0; c < width; c += 2) {
+        uint8_t color[3] = {uint8_t(rng()), uint8_t(rng()), uint8_t(rng())};
+        for (int i = 0; i < 4; i++) {
+          memcpy(&bgr[((r + i / 2) * width + c + i % 2) * 3], color, 3);
+        }
+      }
+    }
+
+    std::vector<uint8_t> yuv = rgb_to_yuv(bgr, width, height);
+    std::vector<uint8_t> rgba = draw(tex, program, yuv, width, height);
+
+    int max_err = 0;
+    double sum_err = 0;
+    for (int i = 0; i < width * height; i++) {
+      for (int ch = 0; ch < 3; ch++) {
+        const int err = std::abs(rgba[i * 4 + ch] - bgr[i * 3 + 2 - ch]);
+        max_err = std::max(max_err, err);
+        sum_err += err;
+      }
+    }
+    INFO("frame " << frame << ": max error " << max_err << ", mean " << sum_err / (width * height * 3));
+    // limited range quantization and the rounded coefficients of both sides
+    REQUIRE(max_err <= 4);
+    REQUIRE(sum_err / (width * height * 3) < 1.5);
+  }
+
+  glDeleteProgram(program);
+  glDeleteBuffers(1, &vbo);
+  glDeleteVertexArrays(1, &vao);
+  glDeleteFramebuffers(1, &fbo);
+  glDeleteTextures(1, &color);
+}
@@ -13,6 +13,7 @@
 #ifdef __linux__
 #include <sys/prctl.h>
 #include <sys/syscall.h>
+#include <unistd.h>
 #ifndef __USE_GNU
 #define __USE_GNU
 #endif
@@ -53,6 +54,26 @@ int set_core_affinity(int core) {
 #endif
 }
 
+int set_default_scheduling() {
+#ifdef __linux__
+  long tid = syscall(SYS_gettid);
+
+  // threads inherit the realtime policy and core of the thread that created them
+  struct sched_param sa;
+  memset(&sa, 0, sizeof(sa));
+  int ret = sched_setscheduler(tid, SCHED_OTHER, &sa);
+
+  cpu_set_t all_cpus;
+  CPU_ZERO(&all_cpus);
+  for (long i = 0; i < sysconf(_SC_NPROCESSORS_CONF) && i < CPU_SETSIZE; i++) {
+    CPU_SET(i, &all_cpus);
+  }
+  return sched_setaffinity(tid, sizeof(all_cpus), &all_cpus) != 0 ? -1 : ret;
+#else
+  return -1;
+#endif
+}
+
 namespace util {
 
 std::string read_file(const std::string& fn) {
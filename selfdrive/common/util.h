@@ -32,6 +32,8 @@ void set_thread_name(const char* name);
 
 int set_realtime_priority(int level);
 int set_core_affinity(int core);
+// back to SCHED_OTHER on any core, for helper threads of realtime processes
+int set_default_scheduling();
 
 namespace util {
 
@@ -1,6 +1,7 @@
 #include "selfdrive/common/visionimg.h"
 
 #include <cassert>
+#include <cstring>
 
 #ifdef QCOM
 #include <gralloc_priv.h>
@@ -60,4 +61,81 @@ EGLImageTexture::EGLImageTexture(const VisionBuf *buf) {
 EGLImageTexture::~EGLImageTexture() {
   glDeleteTextures(1, &frame_tex);
 }
+
+const char YUVTexture::fragment_shader[] =
+  GLSL_VERSION
+  "precision mediump float;\n"
+  "in vec4 vTexCoord;\n"
+  "out vec4 colorOut;\n"
+  "uniform sampler2D uTextureY;\n"
+  "uniform sampler2D uTextureU;\n"
+  "uniform sampler2D uTextureV;\n"
+  "void main() {\n"
+  "  float y = 1.164 * (texture(uTextureY, vTexCoord.xy).r - 16.0 / 255.0);\n"
+  "  float u = texture(uTextureU, vTexCoord.xy).r - 128.0 / 255.0;\n"
+  "  float v = texture(uTextureV, vTexCoord.xy).r - 128.0 / 255.0;\n"
+  "  colorOut = vec4(y + 1.596 * v, y - 0.392 * u - 0.813 * v, y + 2.017 * u, 1.0);\n"
+  "}\n";
+
+YUVTexture::YUVTexture() {
+  glGenTextures(3, textures);
+  for (int i = 0; i < 3; i++) {
+    glBindTexture(GL_TEXTURE_2D, textures[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glGenBuffers(2, pbo);
+}
+
+YUVTexture::~YUVTexture() {
+  glDeleteTextures(3, textures);
+  glDeleteBuffers(2, pbo);
+}
+
+bool YUVTexture::upload(const VisionBuf *buf) {
+  const int plane_width[3] = {(int)buf->width, (int)buf->width / 2, (int)buf->width / 2};
+  const int plane_height[3] = {(int)buf->height, (int)buf->height / 2, (int)buf->height / 2};
+  const size_t plane_offset[3] = {0, size_t(buf->u - buf->y), size_t(buf->v - buf->y)};
+  const size_t frame_size = plane_offset[2] + plane_width[2] * plane_height[2];
+
+  glActiveTexture(GL_TEXTURE0);
+  if ((int)buf->width != width || (int)buf->height != height) {
+    // allocate once per stream, frames only replace the contents
+    for (int i = 0; i < 3; i++) {
+      glBindTexture(GL_TEXTURE_2D, textures[i]);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, plane_width[i], plane_height[i], 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    }
+    for (int i = 0; i < 2; i++) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+      glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_size, nullptr, GL_STREAM_DRAW);
+    }
+    width = buf->width;
+    height = buf->height;
+  }
+
+  // while the gpu may still be reading the last frame from one pixel buffer,
+  // this one is written into the other
+  pbo_idx = (pbo_idx + 1) % 2;
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[pbo_idx]);
+  void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frame_size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (dst) {
+    memcpy(dst, buf->y, frame_size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // the chroma planes aren't 4 byte aligned for every camera
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int i = 0; i < 3; i++) {
+      glBindTexture(GL_TEXTURE_2D, textures[i]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, plane_width[i], plane_height[i],
+                      GL_RED, GL_UNSIGNED_BYTE, (const void *)plane_offset[i]);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  }
+  // nanovg uploads its images from client memory
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return dst != nullptr;
+}
 #endif // ifdef QCOM
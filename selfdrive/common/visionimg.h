@@ -4,8 +4,11 @@
 
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
+// #version line of our shaders, for the GL these headers are from
+#define GLSL_VERSION "#version 150 core\n"
 #else
 #include <GLES3/gl3.h>
+#define GLSL_VERSION "#version 300 es\n"
 #endif
 
 #ifdef QCOM
@@ -25,3 +28,25 @@ class EGLImageTexture {
   EGLImageKHR img_khr = 0;
 #endif
 };
+
+#ifndef QCOM
+// The y, u and v planes of a yuv VisionBuf in R8 textures, allocated once per frame size.
+// Each frame is copied into one of two alternating pixel unpack buffers and the textures
+// are updated from there, so the transfer to the GPU doesn't block the caller.
+class YUVTexture {
+ public:
+  YUVTexture();
+  ~YUVTexture();
+  bool upload(const VisionBuf *buf);
+  GLuint textures[3] = {};
+
+  // converts the planes bound to uTextureY, uTextureU and uTextureV at vTexCoord to rgb,
+  // limited range BT.601, the inverse of camerad's rgb_to_yuv
+  static const char fragment_shader[];
+
+ private:
+  GLuint pbo[2] = {};
+  int pbo_idx = 0;
+  int width = 0, height = 0;
+};
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+// Makes the ACADO generated solvers reentrant. The generated code works on the globals
+// acadoVariables and acadoWorkspace; this header is force-included (-include) into the
+// generated sources and the wrapper, and turns them into a per-thread pointer to the
+// variables and workspace of the solver instance being run. Every instance has its own
+// problem data and warm start, and instances can be solved on different threads at once.
+//
+// acado_common.h is included first, so its declarations of the globals are left untouched
+// and never referenced.
+
+#include "acado_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern __thread ACADOvariables *acado_variables;
+extern __thread ACADOworkspace *acado_workspace;
+
+#ifdef __cplusplus
+}
+#endif
+
+#define acadoVariables (*acado_variables)
+#define acadoWorkspace (*acado_workspace)
@@ -0,0 +1,105 @@
+//
+// Compares cluster_points_centroid against the grid clustering on simulated radar
+// frames, and checks that both give the same clusters.
+//
+//   ./bench [tracks] [frames]
+//
+// Every frame has `tracks` radar points (default 64) on cars ahead, with several
+// points per car like Toyota and Hyundai radars report, plus some clutter. Cars and
+// their points keep their track ids from frame to frame.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+extern "C" {
+#include "fastcluster.h"
+#include "gridcluster.h"
+}
+
+struct Car {
+  double d, y, v;
+};
+
+int main(int argc, const char* argv[]) {
+  const int n = argc > 1 ? atoi(argv[1]) : 64;
+  const int frames = argc > 2 ? atoi(argv[2]) : 10000;
+  const int m = 3;
+
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> uniform(0., 1.);
+  std::normal_distribution<double> noise(0., 0.3);
+
+  // 1 to 4 points per car, every 8th track is clutter
+  std::vector<Car> cars;
+  std::vector<int> car_of(n);
+  for (int i = 0; i < n; i++) {
+    if (i % 8 == 7) {
+      car_of[i] = -1;
+    } else {
+      if (cars.empty() || uniform(gen) < 0.4) {
+        cars.push_back({5. + 150. * uniform(gen), -6. + 12. * uniform(gen), -10. + 15. * uniform(gen)});
+      }
+      car_of[i] = cars.size() - 1;
+    }
+  }
+
+  // generate all frames first, so the clusterings run back to back
+  std::vector<double> pts(frames * n * m);
+  for (int f = 0; f < frames; f++) {
+    for (auto& c : cars) {
+      c.d += c.v * 0.05;
+      if (c.d < 2. || c.d > 160.) c.d = 5. + 150. * uniform(gen);
+    }
+    // the key radard clusters on: dRel, yRel * 2, vRel
+    double* p = &pts[f * n * m];
+    for (int i = 0; i < n; i++) {
+      if (car_of[i] < 0) {
+        p[i * m + 0] = 200. * uniform(gen);
+        p[i * m + 1] = 2. * (-20. + 40. * uniform(gen));
+        p[i * m + 2] = -30. + 30. * uniform(gen);
+      } else {
+        const Car& c = cars[car_of[i]];
+        p[i * m + 0] = c.d + noise(gen);
+        p[i * m + 1] = 2. * (c.y + noise(gen));
+        p[i * m + 2] = c.v + noise(gen);
+      }
+    }
+  }
+
+  std::vector<uint64_t> track_ids(n);
+  std::vector<int> cluster_ids(n);
+  std::vector<int> labels_fc(frames * n), labels_grid(frames * n);
+  for (int i = 0; i < n; i++) track_ids[i] = i;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int f = 0; f < frames; f++) {
+    cluster_points_centroid(n, m, &pts[f * n * m], 2.5 * 2.5, &labels_fc[f * n]);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  GridCluster* gc = grid_cluster_init(m, 2.5);
+  int nclust = 0;
+  for (int f = 0; f < frames; f++) {
+    nclust += grid_cluster_update(gc, n, track_ids.data(), &pts[f * n * m], &labels_grid[f * n], cluster_ids.data(), NULL);
+  }
+  auto t2 = std::chrono::steady_clock::now();
+  grid_cluster_free(gc);
+
+  int mismatches = 0;
+  for (int f = 0; f < frames; f++) {
+    mismatches += !std::equal(&labels_fc[f * n], &labels_fc[(f + 1) * n], &labels_grid[f * n]);
+  }
+  double fc_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+  double grid_us = std::chrono::duration<double, std::micro>(t2 - t1).count();
+
+  printf("%d tracks, %d frames, %.1f clusters per frame\n", n, frames, (double)nclust / frames);
+  printf("cluster_points_centroid %8.2f us/frame\n", fc_us / frames);
+  printf("grid_cluster_update     %8.2f us/frame\n", grid_us / frames);
+  printf("frames with different clusters: %d\n", mismatches);
+  return mismatches != 0;
+}
@@ -0,0 +1,260 @@
+//
+// Centroid clustering on a grid, see gridcluster.h
+//
+// Like the generic centroid linkage, the closest pair of clusters is merged until
+// the closest pair is dist or further apart. Each cluster keeps its nearest neighbour
+// closer than dist, which only has to be looked up in the neighbouring grid cells.
+// After a merge only the merged cluster and the clusters that had one of the two as
+// nearest neighbour are looked up again. At radar sizes this is cheaper than keeping
+// a heap of candidate pairs.
+//
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+#include "gridcluster.h"
+}
+
+struct GridCluster {
+  int m;
+  double dist, dist2;
+  int next_id = 0;
+
+  // per point, a cluster is stored at the index of one of its points
+  std::vector<double> centroid;
+  std::vector<int> size;
+  std::vector<int> parent;
+  std::vector<int> nn;  // nearest neighbour closer than dist, or -1
+  std::vector<double> nn_d2;
+
+  // grid over the first dimension with cells at least dist wide, so clusters closer than
+  // dist are in the same or a neighbouring cell. The other dimensions are only checked by
+  // the distance. Merged centroids stay within the span of the points, so the cells are
+  // fixed for a call.
+  double x0, inv_width;
+  std::vector<int> cell_heads, cell_of, next_in_cell;
+
+  // previous call: (track id, label) sorted by track id, and the cluster id of each label
+  std::vector<std::pair<uint64_t, int>> prev_tracks, tracks;
+  std::vector<int> prev_label_id;
+  std::vector<int> root_label, label_root, label_start, members, order, label_id, votes, voted;
+  std::vector<char> taken;
+
+  double distance2(int i, int j) const {
+    double d2 = 0;
+    for (int k = 0; k < m; k++) {
+      double e = centroid[i * m + k] - centroid[j * m + k];
+      d2 += e * e;
+    }
+    return d2;
+  }
+
+  int cell(int i) const {
+    return (int)((centroid[i * m] - x0) * inv_width) + 1;
+  }
+
+  void grid_insert(int i) {
+    int c = cell(i);
+    cell_of[i] = c;
+    next_in_cell[i] = cell_heads[c];
+    cell_heads[c] = i;
+  }
+
+  void grid_remove(int i) {
+    int *p = &cell_heads[cell_of[i]];
+    while (*p != i) p = &next_in_cell[*p];
+    *p = next_in_cell[i];
+  }
+
+  // looks up the nearest neighbour of i, and makes i the nearest neighbour of
+  // the clusters it is closer to than their current one
+  void update_nn(int i) {
+    nn[i] = -1;
+    nn_d2[i] = dist2;
+    const int c = cell(i);
+    for (int nc = c - 1; nc <= c + 1; nc++) {
+      for (int j = cell_heads[nc]; j >= 0; j = next_in_cell[j]) {
+        if (j == i) continue;
+        double d2 = distance2(i, j);
+        if (d2 < nn_d2[i]) {
+          nn[i] = j;
+          nn_d2[i] = d2;
+        }
+        if (d2 < nn_d2[j]) {
+          nn[j] = i;
+          nn_d2[j] = d2;
+        }
+      }
+    }
+  }
+
+  int find(int i) {
+    while (parent[i] != i) i = parent[i] = parent[parent[i]];
+    return i;
+  }
+
+  void cluster(int n, const double* pts) {
+    centroid.assign(pts, pts + n * m);
+    size.assign(n, 1);
+    parent.resize(n);
+    for (int i = 0; i < n; i++) parent[i] = i;
+    nn.assign(n, -1);
+    nn_d2.assign(n, dist2);
+    cell_of.resize(n);
+    next_in_cell.resize(n);
+
+    // about one point per cell if they are spread out further than that,
+    // plus an empty cell on each side
+    double x1 = x0 = n > 0 ? pts[0] : 0.;
+    for (int i = 1; i < n; i++) {
+      x0 = std::min(x0, pts[i * m]);
+      x1 = std::max(x1, pts[i * m]);
+    }
+    inv_width = 1. / std::max(dist, (x1 - x0) / std::max(n, 1));
+    cell_heads.assign((int)((x1 - x0) * inv_width) + 3, -1);
+
+    // every pair is seen once, from the later point
+    for (int i = 0; i < n; i++) {
+      update_nn(i);
+      grid_insert(i);
+    }
+
+    // merged clusters have no neighbour, so they are never picked again
+    while (true) {
+      int i = -1;
+      double min_d2 = dist2;
+      for (int k = 0; k < n; k++) {
+        if (nn_d2[k] < min_d2) {
+          i = k;
+          min_d2 = nn_d2[k];
+        }
+      }
+      if (i < 0) break;
+
+      // merge j into i
+      int j = nn[i];
+      grid_remove(i);
+      grid_remove(j);
+      for (int k = 0; k < m; k++) {
+        centroid[i * m + k] = (size[i] * centroid[i * m + k] + size[j] * centroid[j * m + k]) / (size[i] + size[j]);
+      }
+      size[i] += size[j];
+      parent[j] = i;
+      nn[j] = -1;
+      nn_d2[j] = dist2;
+
+      // i moved, so the clusters that had i or j as nearest neighbour need a new one
+      grid_insert(i);
+      update_nn(i);
+      for (int k = 0; k < n; k++) {
+        if (k != i && (nn[k] == i || nn[k] == j)) update_nn(k);
+      }
+    }
+  }
+
+  int prev_label(uint64_t track_id) const {
+    auto it = std::lower_bound(prev_tracks.begin(), prev_tracks.end(), std::make_pair(track_id, INT_MIN));
+    return (it != prev_tracks.end() && it->first == track_id) ? it->second : -1;
+  }
+};
+
+extern "C" {
+
+  GridCluster* grid_cluster_init(int m, double dist) {
+    assert(m > 0);
+    GridCluster* gc = new GridCluster;
+    gc->m = m;
+    gc->dist = dist;
+    gc->dist2 = dist * dist;
+    return gc;
+  }
+
+  void grid_cluster_free(GridCluster* gc) {
+    delete gc;
+  }
+
+  int grid_cluster_update(GridCluster* gc, int n, const uint64_t* track_ids, const double* pts,
+                          int* labels, int* cluster_ids, double* centroids) {
+    gc->cluster(n, pts);
+
+    // labels in order of first appearance
+    gc->root_label.assign(n, -1);
+    gc->label_root.clear();
+    for (int i = 0; i < n; i++) {
+      int root = gc->find(i);
+      if (gc->root_label[root] < 0) {
+        gc->root_label[root] = gc->label_root.size();
+        gc->label_root.push_back(root);
+      }
+      labels[i] = gc->root_label[root];
+    }
+    const int nclust = gc->label_root.size();
+
+    if (centroids != NULL) {
+      for (int l = 0; l < nclust; l++) {
+        memcpy(&centroids[l * gc->m], &gc->centroid[gc->label_root[l] * gc->m], gc->m * sizeof(double));
+      }
+    }
+
+    // without ids there is nothing to carry over to the next call either
+    if (cluster_ids == NULL) {
+      gc->prev_tracks.clear();
+      gc->prev_label_id.clear();
+      return nclust;
+    }
+
+    // points grouped by label
+    gc->label_start.assign(nclust + 1, 0);
+    for (int i = 0; i < n; i++) gc->label_start[labels[i] + 1]++;
+    for (int l = 0; l < nclust; l++) gc->label_start[l + 1] += gc->label_start[l];
+    gc->members.resize(n);
+    gc->order.assign(gc->label_start.begin(), gc->label_start.end() - 1);
+    for (int i = 0; i < n; i++) gc->members[gc->order[labels[i]]++] = i;
+
+    // the biggest clusters get first pick of the previous ids, a cluster takes the id
+    // most of its tracks had that no bigger cluster took yet
+    for (int l = 0; l < nclust; l++) gc->order[l] = l;
+    std::stable_sort(gc->order.begin(), gc->order.end(), [&](int a, int b) {
+      return gc->size[gc->label_root[a]] > gc->size[gc->label_root[b]];
+    });
+
+    const int prev_nclust = gc->prev_label_id.size();
+    gc->taken.assign(prev_nclust, 0);
+    gc->votes.assign(prev_nclust, 0);
+    gc->label_id.resize(nclust);
+    for (int l : gc->order) {
+      int best = -1;
+      gc->voted.clear();
+      for (int k = gc->label_start[l]; k < gc->label_start[l + 1]; k++) {
+        int pl = gc->prev_label(track_ids[gc->members[k]]);
+        if (pl < 0 || gc->taken[pl]) continue;
+        if (gc->votes[pl]++ == 0) gc->voted.push_back(pl);
+        if (best < 0 || gc->votes[pl] > gc->votes[best] || (gc->votes[pl] == gc->votes[best] && pl < best)) best = pl;
+      }
+      for (int pl : gc->voted) gc->votes[pl] = 0;
+
+      if (best >= 0) {
+        gc->taken[best] = 1;
+        gc->label_id[l] = gc->prev_label_id[best];
+      } else {
+        gc->label_id[l] = gc->next_id++;
+      }
+    }
+
+    gc->tracks.clear();
+    for (int i = 0; i < n; i++) {
+      cluster_ids[i] = gc->label_id[labels[i]];
+      gc->tracks.push_back({track_ids[i], labels[i]});
+    }
+    std::sort(gc->tracks.begin(), gc->tracks.end());
+    std::swap(gc->tracks, gc->prev_tracks);
+    gc->prev_label_id = gc->label_id;
+    return nclust;
+  }
+
+}
@@ -0,0 +1,43 @@
+#ifndef gridcluster_H
+#define gridcluster_H
+
+#include <stdint.h>
+
+//
+// Centroid clustering of radar tracks on a grid keyed on the clustering distance.
+//
+// Gives the same partition as cluster_points_centroid(n, m, pts, dist*dist, labels)
+// (up to centroid inversions, which don't happen at radar scale), but only compares
+// clusters in neighbouring grid cells instead of building the full distance matrix.
+// Cluster ids are kept across calls: a cluster gets the id that most of its tracks
+// had in the previous call, or a new one.
+//
+typedef struct GridCluster GridCluster;
+
+//
+// Input arguments:
+//   m    = dimension of the points
+//   dist = clusters are merged while their centroids are closer than dist
+//
+GridCluster* grid_cluster_init(int m, double dist);
+void grid_cluster_free(GridCluster* gc);
+
+//
+// Input arguments:
+//   n         = number of points
+//   track_ids = allocated integer array of size n, the identity of each point across calls,
+//               only read when cluster_ids isn't NULL
+//   pts       = allocated n*m array of points
+// Output arguments:
+//   labels      = allocated integer array of size n, labels (0, ..., nclust-1) in order of first appearance,
+//                 as cluster_points_centroid assigns them
+//   cluster_ids = allocated integer array of size n, stable cluster id of each point, or NULL
+//                 to skip keeping the ids
+//   centroids   = allocated array of size n*m, centroid of each label, or NULL
+// Return code:
+//   number of clusters
+//
+int grid_cluster_update(GridCluster* gc, int n, const uint64_t* track_ids, const double* pts,
+                        int* labels, int* cluster_ids, double* centroids);
+
+#endif
@@ -0,0 +1,40 @@
+import os
+import numpy as np
+
+from cffi import FFI
+from common.ffi_wrapper import suffix
+
+cluster_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)))
+cluster_fn = os.path.join(cluster_dir, "libgridcluster"+suffix())
+
+ffi = FFI()
+ffi.cdef("""
+typedef struct GridCluster GridCluster;
+GridCluster* grid_cluster_init(int m, double dist);
+void grid_cluster_free(GridCluster* gc);
+int grid_cluster_update(GridCluster* gc, int n, const uint64_t* track_ids, const double* pts,
+                        int* labels, int* cluster_ids, double* centroids);
+""")
+
+gridcluster = ffi.dlopen(cluster_fn)
+
+
+class GridCluster:
+  """Centroid clustering like cluster_points_centroid, without the full distance matrix."""
+  def __init__(self, dist, m=3):
+    self.m = m
+    self.gc = ffi.gc(gridcluster.grid_cluster_init(m, dist), gridcluster.grid_cluster_free)
+
+  def update(self, track_ids, pts):
+    """Returns the labels like cluster_points_centroid."""
+    n = len(track_ids)
+    if n == 0:
+      return []
+    pts = np.ascontiguousarray(pts, dtype=np.float64)
+    assert pts.shape == (n, self.m)
+    pts_ptr = ffi.cast("double *", pts.ctypes.data)
+
+    # only the labels are used, so the track ids aren't needed
+    labels_ptr = ffi.new("int[]", n)
+    gridcluster.grid_cluster_update(self.gc, n, ffi.NULL, pts_ptr, labels_ptr, ffi.NULL, ffi.NULL)
+    return list(labels_ptr)
@@ -1,7 +1,11 @@
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 
 extern "C" {
 #include "fastcluster.h"
+#include "gridcluster.h"
 }
 
 
@@ -29,7 +33,42 @@ int main(int argc, const char* argv[]) {
     assert(idx[i] == correct_idx[i]);
   }
 
+  // the grid clustering gives the same labels
+  uint64_t * track_ids = new uint64_t[n];
+  int * cluster_ids = new int[n];
+  int * prev_cluster_ids = new int[n];
+  // radar track ids are 64 bit
+  for (int i = 0; i < n; i++) track_ids[i] = (1ULL << 40) + i;
+
+  GridCluster* gc = grid_cluster_init(m, 2.5);
+  assert(grid_cluster_update(gc, n, track_ids, pts, idx, prev_cluster_ids, NULL) == 7);
+  for (int i = 0; i < n; i++) {
+    assert(idx[i] == correct_idx[i]);
+  }
+
+  // the ids are optional, the labels stay the same without them
+  GridCluster* gc_no_ids = grid_cluster_init(m, 2.5);
+  assert(grid_cluster_update(gc_no_ids, n, NULL, pts, idx, NULL, NULL) == 7);
+  for (int i = 0; i < n; i++) {
+    assert(idx[i] == correct_idx[i]);
+  }
+  grid_cluster_free(gc_no_ids);
+
+  // and keeps the cluster ids when the points move a bit and come in a different order
+  for (int i = 0; i < n; i++) pts[i * m] += 0.5;
+  std::swap(track_ids[0], track_ids[n - 1]);
+  for (int k = 0; k < m; k++) std::swap(pts[k], pts[(n - 1) * m + k]);
+  grid_cluster_update(gc, n, track_ids, pts, idx, cluster_ids, NULL);
+  assert(cluster_ids[0] == prev_cluster_ids[n - 1] && cluster_ids[n - 1] == prev_cluster_ids[0]);
+  for (int i = 1; i < n - 1; i++) {
+    assert(cluster_ids[i] == prev_cluster_ids[i]);
+  }
+  grid_cluster_free(gc);
+
   delete[] idx;
   delete[] correct_idx;
   delete[] pts;
+  delete[] track_ids;
+  delete[] cluster_ids;
+  delete[] prev_cluster_ids;
 }
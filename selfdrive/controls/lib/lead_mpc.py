@@ -24,7 +24,7 @@ class LeadMpc():
 
     self.last_cloudlog_t = 0.0
     self.n_its = 0
-    self.duration = 0
+    self.solve_time = 0.0
     self.status = False
 
     self.v_solution = np.zeros(CONTROL_N)
@@ -40,8 +40,9 @@ class LeadMpc():
     self.dynamic_TR_mode = int(Params().get("DynamicTR", encoding="utf8"))
 
   def reset_mpc(self):
-    ffi, self.libmpc = libmpc_py.get_libmpc(self.lead_id)
-    self.libmpc.init(MPC_COST_LONG.TTC, MPC_COST_LONG.DISTANCE,
+    ffi, self.libmpc = libmpc_py.ffi, libmpc_py.libmpc
+    self.mpc = ffi.gc(self.libmpc.mpc_create(), self.libmpc.mpc_free)
+    self.libmpc.init(self.mpc, MPC_COST_LONG.TTC, MPC_COST_LONG.DISTANCE,
                      MPC_COST_LONG.ACCELERATION, MPC_COST_LONG.JERK)
 
     self.mpc_solution = ffi.new("log_t *")
@@ -50,13 +51,28 @@ class LeadMpc():
     self.cur_state[0].a_ego = 0
     self.a_lead_tau = _LEAD_ACCEL_TAU
 
+    self.run_args = ffi.new("run_mpc_args_t *")
+    self.run_args.mpc = self.mpc
+    self.run_args.x0 = self.cur_state
+    self.run_args.solution = self.mpc_solution
+
   def set_cur_state(self, v, a):
     v_safe = max(v, 1e-3)
     a_safe = a
     self.cur_state[0].v_ego = v_safe
     self.cur_state[0].a_ego = a_safe
 
+  def task(self):
+    return libmpc_py.ffi, self.libmpc.run_mpc_task, self.run_args
+
   def update(self, CS, radarstate, v_cruise):
+    self.prepare(CS, radarstate, v_cruise)
+    t = sec_since_boot()
+    self.libmpc.run_mpc_task(self.run_args)
+    self.finish(CS, sec_since_boot() - t)
+
+  def prepare(self, CS, radarstate, v_cruise):
+    """Sets up the problem, to be solved by running task()."""
     v_ego = CS.vEgo
     if self.lead_id == 0:
       lead = radarstate.leadOne
@@ -79,7 +95,7 @@ class LeadMpc():
       self.a_lead_tau = lead.aLeadTau
       self.new_lead = False
       if not self.prev_lead_status or abs(x_lead - self.prev_lead_x) > 2.5:
-        self.libmpc.init_with_simulation(v_ego, x_lead, v_lead, a_lead, self.a_lead_tau)
+        self.libmpc.init_with_simulation(self.mpc, v_ego, x_lead, v_lead, a_lead, self.a_lead_tau)
         self.new_lead = True
 
       self.prev_lead_status = True
@@ -107,14 +123,18 @@ class LeadMpc():
     elif self.dynamic_TR_mode == 4:
       TR = interp(float(cruise_gap), [1., 2., 3., 4.], [self.cruise_gap1, self.cruise_gap2, self.cruise_gap3, self.dynamic_TR])
 
+    self.run_args.l = self.a_lead_tau
+    self.run_args.a_l_0 = a_lead
+    self.run_args.TR = TR
 
-    # Calculate mpc
+  def finish(self, CS, solve_time):
+    """Reads the solution after task() ran."""
     t = sec_since_boot()
-    self.n_its = self.libmpc.run_mpc(self.cur_state, self.mpc_solution, self.a_lead_tau, a_lead, TR)
+    self.n_its = self.run_args.n_its
+    self.solve_time = solve_time
     self.v_solution = interp(T_IDXS[:CONTROL_N], MPC_T, self.mpc_solution.v_ego)
     self.a_solution = interp(T_IDXS[:CONTROL_N], MPC_T, self.mpc_solution.a_ego)
     self.j_solution = interp(T_IDXS[:CONTROL_N], MPC_T[:-1], self.mpc_solution.j_ego)
-    self.duration = int((sec_since_boot() - t) * 1e9)
 
     # Reset if NaN or goes through lead car
     crashing = any(lead - ego < -50 for (lead, ego) in zip(self.mpc_solution[0].x_l, self.mpc_solution[0].x_ego))
@@ -127,9 +147,9 @@ class LeadMpc():
         cloudlog.warning("Longitudinal mpc %d reset - backwards: %s crashing: %s nan: %s" % (
                           self.lead_id, backwards, crashing, nans))
 
-      self.libmpc.init(MPC_COST_LONG.TTC, MPC_COST_LONG.DISTANCE,
+      self.libmpc.init(self.mpc, MPC_COST_LONG.TTC, MPC_COST_LONG.DISTANCE,
                        MPC_COST_LONG.ACCELERATION, MPC_COST_LONG.JERK)
-      self.cur_state[0].v_ego = v_ego
+      self.cur_state[0].v_ego = CS.vEgo
       self.cur_state[0].a_ego = 0.0
       self.a_mpc = CS.aEgo
       self.prev_lead_status = False
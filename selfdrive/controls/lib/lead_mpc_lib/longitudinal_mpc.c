@@ -1,7 +1,8 @@
-#include "acado_common.h"
+#include "acado_instance.h"
 #include "acado_auxiliary_functions.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #define NX          ACADO_NX  /* Number of differential state variables.  */
@@ -14,8 +15,14 @@
 
 #define N           ACADO_N   /* Number of intervals in the horizon. */
 
-ACADOvariables acadoVariables;
-ACADOworkspace acadoWorkspace;
+__thread ACADOvariables *acado_variables;
+__thread ACADOworkspace *acado_workspace;
+
+// A solver instance, with its own problem data and previous solution to warm start from
+typedef struct {
+  ACADOvariables variables;
+  ACADOworkspace workspace;
+} mpc_t;
 
 typedef struct {
   double x_ego, v_ego, a_ego, x_l, v_l, a_l;
@@ -34,7 +41,29 @@ typedef struct {
   double cost;
 } log_t;
 
-void init(double ttcCost, double distanceCost, double accelerationCost, double jerkCost){
+typedef struct {
+  mpc_t *mpc;
+  state_t *x0;
+  log_t *solution;
+  double l, a_l_0, TR;
+  int n_its;
+} run_mpc_args_t;
+
+static void use_instance(mpc_t *mpc){
+  acado_variables = &mpc->variables;
+  acado_workspace = &mpc->workspace;
+}
+
+mpc_t *mpc_create(void){
+  return calloc(1, sizeof(mpc_t));
+}
+
+void mpc_free(mpc_t *mpc){
+  free(mpc);
+}
+
+void init(mpc_t *mpc, double ttcCost, double distanceCost, double accelerationCost, double jerkCost){
+  use_instance(mpc);
   acado_initializeSolver();
   int    i;
   const int STEP_MULTIPLIER = 3;
@@ -68,7 +97,8 @@ void init(double ttcCost, double distanceCost, double accelerationCost, double j
 
 }
 
-void init_with_simulation(double v_ego, double x_l_0, double v_l_0, double a_l_0, double l){
+void init_with_simulation(mpc_t *mpc, double v_ego, double x_l_0, double v_l_0, double a_l_0, double l){
+  use_instance(mpc);
   int i;
 
   double x_l = x_l_0;
@@ -112,7 +142,9 @@ void init_with_simulation(double v_ego, double x_l_0, double v_l_0, double a_l_0
   for (i = 0; i < NYN; ++i)  acadoVariables.yN[ i ] = 0.0;
 }
 
-int run_mpc(state_t * x0, log_t * solution, double l, double a_l_0, double TR){
+int run_mpc(mpc_t *mpc, state_t * x0, log_t * solution, double l, double a_l_0, double TR){
+  use_instance(mpc);
+
   // Calculate lead vehicle predictions
   int i;
   double t = 0.;
@@ -171,3 +203,9 @@ int run_mpc(state_t * x0, log_t * solution, double l, double a_l_0, double TR){
 
   return acado_getNWSR();
 }
+
+// run_mpc with its arguments packed in a struct, so it can be solved in an mpc_batch
+void run_mpc_task(void *p){
+  run_mpc_args_t *args = p;
+  args->n_its = run_mpc(args->mpc, args->x0, args->solution, args->l, args->a_l_0, args->TR);
+}
@@ -16,15 +16,22 @@ class LongitudinalMpc():
     self.status = True
     self.min_a = -1.2
     self.max_a = 1.2
+    self.solve_time = 0.0
 
 
   def reset_mpc(self):
     self.libmpc = libmpc_py.libmpc
-    self.libmpc.init(0.0, 1.0, 0.0, 50.0, 10000.0)
+    self.mpc = libmpc_py.ffi.gc(self.libmpc.mpc_create(), self.libmpc.mpc_free)
+    self.libmpc.init(self.mpc, 0.0, 1.0, 0.0, 50.0, 10000.0)
 
     self.mpc_solution = libmpc_py.ffi.new("log_t *")
     self.cur_state = libmpc_py.ffi.new("state_t *")
 
+    self.run_args = libmpc_py.ffi.new("run_mpc_args_t *")
+    self.run_args.mpc = self.mpc
+    self.run_args.x0 = self.cur_state
+    self.run_args.solution = self.mpc_solution
+
     self.cur_state[0].x_ego = 0
     self.cur_state[0].v_ego = 0
     self.cur_state[0].a_ego = 0
@@ -45,19 +52,40 @@ class LongitudinalMpc():
     self.cur_state[0].v_ego = v_safe
     self.cur_state[0].a_ego = a_safe
 
+  def task(self):
+    return libmpc_py.ffi, self.libmpc.run_mpc_task, self.run_args
+
   def update(self, carstate, radarstate, v_cruise):
+    self.prepare(carstate, radarstate, v_cruise)
+    self.run(carstate)
+
+  def update_with_xva(self, poss, speeds, accels):
+    self.prepare_with_xva(poss, speeds, accels)
+    self.run(None)
+
+  def run(self, carstate):
+    t = sec_since_boot()
+    self.libmpc.run_mpc_task(self.run_args)
+    self.finish(carstate, sec_since_boot() - t)
+
+  def prepare(self, carstate, radarstate, v_cruise):
+    """Sets up the problem, to be solved by running task()."""
     v_cruise_clipped = np.clip(v_cruise, self.cur_state[0].v_ego - 10., self.cur_state[0].v_ego + 10.0)
     poss = v_cruise_clipped * np.array(T_IDXS[:LON_MPC_N+1])
     speeds = v_cruise_clipped * np.ones(LON_MPC_N+1)
     accels = np.zeros(LON_MPC_N+1)
-    self.update_with_xva(poss, speeds, accels)
+    self.prepare_with_xva(poss, speeds, accels)
 
-  def update_with_xva(self, poss, speeds, accels):
-    # Calculate mpc
-    self.libmpc.run_mpc(self.cur_state, self.mpc_solution,
-                        list(poss), list(speeds), list(accels),
-                        self.min_a, self.max_a)
+  def prepare_with_xva(self, poss, speeds, accels):
+    self.run_args.target_x = list(poss)
+    self.run_args.target_v = list(speeds)
+    self.run_args.target_a = list(accels)
+    self.run_args.min_a = self.min_a
+    self.run_args.max_a = self.max_a
 
+  def finish(self, carstate, solve_time):
+    """Reads the solution after task() ran."""
+    self.solve_time = solve_time
     self.v_solution = list(self.mpc_solution.v_ego)
     self.a_solution = list(self.mpc_solution.a_ego)
     self.j_solution = list(self.mpc_solution.j_ego)
@@ -28,7 +28,7 @@ extern "C"
 #include "INCLUDE/EXTRAS/SolutionAnalysis.hpp"
 #endif /* ACADO_COMPUTE_COVARIANCE_MATRIX */
 
-static int acado_nWSR;
+static __thread int acado_nWSR;
 
 
 
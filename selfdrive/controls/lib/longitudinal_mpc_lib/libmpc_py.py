@@ -10,6 +10,8 @@ ffi = FFI()
 ffi.cdef("""
 const int MPC_N = 32;
 
+typedef struct mpc_t mpc_t;
+
 typedef struct {
 double x_ego, v_ego, a_ego;
 } state_t;
@@ -24,11 +26,25 @@ double j_ego[MPC_N];
 double cost;
 } log_t;
 
-
-void init(double xCost, double vCost, double aCost, double jerkCost, double constraintCost);
-int run_mpc(state_t * x0, log_t * solution,
+typedef struct {
+mpc_t *mpc;
+state_t *x0;
+log_t *solution;
+double target_x[MPC_N+1];
+double target_v[MPC_N+1];
+double target_a[MPC_N+1];
+double min_a, max_a;
+int n_its;
+} run_mpc_args_t;
+
+
+mpc_t *mpc_create(void);
+void mpc_free(mpc_t *mpc);
+void init(mpc_t *mpc, double xCost, double vCost, double aCost, double jerkCost, double constraintCost);
+int run_mpc(mpc_t *mpc, state_t * x0, log_t * solution,
             double target_x[MPC_N+1], double target_v[MPC_N+1], double target_a[MPC_N+1],
             double min_a, double max_a);
+void run_mpc_task(void *args);
 """)
 
 libmpc = ffi.dlopen(libmpc_fn)
@@ -1,8 +1,9 @@
-#include "acado_common.h"
+#include "acado_instance.h"
 #include "acado_auxiliary_functions.h"
 #include "common/modeldata.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 
 #define NX          ACADO_NX  /* Number of differential state variables.  */
@@ -15,8 +16,14 @@
 
 #define N           ACADO_N   /* Number of intervals in the horizon. */
 
-ACADOvariables acadoVariables;
-ACADOworkspace acadoWorkspace;
+__thread ACADOvariables *acado_variables;
+__thread ACADOworkspace *acado_workspace;
+
+// A solver instance, with its own problem data and previous solution to warm start from
+typedef struct {
+  ACADOvariables variables;
+  ACADOworkspace workspace;
+} mpc_t;
 
 typedef struct {
   double x_ego, v_ego, a_ego;
@@ -32,7 +39,32 @@ typedef struct {
   double cost;
 } log_t;
 
-void init(double xCost, double vCost, double aCost, double jerkCost, double constraintCost){
+typedef struct {
+  mpc_t *mpc;
+  state_t *x0;
+  log_t *solution;
+  double target_x[N+1];
+  double target_v[N+1];
+  double target_a[N+1];
+  double min_a, max_a;
+  int n_its;
+} run_mpc_args_t;
+
+static void use_instance(mpc_t *mpc){
+  acado_variables = &mpc->variables;
+  acado_workspace = &mpc->workspace;
+}
+
+mpc_t *mpc_create(void){
+  return calloc(1, sizeof(mpc_t));
+}
+
+void mpc_free(mpc_t *mpc){
+  free(mpc);
+}
+
+void init(mpc_t *mpc, double xCost, double vCost, double aCost, double jerkCost, double constraintCost){
+  use_instance(mpc);
   acado_initializeSolver();
   int    i;
   const int STEP_MULTIPLIER = 3;
@@ -65,9 +97,10 @@ void init(double xCost, double vCost, double aCost, double jerkCost, double cons
 }
 
 
-int run_mpc(state_t * x0, log_t * solution,
+int run_mpc(mpc_t *mpc, state_t * x0, log_t * solution,
             double target_x[N+1], double target_v[N+1], double target_a[N+1],
             double min_a, double max_a){
+  use_instance(mpc);
   int i;
   for (i = 0; i < N + 1; ++i){
     acadoVariables.od[i*NOD] = min_a;
@@ -106,3 +139,10 @@ int run_mpc(state_t * x0, log_t * solution,
   // we shift by 0.1 seconds.
   return acado_getNWSR();
 }
+
+// run_mpc with its arguments packed in a struct, so it can be solved in an mpc_batch
+void run_mpc_task(void *p){
+  run_mpc_args_t *args = p;
+  args->n_its = run_mpc(args->mpc, args->x0, args->solution, args->target_x, args->target_v, args->target_a,
+                        args->min_a, args->max_a);
+}
@@ -14,6 +14,7 @@ from selfdrive.controls.lib.fcw import FCWChecker
 from selfdrive.controls.lib.longcontrol import LongCtrlState
 from selfdrive.controls.lib.lead_mpc import LeadMpc
 from selfdrive.controls.lib.long_mpc import LongitudinalMpc
+from selfdrive.controls.lib.mpc_batch.mpc_batch_py import MpcBatch
 from selfdrive.controls.lib.drive_helpers import V_CRUISE_MAX, CONTROL_N
 from selfdrive.swaglog import cloudlog
 
@@ -23,6 +24,9 @@ A_CRUISE_MIN = -1.2
 A_CRUISE_MAX_VALS = [1.2, 1.2, 0.8, 0.6]
 A_CRUISE_MAX_BP = [0., 15., 25., 40.]
 
+# plannerd runs on a single core, more threads only help when it gets more cores
+MPC_SOLVER_THREADS = 1
+
 # Lookup table for turns
 _A_TOTAL_MAX_V = [1.7, 3.2]
 _A_TOTAL_MAX_BP = [20., 40.]
@@ -52,6 +56,7 @@ class Planner():
     self.mpcs['lead0'] = LeadMpc(0)
     self.mpcs['lead1'] = LeadMpc(1)
     self.mpcs['cruise'] = LongitudinalMpc()
+    self.mpc_batch = MpcBatch(MPC_SOLVER_THREADS)
 
     self.fcw = False
     self.fcw_checker = FCWChecker()
@@ -118,10 +123,15 @@ class Planner():
     accel_limits_turns[1] = max(accel_limits_turns[1], self.a_desired)
     self.mpcs['cruise'].set_accel_limits(accel_limits_turns[0], accel_limits_turns[1])
 
-    next_a = np.inf
     for key in self.mpcs:
       self.mpcs[key].set_cur_state(self.v_desired, self.a_desired)
-      self.mpcs[key].update(sm['carState'], sm['radarState'], v_cruise)
+      self.mpcs[key].prepare(sm['carState'], sm['radarState'], v_cruise)
+
+    solve_times = self.mpc_batch.run([mpc.task() for mpc in self.mpcs.values()])
+
+    next_a = np.inf
+    for key, solve_time in zip(self.mpcs, solve_times):
+      self.mpcs[key].finish(sm['carState'], solve_time)
       if self.mpcs[key].status and self.mpcs[key].a_solution[5] < next_a:  # picks slowest solution from accel in ~0.2 seconds
         self.longitudinalPlanSource = key
         self.v_desired_trajectory = self.mpcs[key].v_solution[:CONTROL_N]
@@ -180,6 +190,8 @@ class Planner():
     longitudinalPlan.hasLead = self.mpcs['lead0'].status
     longitudinalPlan.longitudinalPlanSource = self.longitudinalPlanSource
     longitudinalPlan.fcw = self.fcw
+    longitudinalPlan.solverExecutionTime = self.mpc_batch.solve_time
+    longitudinalPlan.solverExecutionTimes = [float(mpc.solve_time) for mpc in self.mpcs.values()]
 
     # opkr
     # Send radarstate(dRel, vRel, yRel)
@@ -0,0 +1,110 @@
+//
+// Batch MPC solving, see mpc_batch.h
+//
+// The worker threads are started once and wait for batches. The calling thread takes
+// tasks too, so a batch with a single thread never leaves the caller.
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "mpc_batch.h"
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct MpcBatch {
+  std::vector<std::thread> workers;
+
+  std::mutex lock;
+  std::condition_variable work_cv, done_cv;
+  uint64_t generation = 0;
+  bool exit = false;
+
+  // the current batch
+  mpc_task_t* tasks = nullptr;
+  int num_tasks = 0;
+  std::atomic<int> next_task = 0;
+  int running = 0;
+
+  void run_tasks() {
+    for (int i; (i = next_task++) < num_tasks;) {
+      auto start = std::chrono::steady_clock::now();
+      tasks[i].run(tasks[i].args);
+      tasks[i].solve_time = seconds_since(start);
+    }
+  }
+
+  void worker() {
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock lk(lock);
+        work_cv.wait(lk, [&] { return exit || generation != seen; });
+        if (exit) return;
+        seen = generation;
+      }
+
+      run_tasks();
+
+      std::unique_lock lk(lock);
+      if (--running == 0) done_cv.notify_one();
+    }
+  }
+};
+
+extern "C" {
+
+  MpcBatch* mpc_batch_init(int num_threads) {
+    MpcBatch* batch = new MpcBatch;
+    for (int i = 1; i < num_threads; i++) {
+      batch->workers.push_back(std::thread(&MpcBatch::worker, batch));
+    }
+    return batch;
+  }
+
+  void mpc_batch_free(MpcBatch* batch) {
+    {
+      std::unique_lock lk(batch->lock);
+      batch->exit = true;
+    }
+    batch->work_cv.notify_all();
+    for (auto& t : batch->workers) t.join();
+    delete batch;
+  }
+
+  double mpc_batch_run(MpcBatch* batch, mpc_task_t* tasks, int n) {
+    auto start = std::chrono::steady_clock::now();
+    batch->tasks = tasks;
+    batch->num_tasks = n;
+    batch->next_task = 0;
+
+    // a single task runs on the calling thread without waking the workers
+    const bool parallel = !batch->workers.empty() && n > 1;
+    if (parallel) {
+      {
+        std::unique_lock lk(batch->lock);
+        batch->running = batch->workers.size();
+        batch->generation++;
+      }
+      batch->work_cv.notify_all();
+    }
+
+    batch->run_tasks();
+
+    if (parallel) {
+      std::unique_lock lk(batch->lock);
+      batch->done_cv.wait(lk, [&] { return batch->running == 0; });
+    }
+    return seconds_since(start);
+  }
+
+}
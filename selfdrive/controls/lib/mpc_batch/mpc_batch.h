@@ -0,0 +1,32 @@
+#ifndef mpc_batch_H
+#define mpc_batch_H
+
+//
+// Solves several MPC problems in one call, optionally spread over threads.
+//
+// The solvers are only known by a task function and its arguments, e.g. run_mpc_task of
+// the lead and longitudinal MPC libraries with a run_mpc_args_t. Tasks running at the same
+// time must use different solver instances.
+//
+typedef struct {
+  void (*run)(void* args);
+  void* args;
+  double solve_time;  // output: seconds spent in run
+} mpc_task_t;
+
+typedef struct MpcBatch MpcBatch;
+
+//
+// Input arguments:
+//   num_threads = number of threads the tasks are spread over, including the calling thread.
+//                 With 1 the tasks run one after another on the calling thread.
+//
+MpcBatch* mpc_batch_init(int num_threads);
+void mpc_batch_free(MpcBatch* batch);
+
+//
+// Runs all n tasks and returns when they are done. Returns the wall time of the batch in seconds.
+//
+double mpc_batch_run(MpcBatch* batch, mpc_task_t* tasks, int n);
+
+#endif
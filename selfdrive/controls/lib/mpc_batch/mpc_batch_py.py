@@ -0,0 +1,44 @@
+import os
+
+from cffi import FFI
+from common.ffi_wrapper import suffix
+
+batch_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)))
+batch_fn = os.path.join(batch_dir, "libmpc_batch"+suffix())
+
+ffi = FFI()
+ffi.cdef("""
+typedef struct {
+  void (*run)(void* args);
+  void* args;
+  double solve_time;
+} mpc_task_t;
+
+typedef struct MpcBatch MpcBatch;
+MpcBatch* mpc_batch_init(int num_threads);
+void mpc_batch_free(MpcBatch* batch);
+double mpc_batch_run(MpcBatch* batch, mpc_task_t* tasks, int n);
+""")
+
+mpc_batch = ffi.dlopen(batch_fn)
+
+
+def _address(src_ffi, cdata):
+  return int(src_ffi.cast("uintptr_t", cdata))
+
+
+class MpcBatch:
+  """Solves the problems of several mpc libraries in one native call."""
+  def __init__(self, num_threads=1):
+    self.batch = ffi.gc(mpc_batch.mpc_batch_init(num_threads), mpc_batch.mpc_batch_free)
+    self.solve_time = 0.0
+
+  def run(self, tasks):
+    """Runs a list of (ffi, run function, args) tasks, each from the ffi of its own library.
+    Returns the solve time of each task in seconds."""
+    c_tasks = ffi.new("mpc_task_t[]", len(tasks))
+    for i, (src_ffi, run, args) in enumerate(tasks):
+      c_tasks[i].run = ffi.cast("void (*)(void *)", _address(src_ffi, run))
+      c_tasks[i].args = ffi.cast("void *", _address(src_ffi, args))
+    self.solve_time = mpc_batch.mpc_batch_run(self.batch, c_tasks, len(tasks))
+    return [c_tasks[i].solve_time for i in range(len(tasks))]
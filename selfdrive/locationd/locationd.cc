@@ -1,6 +1,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include <algorithm>
 #include <cmath>
 
 #include "locationd.h"
@@ -52,9 +53,10 @@ static VectorXd rotate_std(const MatrixXdr& rot_matrix, const VectorXd& std_in)
   return rotate_cov(rot_matrix, std_in.array().square().matrix().asDiagonal()).diagonal().array().sqrt();
 }
 
-Localizer::Localizer() {
-  this->kf = std::make_unique<LiveKalman>();
+Localizer::Localizer(const LiveKalmanNoise &noise) {
+  this->kf = std::make_unique<LiveKalman>(noise);
   this->reset_kalman();
+  this->reset_count = 0;
 
   this->calib = Vector3d(0.0, 0.0, 0.0);
   this->device_from_calib = MatrixXdr::Identity(3, 3);
@@ -392,6 +394,7 @@ void Localizer::reset_kalman(double current_time, VectorXd init_orient, VectorXd
   this->kf->init_state(init_x, init_P, current_time);
   this->last_reset_time = current_time;
   this->reset_tracker += 1.0;
+  this->reset_count++;
 }
 
 void Localizer::handle_msg_bytes(const char *data, const size_t size) {
@@ -442,47 +445,59 @@ bool Localizer::isGpsOK() {
 int Localizer::locationd_thread() {
   const std::initializer_list<const char *> service_list =
       { "gpsLocationExternal", "sensorEvents", "cameraOdometry", "liveCalibration", "carState" };
-  PubMaster pm({ "liveLocationKalman" });
-  SubMaster sm(service_list, nullptr, { "gpsLocationExternal" });
+  PubMaster pm({ "liveLocationKalman", "locationdLoopStats" });
+  // feed the filter in logMonoTime order so it doesn't have to rewind for messages that
+  // were sent before, but received after, a newer one from another service
+  OrderedSubMaster sm(service_list, REORDER_WINDOW_NS, nullptr, { "gpsLocationExternal" });
 
   Params params;
+  uint64_t cam_odo_count = 0;
+
+  // paced by sensorEvents
+  RateKeeper rk("locationd", 100);
 
   while (!do_exit) {
-    sm.update();
-    for (const char* service : service_list) {
-      if (sm.updated(service) && sm.valid(service)) {
-        const cereal::Event::Reader log = sm[service];
+    const auto &msgs = sm.update();
+    // batches without sensorEvents aren't iterations of the paced loop
+    const bool paced = std::any_of(msgs.begin(), msgs.end(), [](const auto &m) { return m.first == "sensorEvents"; });
+    if (paced) {
+      rk.wakeup();
+    }
+    for (auto &[service, log] : msgs) {
+      if (log.getValid()) {
         this->handle_msg(log);
       }
-    }
 
-    if (sm.updated("cameraOdometry")) {
-      uint64_t logMonoTime = sm["cameraOdometry"].getLogMonoTime();
-      bool inputsOK = sm.allAliveAndValid();
-      bool sensorsOK = sm.alive("sensorEvents") && sm.valid("sensorEvents");
-      bool gpsOK = this->isGpsOK();
+      if (service == "cameraOdometry") {
+        uint64_t logMonoTime = log.getLogMonoTime();
+        bool inputsOK = sm.allAliveAndValid();
+        bool sensorsOK = sm.alive("sensorEvents") && sm.valid("sensorEvents");
+        bool gpsOK = this->isGpsOK();
+
+        MessageBuilder msg_builder;
+        kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, logMonoTime, inputsOK, sensorsOK, gpsOK);
+        pm.send("liveLocationKalman", bytes.begin(), bytes.size());
+
+        if (++cam_odo_count % 1200 == 0 && gpsOK) {  // once a minute
+          VectorXd posGeo = this->get_position_geodetic();
+          std::string lastGPSPosJSON = util::string_format(
+            "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
+
+          std::thread([&params] (const std::string gpsjson) {
+            params.put("LastGPSPosition", gpsjson);
+          }, lastGPSPosJSON).detach();
+        }
+      }
+    }
 
+    if (rk.statsReady()) {
       MessageBuilder msg_builder;
-      kj::ArrayPtr<capnp::byte> bytes = this->get_message_bytes(msg_builder, logMonoTime, inputsOK, sensorsOK, gpsOK);
-      pm.send("liveLocationKalman", bytes.begin(), bytes.size());
-
-      if (sm.frame % 1200 == 0 && gpsOK) {  // once a minute
-        VectorXd posGeo = this->get_position_geodetic();
-        std::string lastGPSPosJSON = util::string_format(
-          "{\"latitude\": %.15f, \"longitude\": %.15f, \"altitude\": %.15f}", posGeo(0), posGeo(1), posGeo(2));
-
-        std::thread([&params] (const std::string gpsjson) {
-          params.put("LastGPSPosition", gpsjson);
-        }, lastGPSPosJSON).detach();
-      }
+      rk.fillStats(msg_builder.initEvent().initLocationdLoopStats());
+      pm.send("locationdLoopStats", msg_builder);
+    }
+    if (paced) {
+      rk.monitorTime();
     }
   }
   return 0;
 }
-
-int main() {
-  set_realtime_priority(5);
-
-  Localizer localizer;
-  return localizer.locationd_thread();
-}
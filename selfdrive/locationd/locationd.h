@@ -9,6 +9,7 @@
 #include "common/transformations/coordinates.hpp"
 #include "common/transformations/orientation.hpp"
 #include "selfdrive/common/params.h"
+#include "selfdrive/common/ratekeeper.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
@@ -19,10 +20,11 @@
 #include "selfdrive/locationd/models/live_kf.h"
 
 #define POSENET_STD_HIST_HALF 20
+#define REORDER_WINDOW_NS 10000000ULL
 
 class Localizer {
 public:
-  Localizer();
+  Localizer(const LiveKalmanNoise &noise = {});
 
   int locationd_thread();
 
@@ -38,6 +40,8 @@ public:
   void build_live_location(cereal::LiveLocationKalman::Builder& fix);
 
   Eigen::VectorXd get_position_geodetic();
+  LiveKalman &get_kf() { return *this->kf; }
+  uint64_t get_reset_count() { return this->reset_count; }
 
   void handle_msg_bytes(const char *data, const size_t size);
   void handle_msg(const cereal::Event::Reader& log);
@@ -64,5 +68,6 @@ private:
   int64_t unix_timestamp_millis = 0;
   double last_gps_fix = 0;
   double reset_tracker = 0.0;
+  uint64_t reset_count = 0;
   bool device_fell = false;
 };
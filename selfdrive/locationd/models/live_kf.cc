@@ -27,19 +27,21 @@ std::vector<Eigen::Map<MatrixXdr>> get_vec_mapmat(std::vector<MatrixXdr>& mat_ve
   return res;
 }
 
-LiveKalman::LiveKalman() {
-  this->dim_state = 23;
-  this->dim_state_err = 22;
+LiveKalman::LiveKalman(const LiveKalmanNoise &noise) {
+  this->dim_state = LIVE_DIM_STATE;
+  this->dim_state_err = LIVE_DIM_STATE_ERR;
 
   this->initial_x = live_initial_x;
   this->initial_P = live_initial_P_diag.asDiagonal();
-  this->Q = live_Q_diag.asDiagonal();
+  this->Q = (live_Q_diag * noise.process).asDiagonal();
+  this->obs_noise_scale = noise.observation;
+  this->collect_innovation_stats = noise.innovation_stats;
   for (auto& pair : live_obs_noise_diag) {
     this->obs_noise[pair.first] = pair.second.asDiagonal();
   }
 
   // init filter
-  this->filter = std::make_shared<EKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
+  this->filter = std::make_shared<LiveEKFSym>(this->name, get_mapmat(this->Q), get_mapvec(this->initial_x),
     get_mapmat(initial_P),  this->dim_state, this->dim_state_err, 0, 0, 0, std::vector<int>(),
     std::vector<int>{3}, std::vector<std::string>(), 0.2);
 }
@@ -78,8 +80,8 @@ std::vector<MatrixXdr> LiveKalman::get_R(int kind, int n) {
   return R;
 }
 
-std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, std::vector<VectorXd> meas, std::vector<MatrixXdr> R) {
-  std::optional<Estimate> r;
+std::optional<LiveEstimate> LiveKalman::predict_and_observe(double t, int kind, std::vector<VectorXd> meas, std::vector<MatrixXdr> R) {
+  std::optional<LiveEstimate> r;
   switch (kind) {
   case OBSERVATION_CAMERA_ODO_TRANSLATION:
     r = this->predict_and_update_odo_trans(meas, t, kind);
@@ -94,19 +96,19 @@ std::optional<Estimate> LiveKalman::predict_and_observe(double t, int kind, std:
     if (R.size() == 0) {
       R = this->get_R(kind, meas.size());
     }
-    r = this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(meas), get_vec_mapmat(R));
+    r = this->update(t, kind, meas, R);
     break;
   }
   return r;
 }
 
-std::optional<Estimate> LiveKalman::predict_and_update_odo_speed(std::vector<VectorXd> speed, double t, int kind) {
+std::optional<LiveEstimate> LiveKalman::predict_and_update_odo_speed(std::vector<VectorXd> speed, double t, int kind) {
   std::vector<MatrixXdr> R;
   R.assign(speed.size(), (MatrixXdr(1, 1) << std::pow(0.2, 2)).finished().asDiagonal());
-  return this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(speed), get_vec_mapmat(R));
+  return this->update(t, kind, speed, R);
 }
 
-std::optional<Estimate> LiveKalman::predict_and_update_odo_trans(std::vector<VectorXd> trans, double t, int kind) {
+std::optional<LiveEstimate> LiveKalman::predict_and_update_odo_trans(std::vector<VectorXd> trans, double t, int kind) {
   std::vector<VectorXd> z;
   std::vector<MatrixXdr> R;
   for (VectorXd& trns : trans) {
@@ -114,10 +116,10 @@ std::optional<Estimate> LiveKalman::predict_and_update_odo_trans(std::vector<Vec
     z.push_back(trns.head(3));
     R.push_back(trns.segment<3>(3).array().square().matrix().asDiagonal());
   }
-  return this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(z), get_vec_mapmat(R));
+  return this->update(t, kind, z, R);
 }
 
-std::optional<Estimate> LiveKalman::predict_and_update_odo_rot(std::vector<VectorXd> rot, double t, int kind) {
+std::optional<LiveEstimate> LiveKalman::predict_and_update_odo_rot(std::vector<VectorXd> rot, double t, int kind) {
   std::vector<VectorXd> z;
   std::vector<MatrixXdr> R;
   for (VectorXd& rt : rot) {
@@ -125,7 +127,39 @@ std::optional<Estimate> LiveKalman::predict_and_update_odo_rot(std::vector<Vecto
     z.push_back(rt.head(3));
     R.push_back(rt.segment<3>(3).array().square().matrix().asDiagonal());
   }
-  return this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(z), get_vec_mapmat(R));
+  return this->update(t, kind, z, R);
+}
+
+std::optional<LiveEstimate> LiveKalman::update(double t, int kind, std::vector<VectorXd> &z, std::vector<MatrixXdr> &R) {
+  auto scale = this->obs_noise_scale.find(kind);
+  if (scale != this->obs_noise_scale.end()) {
+    for (MatrixXdr &r : R) {
+      r *= scale->second;
+    }
+  }
+
+  std::optional<LiveEstimate> res = this->filter->predict_and_update_batch(t, kind, get_vec_mapvec(z), get_vec_mapmat(R));
+  if (res && this->collect_innovation_stats) {
+    InnovationStats &stats = this->innovation_stats[kind];
+    for (auto &y : res->y) {
+      if (stats.count == 0) {
+        stats.sum = VectorXd::Zero(y.size());
+        stats.sum_sq = VectorXd::Zero(y.size());
+      }
+      stats.count++;
+      stats.sum += y;
+      stats.sum_sq += y.cwiseAbs2();
+    }
+  }
+  return res;
+}
+
+uint64_t LiveKalman::get_rewind_count() {
+  return this->filter->get_rewind_count();
+}
+
+uint64_t LiveKalman::get_dropped_count() {
+  return this->filter->get_dropped_count();
 }
 
 Eigen::VectorXd LiveKalman::get_initial_x() {
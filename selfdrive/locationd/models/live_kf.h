@@ -2,7 +2,9 @@
 
 #include <string>
 #include <cmath>
+#include <map>
 #include <memory>
+#include <unordered_map>
 
 #include <eigen3/Eigen/Core>
 #include <eigen3/Eigen/Dense>
@@ -14,14 +16,32 @@
 
 using namespace EKFS;
 
+// the live filter's layout is known at compile time, so it runs on fixed size matrices
+typedef EKFSymT<LIVE_DIM_STATE, LIVE_DIM_STATE_ERR, LIVE_MAX_DIM_OBS> LiveEKFSym;
+typedef LiveEKFSym::Estimate LiveEstimate;
+
 Eigen::Map<Eigen::VectorXd> get_mapvec(Eigen::VectorXd& vec);
 Eigen::Map<MatrixXdr> get_mapmat(MatrixXdr& mat);
 std::vector<Eigen::Map<Eigen::VectorXd>> get_vec_mapvec(std::vector<Eigen::VectorXd>& vec_vec);
 std::vector<Eigen::Map<MatrixXdr>> get_vec_mapmat(std::vector<MatrixXdr>& mat_vec);
 
+// multipliers on the tuned process and observation noise, for offline parameter sweeps
+struct LiveKalmanNoise {
+  double process = 1.0;
+  std::unordered_map<int, double> observation;  // by observation kind
+  // accumulate the innovations per kind, see get_innovation_stats(). off on device
+  bool innovation_stats = false;
+};
+
+struct InnovationStats {
+  uint64_t count = 0;
+  Eigen::VectorXd sum;
+  Eigen::VectorXd sum_sq;
+};
+
 class LiveKalman {
 public:
-  LiveKalman();
+  LiveKalman(const LiveKalmanNoise &noise = {});
 
   void init_state(Eigen::VectorXd& state, Eigen::VectorXd& covs_diag, double filter_time);
   void init_state(Eigen::VectorXd& state, MatrixXdr& covs, double filter_time);
@@ -32,20 +52,26 @@ public:
   double get_filter_time();
   std::vector<MatrixXdr> get_R(int kind, int n);
 
-  std::optional<Estimate> predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
-  std::optional<Estimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
-  std::optional<Estimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
-  std::optional<Estimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
+  std::optional<LiveEstimate> predict_and_observe(double t, int kind, std::vector<Eigen::VectorXd> meas, std::vector<MatrixXdr> R = {});
+  std::optional<LiveEstimate> predict_and_update_odo_speed(std::vector<Eigen::VectorXd> speed, double t, int kind);
+  std::optional<LiveEstimate> predict_and_update_odo_trans(std::vector<Eigen::VectorXd> trans, double t, int kind);
+  std::optional<LiveEstimate> predict_and_update_odo_rot(std::vector<Eigen::VectorXd> rot, double t, int kind);
 
   Eigen::VectorXd get_initial_x();
   MatrixXdr get_initial_P();
 
   MatrixXdr H(Eigen::VectorXd in);
 
+  uint64_t get_rewind_count();
+  uint64_t get_dropped_count();
+  const std::map<int, InnovationStats> &get_innovation_stats() { return this->innovation_stats; }
+
 private:
+  std::optional<LiveEstimate> update(double t, int kind, std::vector<Eigen::VectorXd> &z, std::vector<MatrixXdr> &R);
+
   std::string name = "live";
 
-  std::shared_ptr<EKFSym> filter;
+  std::shared_ptr<LiveEKFSym> filter;
 
   int dim_state;
   int dim_state_err;
@@ -54,4 +80,7 @@ private:
   MatrixXdr initial_P;
   MatrixXdr Q;  // process noise
   std::unordered_map<int, MatrixXdr> obs_noise;
+  std::unordered_map<int, double> obs_noise_scale;
+  bool collect_innovation_stats;
+  std::map<int, InnovationStats> innovation_stats;
 };
@@ -218,6 +218,9 @@ class LiveKalman():
     live_kf_header = "#pragma once\n\n"
     live_kf_header += "#include <unordered_map>\n"
     live_kf_header += "#include <eigen3/Eigen/Dense>\n\n"
+    live_kf_header += f"#define LIVE_DIM_STATE {dim_state}\n"
+    live_kf_header += f"#define LIVE_DIM_STATE_ERR {dim_state_err}\n"
+    live_kf_header += f"#define LIVE_MAX_DIM_OBS {max(h.shape[0] for h, _, _ in obs_eqs)}\n\n"
     for state, slc in inspect.getmembers(States, lambda x: type(x) == slice):
       assert(slc.step is None)  # unsupported
       live_kf_header += f'#define STATE_{state}_START {slc.start}\n'
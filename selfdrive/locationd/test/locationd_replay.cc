@@ -0,0 +1,276 @@
+// Runs locationd's filter over logged routes, several routes in parallel, to tune the
+// LiveKalman noise parameters without process replay.
+//
+//   ./locationd_replay [-j threads] [-o outdir] [-q scale] [-r kind=scale]... [-f routes.txt] [route]...
+//
+//   -j  number of routes to run at once (default: number of cores)
+//   -o  write the liveLocationKalman messages of every route to <outdir>/<route name>.llk
+//   -q  multiply the process noise by scale
+//   -r  multiply the noise of an observation kind (see locationd/models/constants.py) by scale
+//   -f  read routes from a file, one per line
+//
+// A route is given as the path prefix of its segments, e.g. /data/media/0/realdata/2021-06-01--12-00-00
+// for the segments 2021-06-01--12-00-00--0/rlog.bz2, 2021-06-01--12-00-00--1/rlog.bz2, ...
+
+#include <bzlib.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+#include "selfdrive/locationd/locationd.h"
+
+struct RouteResult {
+  std::string route;
+  int segments = 0;
+  uint64_t events = 0, outputs = 0;
+  uint64_t rewinds = 0, dropped = 0, resets = 0;
+  std::map<int, InnovationStats> innovations;
+  double seconds = 0;
+};
+
+static bool decompress_bz2(const std::string &in, std::string &out) {
+  bz_stream bzs = {};
+  if (in.empty() || BZ2_bzDecompressInit(&bzs, 0, 0) != BZ_OK) return false;
+
+  out.resize(std::max<size_t>(in.size() * 5, 1 << 20));
+  bzs.next_in = (char *)in.data();
+  bzs.avail_in = in.size();
+  size_t out_len = 0;
+  int ret = BZ_OK;
+  while (ret == BZ_OK) {
+    if (out_len == out.size()) out.resize(out.size() * 2);
+    bzs.next_out = &out[out_len];
+    bzs.avail_out = out.size() - out_len;
+    ret = BZ2_bzDecompress(&bzs);
+    out_len = out.size() - bzs.avail_out;
+
+    // loggerd writes a single stream, but concatenated files are valid bz2 too
+    if (ret == BZ_STREAM_END && bzs.avail_in > 0) {
+      BZ2_bzDecompressEnd(&bzs);
+      char *next_in = bzs.next_in;
+      unsigned int avail_in = bzs.avail_in;
+      bzs = {};
+      if (BZ2_bzDecompressInit(&bzs, 0, 0) != BZ_OK) return false;
+      bzs.next_in = next_in;
+      bzs.avail_in = avail_in;
+      ret = BZ_OK;
+    } else if (ret == BZ_OK && bzs.avail_in == 0 && bzs.avail_out > 0) {
+      break;  // truncated, keep what we got
+    }
+  }
+  BZ2_bzDecompressEnd(&bzs);
+  out.resize(out_len);
+  return ret == BZ_STREAM_END;
+}
+
+static bool is_locationd_input(const cereal::Event::Reader &event) {
+  switch (event.which()) {
+    case cereal::Event::SENSOR_EVENTS:
+    case cereal::Event::GPS_LOCATION_EXTERNAL:
+    case cereal::Event::CAMERA_ODOMETRY:
+    case cereal::Event::LIVE_CALIBRATION:
+    case cereal::Event::CAR_STATE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static std::string segment_log_path(const std::string &route, int segment) {
+  for (const char *name : {"rlog.bz2", "rlog"}) {
+    std::string path = util::string_format("%s--%d/%s", route.c_str(), segment, name);
+    if (util::file_exists(path)) return path;
+  }
+  return "";
+}
+
+static RouteResult replay_route(const std::string &route, const LiveKalmanNoise &noise, const std::string &outdir) {
+  RouteResult res = {.route = route};
+  double start = millis_since_boot();
+
+  Localizer localizer(noise);
+  FILE *out = nullptr;
+  if (!outdir.empty()) {
+    std::string name = route.substr(route.find_last_of('/') + 1);
+    out = fopen((outdir + "/" + name + ".llk").c_str(), "wb");
+    if (out == nullptr) fprintf(stderr, "%s: failed to open output\n", route.c_str());
+  }
+
+  capnp::ReaderOptions options;
+  options.traversalLimitInWords = kj::maxValue;
+
+  for (int segment = 0;; segment++) {
+    std::string path = segment_log_path(route, segment);
+    if (path.empty()) break;
+
+    std::string raw = util::read_file(path), log;
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".bz2") == 0) {
+      if (!decompress_bz2(raw, log)) fprintf(stderr, "%s: decompression error, using what was read\n", path.c_str());
+    } else {
+      log = std::move(raw);
+    }
+    res.segments++;
+
+    kj::Array<capnp::word> words = kj::heapArray<capnp::word>(log.size() / sizeof(capnp::word));
+    memcpy(words.begin(), log.data(), words.size() * sizeof(capnp::word));
+
+    // feed the inputs in logMonoTime order, the way locationd's OrderedSubMaster releases them
+    std::vector<std::pair<uint64_t, kj::ArrayPtr<const capnp::word>>> events;
+    kj::ArrayPtr<const capnp::word> remaining = words.asPtr();
+    try {
+      while (remaining.size() > 0) {
+        capnp::FlatArrayMessageReader reader(remaining, options);
+        cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+        kj::ArrayPtr<const capnp::word> msg(remaining.begin(), reader.getEnd());
+        if (is_locationd_input(event)) events.push_back({event.getLogMonoTime(), msg});
+        remaining = kj::arrayPtr(reader.getEnd(), remaining.end());
+      }
+    } catch (const kj::Exception &) {
+      fprintf(stderr, "%s: corrupt after %zu events\n", path.c_str(), events.size());
+    }
+    std::stable_sort(events.begin(), events.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+    for (auto &[log_mono_time, msg] : events) {
+      capnp::FlatArrayMessageReader reader(msg, options);
+      cereal::Event::Reader event = reader.getRoot<cereal::Event>();
+      if (event.getValid()) {
+        localizer.handle_msg(event);
+      }
+      res.events++;
+
+      if (event.isCameraOdometry()) {
+        // liveness isn't meaningful offline, the inputs are whatever was logged
+        MessageBuilder msg_builder;
+        kj::ArrayPtr<capnp::byte> bytes = localizer.get_message_bytes(msg_builder, log_mono_time, true, true, localizer.isGpsOK());
+        if (out != nullptr) fwrite(bytes.begin(), 1, bytes.size(), out);
+        res.outputs++;
+      }
+    }
+  }
+
+  if (out != nullptr) fclose(out);
+  res.rewinds = localizer.get_kf().get_rewind_count();
+  res.dropped = localizer.get_kf().get_dropped_count();
+  res.resets = localizer.get_reset_count();
+  res.innovations = localizer.get_kf().get_innovation_stats();
+  res.seconds = (millis_since_boot() - start) / 1000.;
+  return res;
+}
+
+static void merge_innovations(std::map<int, InnovationStats> &total, const std::map<int, InnovationStats> &stats) {
+  for (auto &[kind, s] : stats) {
+    InnovationStats &t = total[kind];
+    if (t.count == 0) {
+      t = s;
+    } else {
+      t.count += s.count;
+      t.sum += s.sum;
+      t.sum_sq += s.sum_sq;
+    }
+  }
+}
+
+static void print_innovations(const std::map<int, InnovationStats> &stats) {
+  for (auto &[kind, s] : stats) {
+    if (s.count == 0) continue;
+    printf("  kind %2d  n %8" PRIu64 "  mean", kind, s.count);
+    for (int i = 0; i < s.sum.size(); i++) printf(" %9.4f", s.sum[i] / s.count);
+    printf("  rms");
+    for (int i = 0; i < s.sum_sq.size(); i++) printf(" %9.4f", std::sqrt(s.sum_sq[i] / s.count));
+    printf("\n");
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-j threads] [-o outdir] [-q scale] [-r kind=scale]... [-f routes.txt] [route]...\n", name);
+}
+
+int main(int argc, char **argv) {
+  int num_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string outdir;
+  LiveKalmanNoise noise;
+  noise.innovation_stats = true;
+  std::vector<std::string> routes;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "j:o:q:r:f:")) != -1) {
+    switch (opt) {
+      case 'j': num_threads = std::max(1, atoi(optarg)); break;
+      case 'o': outdir = optarg; break;
+      case 'q': noise.process = atof(optarg); break;
+      case 'r': {
+        int kind;
+        double scale;
+        if (sscanf(optarg, "%d=%lf", &kind, &scale) != 2) {
+          usage(argv[0]);
+          return 1;
+        }
+        noise.observation[kind] = scale;
+        break;
+      }
+      case 'f': {
+        std::ifstream f(optarg);
+        for (std::string line; std::getline(f, line);) {
+          if (!line.empty() && line[0] != '#') routes.push_back(line);
+        }
+        break;
+      }
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  for (int i = optind; i < argc; i++) routes.push_back(argv[i]);
+  if (routes.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // routes are independent, each worker takes the next one until none are left
+  std::vector<RouteResult> results(routes.size());
+  std::atomic<size_t> next_route = 0;
+  std::vector<std::thread> workers;
+  double start = millis_since_boot();
+  for (int i = 0; i < std::min<int>(num_threads, routes.size()); i++) {
+    workers.push_back(std::thread([&]() {
+      for (size_t r; (r = next_route++) < routes.size();) {
+        results[r] = replay_route(routes[r], noise, outdir);
+        fprintf(stderr, "%s: %d segments in %.1f s\n", routes[r].c_str(), results[r].segments, results[r].seconds);
+      }
+    }));
+  }
+  for (auto &t : workers) t.join();
+  double elapsed = (millis_since_boot() - start) / 1000.;
+
+  RouteResult total;
+  for (auto &res : results) {
+    printf("%s: %d segments, %" PRIu64 " events, %" PRIu64 " outputs, %" PRIu64 " rewinds, %" PRIu64 " dropped, %" PRIu64 " resets\n",
+           res.route.c_str(), res.segments, res.events, res.outputs, res.rewinds, res.dropped, res.resets);
+    print_innovations(res.innovations);
+
+    total.segments += res.segments;
+    total.events += res.events;
+    total.outputs += res.outputs;
+    total.rewinds += res.rewinds;
+    total.dropped += res.dropped;
+    total.resets += res.resets;
+    merge_innovations(total.innovations, res.innovations);
+  }
+  printf("total: %zu routes, %d segments, %" PRIu64 " events, %" PRIu64 " outputs, %" PRIu64 " rewinds, %" PRIu64 " dropped, %" PRIu64 " resets\n",
+         routes.size(), total.segments, total.events, total.outputs, total.rewinds, total.dropped, total.resets);
+  print_innovations(total.innovations);
+  printf("%.1f s on %d threads\n", elapsed, std::min<int>(num_threads, routes.size()));
+  return 0;
+}
@@ -0,0 +1,158 @@
+// Benchmarks ubloxd's framing and decoding on a recorded ubloxRaw stream against the
+// previous byte-at-a-time resync and the kaitai decode.
+//
+//   ./ublox_bench <ubloxraw.bin> [corruption rate]
+//
+// ubloxraw.bin is the concatenated ubloxRaw payloads of a route:
+//   from tools.lib.logreader import LogReader
+//   open('ubloxraw.bin', 'wb').write(b''.join(m.ubloxRaw for m in LogReader(rlog) if m.which() == 'ubloxRaw'))
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <kaitai/kaitaistream.h>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/common/util.h"
+#include "selfdrive/locationd/ublox_msg.h"
+
+const size_t CHUNK_SIZE = 1024;
+
+// the framer ubloxd used before: drops one byte at a time on corruption
+class LegacyFramer {
+public:
+  bool add_data(const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed) {
+    int needed = needed_bytes();
+    if (needed > 0) {
+      bytes_consumed = std::min((uint32_t)needed, incoming_data_len);
+      memcpy(buf.data() + len, incoming_data, bytes_consumed);
+      len += bytes_consumed;
+    } else {
+      bytes_consumed = incoming_data_len;
+    }
+    while (!valid_so_far() && len != 0) {
+      len -= 1;
+      if (len > 0) memmove(&buf[0], &buf[1], len);
+    }
+    if (needed_bytes() == -1) len = 0;
+    return valid();
+  }
+  void reset() { len = 0; }
+
+private:
+  int needed_bytes() {
+    if (len < ublox::UBLOX_HEADER_SIZE) return ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE - len;
+    uint16_t needed = *(uint16_t *)&buf[4] + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
+    if (needed < (uint16_t)len) return -1;
+    return needed - (uint16_t)len;
+  }
+  bool valid_checksum() {
+    uint8_t ck_a = 0, ck_b = 0;
+    for (int i = 2; i < len - ublox::UBLOX_CHECKSUM_SIZE; i++) {
+      ck_a = (ck_a + buf[i]) & 0xFF;
+      ck_b = (ck_b + ck_a) & 0xFF;
+    }
+    return ck_a == buf[len - 2] && ck_b == buf[len - 1];
+  }
+  bool valid() {
+    return len >= ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE && needed_bytes() == 0 && valid_checksum();
+  }
+  bool valid_so_far() {
+    if (len > 0 && buf[0] != ublox::PREAMBLE1) return false;
+    if (len > 1 && buf[1] != ublox::PREAMBLE2) return false;
+    if (needed_bytes() == 0 && !valid()) return false;
+    return true;
+  }
+
+  size_t len = 0;
+  std::vector<uint8_t> buf = std::vector<uint8_t>(ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE);
+};
+
+template <class Parser, class FrameFn>
+static int run_framer(Parser &parser, const std::string &stream, FrameFn on_frame) {
+  int frames = 0;
+  for (size_t offset = 0; offset < stream.size(); offset += CHUNK_SIZE) {
+    const uint8_t *data = (const uint8_t *)stream.data() + offset;
+    const size_t len = std::min(CHUNK_SIZE, stream.size() - offset);
+    size_t bytes_consumed = 0;
+    while (bytes_consumed < len) {
+      size_t bytes_consumed_this_time = 0U;
+      if (parser.add_data(data + bytes_consumed, (uint32_t)(len - bytes_consumed), bytes_consumed_this_time)) {
+        on_frame(parser);
+        parser.reset();
+        frames++;
+      }
+      bytes_consumed += bytes_consumed_this_time;
+    }
+  }
+  return frames;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("usage: %s <ubloxraw.bin> [corruption rate]\n", argv[0]);
+    return 1;
+  }
+  std::string stream = util::read_file(argv[1]);
+  if (stream.empty()) {
+    printf("failed to read %s\n", argv[1]);
+    return 1;
+  }
+
+  // flip random bytes to simulate a noisy link
+  const double corruption = argc > 2 ? atof(argv[2]) : 0.;
+  std::mt19937 gen(0);
+  std::bernoulli_distribution corrupt(corruption);
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+  for (char &c : stream) {
+    if (corrupt(gen)) c = byte_dist(gen);
+  }
+  printf("%zu bytes, corruption rate %g\n", stream.size(), corruption);
+
+  // framing only
+  UbloxMsgParser parser;
+  std::vector<std::string> frames;
+  double t1 = millis_since_boot();
+  int n = run_framer(parser, stream, [&](UbloxMsgParser &p) { frames.push_back(p.data()); });
+  double t2 = millis_since_boot();
+  printf("framing:        %6d frames %9.3f ms %8.2f MB/s\n", n, t2 - t1, stream.size() / 1e3 / (t2 - t1));
+
+  LegacyFramer legacy;
+  t1 = millis_since_boot();
+  n = run_framer(legacy, stream, [](LegacyFramer &p) {});
+  t2 = millis_since_boot();
+  printf("legacy framing: %6d frames %9.3f ms %8.2f MB/s\n", n, t2 - t1, stream.size() / 1e3 / (t2 - t1));
+
+  // decoding, the capnp build is the same for both
+  int kaitai_errors = 0;
+  t1 = millis_since_boot();
+  for (auto &f : frames) {
+    try {
+      kaitai::kstream ks(f);
+      ubx_t ubx_message(&ks);
+    } catch (const std::exception &e) {
+      kaitai_errors++;
+    }
+  }
+  t2 = millis_since_boot();
+  printf("kaitai decode:  %6zu frames %9.3f ms %8.3f us/frame (%d errors)\n", frames.size(), t2 - t1,
+         (t2 - t1) * 1e3 / std::max<size_t>(frames.size(), 1), kaitai_errors);
+
+  UbloxMsgParser gen_parser;
+  size_t out_bytes = 0;
+  t1 = millis_since_boot();
+  n = run_framer(gen_parser, stream, [&](UbloxMsgParser &p) {
+    try {
+      out_bytes += p.gen_msg().second.size();
+    } catch (const std::exception &e) {
+    }
+  });
+  t2 = millis_since_boot();
+  printf("framing + gen_msg: %6d frames %9.3f ms %8.3f us/frame, %zu words out\n", n, t2 - t1,
+         (t2 - t1) * 1e3 / std::max(n, 1), out_bytes);
+  return 0;
+}
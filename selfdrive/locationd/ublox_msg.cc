@@ -7,6 +7,7 @@
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <unordered_map>
 
@@ -19,174 +20,207 @@ inline static bool bit_to_bool(uint8_t val, int shifts) {
   return (bool)(val & (1 << shifts));
 }
 
-inline int UbloxMsgParser::needed_bytes() {
-  // Msg header incomplete?
-  if(bytes_in_parse_buf < ublox::UBLOX_HEADER_SIZE)
-    return ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE - bytes_in_parse_buf;
-  uint16_t needed = UBLOX_MSG_SIZE(msg_parse_buf) + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
-  // too much data
-  if(needed < (uint16_t)bytes_in_parse_buf)
-    return -1;
-  return needed - (uint16_t)bytes_in_parse_buf;
-}
-
-inline bool UbloxMsgParser::valid_cheksum() {
+inline bool UbloxMsgParser::valid_cheksum(const uint8_t *frame, size_t frame_len) {
   uint8_t ck_a = 0, ck_b = 0;
-  for(int i = 2; i < bytes_in_parse_buf - ublox::UBLOX_CHECKSUM_SIZE;i++) {
-    ck_a = (ck_a + msg_parse_buf[i]) & 0xFF;
+  for(int i = 2; i < frame_len - ublox::UBLOX_CHECKSUM_SIZE;i++) {
+    ck_a = (ck_a + frame[i]) & 0xFF;
     ck_b = (ck_b + ck_a) & 0xFF;
   }
-  if(ck_a != msg_parse_buf[bytes_in_parse_buf - 2]) {
-    LOGD("Checksum a mismtach: %02X, %02X", ck_a, msg_parse_buf[6]);
+  if(ck_a != frame[frame_len - 2]) {
+    LOGD("Checksum a mismtach: %02X, %02X", ck_a, frame[frame_len - 2]);
     return false;
   }
-  if(ck_b != msg_parse_buf[bytes_in_parse_buf - 1]) {
-    LOGD("Checksum b mismtach: %02X, %02X", ck_b, msg_parse_buf[7]);
+  if(ck_b != frame[frame_len - 1]) {
+    LOGD("Checksum b mismtach: %02X, %02X", ck_b, frame[frame_len - 1]);
     return false;
   }
   return true;
 }
 
-inline bool UbloxMsgParser::valid() {
-  return bytes_in_parse_buf >= ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE &&
-         needed_bytes() == 0 && valid_cheksum();
+// Drop at least skip bytes, up to the next possible start of a frame
+inline void UbloxMsgParser::resync(size_t skip) {
+  const uint8_t *frame = msg_parse_buf + parse_start;
+  const uint8_t *next = skip < bytes_in_parse_buf ?
+    (const uint8_t *)memchr(frame + skip, ublox::PREAMBLE1, bytes_in_parse_buf - skip) : nullptr;
+  if (next == nullptr) {
+    parse_start = 0;
+    bytes_in_parse_buf = 0;
+  } else {
+    parse_start += next - frame;
+    bytes_in_parse_buf -= next - frame;
+  }
 }
 
-inline bool UbloxMsgParser::valid_so_far() {
-  if(bytes_in_parse_buf > 0 && msg_parse_buf[0] != ublox::PREAMBLE1) {
-    return false;
-  }
-  if(bytes_in_parse_buf > 1 && msg_parse_buf[1] != ublox::PREAMBLE2) {
-    return false;
-  }
-  if(needed_bytes() == 0 && !valid()) {
-    return false;
+void UbloxMsgParser::reset() {
+  // drop the current frame, anything after it was already received and stays in the buffer
+  if (bytes_in_parse_buf >= ublox::UBLOX_HEADER_SIZE) {
+    const size_t frame_len = UBLOX_MSG_SIZE((msg_parse_buf + parse_start)) + ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
+    if (frame_len < bytes_in_parse_buf) {
+      parse_start += frame_len;
+      bytes_in_parse_buf -= frame_len;
+      return;
+    }
   }
-  return true;
+  parse_start = 0;
+  bytes_in_parse_buf = 0;
 }
 
-
 bool UbloxMsgParser::add_data(const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed) {
-  int needed = needed_bytes();
-  if(needed > 0) {
-    bytes_consumed = std::min((uint32_t)needed, incoming_data_len );
-    // Add data to buffer
-    memcpy(msg_parse_buf + bytes_in_parse_buf, incoming_data, bytes_consumed);
-    bytes_in_parse_buf += bytes_consumed;
-  } else {
-    bytes_consumed = incoming_data_len;
-  }
+  bytes_consumed = 0;
+  while (true) {
+    const uint8_t *frame = msg_parse_buf + parse_start;
+
+    // Validate msg format, detect invalid header and invalid checksum.
+    if ((bytes_in_parse_buf > 0 && frame[0] != ublox::PREAMBLE1) ||
+        (bytes_in_parse_buf > 1 && frame[1] != ublox::PREAMBLE2)) {
+      resync(1);
+      continue;
+    }
 
-  // Validate msg format, detect invalid header and invalid checksum.
-  while(!valid_so_far() && bytes_in_parse_buf != 0) {
-    // Corrupted msg, drop a byte.
-    bytes_in_parse_buf -= 1;
-    if(bytes_in_parse_buf > 0)
-      memmove(&msg_parse_buf[0], &msg_parse_buf[1], bytes_in_parse_buf);
-  }
+    size_t needed = ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
+    if (bytes_in_parse_buf >= ublox::UBLOX_HEADER_SIZE) {
+      if (UBLOX_MSG_SIZE(frame) > ublox::UBLOX_MAX_PARSED_MSG_SIZE) {
+        resync(1);
+        continue;
+      }
+      needed += UBLOX_MSG_SIZE(frame);
+      if (bytes_in_parse_buf >= needed) {
+        if (valid_cheksum(frame, needed)) {
+          return true;
+        }
+        // Corrupted msg, look for the next frame inside it.
+        resync(1);
+        continue;
+      }
+    }
 
-  // There is redundant data at the end of buffer, reset the buffer.
-  if(needed_bytes() == -1) {
-    bytes_in_parse_buf = 0;
+    // Add only the data needed for this frame to the buffer
+    const size_t n = std::min(needed - bytes_in_parse_buf, (size_t)incoming_data_len - bytes_consumed);
+    if (n == 0) {
+      return false;
+    }
+    if (parse_start + bytes_in_parse_buf + n > sizeof(msg_parse_buf)) {
+      memmove(msg_parse_buf, msg_parse_buf + parse_start, bytes_in_parse_buf);
+      parse_start = 0;
+    }
+    memcpy(msg_parse_buf + parse_start + bytes_in_parse_buf, incoming_data + bytes_consumed, n);
+    bytes_in_parse_buf += n;
+    bytes_consumed += n;
   }
-  return valid();
 }
 
 
 std::pair<std::string, kj::Array<capnp::word>> UbloxMsgParser::gen_msg() {
-  std::string dat = data();
-  kaitai::kstream stream(dat);
-
-  ubx_t ubx_message(&stream);
-  auto body = ubx_message.body();
+  const uint8_t *frame = msg_parse_buf + parse_start;
+  const uint16_t msg_type = (frame[2] << 8) | frame[3];
+  const size_t len = UBLOX_MSG_SIZE(frame);
+  const uint8_t *payload = frame + ublox::UBLOX_HEADER_SIZE;
 
-  switch (ubx_message.msg_type()) {
+  switch (msg_type) {
   case 0x0107:
-    return {"gpsLocationExternal", gen_nav_pvt(static_cast<ubx_t::nav_pvt_t*>(body))};
+    if (len >= sizeof(ublox::ubx_nav_pvt_t)) {
+      return {"gpsLocationExternal", gen_nav_pvt((const ublox::ubx_nav_pvt_t *)payload)};
+    }
     break;
   case 0x0213:
-    return {"ubloxGnss", gen_rxm_sfrbx(static_cast<ubx_t::rxm_sfrbx_t*>(body))};
+    if (len >= sizeof(ublox::ubx_rxm_sfrbx_t)) {
+      auto msg = (const ublox::ubx_rxm_sfrbx_t *)payload;
+      if (len >= sizeof(*msg) + msg->numWords * sizeof(uint32_t)) {
+        return {"ubloxGnss", gen_rxm_sfrbx(msg, payload + sizeof(*msg))};
+      }
+    }
     break;
   case 0x0215:
-    return {"ubloxGnss", gen_rxm_rawx(static_cast<ubx_t::rxm_rawx_t*>(body))};
+    if (len >= sizeof(ublox::ubx_rxm_rawx_t)) {
+      auto msg = (const ublox::ubx_rxm_rawx_t *)payload;
+      if (len >= sizeof(*msg) + msg->numMeas * sizeof(ublox::ubx_rxm_rawx_meas_t)) {
+        return {"ubloxGnss", gen_rxm_rawx(msg, payload + sizeof(*msg))};
+      }
+    }
     break;
   case 0x0a09:
-    return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(body))};
-    break;
-  case 0x0a0b:
-    return {"ubloxGnss", gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(body))};
-    break;
+  case 0x0a0b: {
+    // low rate, still parsed by kaitai
+    std::string dat = data();
+    kaitai::kstream stream(dat);
+    ubx_t ubx_message(&stream);
+    if (msg_type == 0x0a09) {
+      return {"ubloxGnss", gen_mon_hw(static_cast<ubx_t::mon_hw_t*>(ubx_message.body()))};
+    }
+    return {"ubloxGnss", gen_mon_hw2(static_cast<ubx_t::mon_hw2_t*>(ubx_message.body()))};
+  }
   default:
-    LOGE("Unknown message type %x", ubx_message.msg_type());
+    LOGE("Unknown message type %x", msg_type);
     return {"ubloxGnss", kj::Array<capnp::word>()};
-    break;
   }
+
+  LOGE("Message type %x too short: %zu", msg_type, len);
+  return {"ubloxGnss", kj::Array<capnp::word>()};
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(ubx_t::nav_pvt_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg) {
   MessageBuilder msg_builder;
   auto gpsLoc = msg_builder.initEvent().initGpsLocationExternal();
   gpsLoc.setSource(cereal::GpsLocationData::SensorSource::UBLOX);
-  gpsLoc.setFlags(msg->flags());
-  gpsLoc.setLatitude(msg->lat() * 1e-07);
-  gpsLoc.setLongitude(msg->lon() * 1e-07);
-  gpsLoc.setAltitude(msg->height() * 1e-03);
-  gpsLoc.setSpeed(msg->g_speed() * 1e-03);
-  gpsLoc.setBearingDeg(msg->head_mot() * 1e-5);
-  gpsLoc.setAccuracy(msg->h_acc() * 1e-03);
+  gpsLoc.setFlags(msg->flags);
+  gpsLoc.setLatitude(msg->lat * 1e-07);
+  gpsLoc.setLongitude(msg->lon * 1e-07);
+  gpsLoc.setAltitude(msg->height * 1e-03);
+  gpsLoc.setSpeed(msg->gSpeed * 1e-03);
+  gpsLoc.setBearingDeg(msg->headMot * 1e-5);
+  gpsLoc.setAccuracy(msg->hAcc * 1e-03);
   std::tm timeinfo = std::tm();
-  timeinfo.tm_year = msg->year() - 1900;
-  timeinfo.tm_mon = msg->month() - 1;
-  timeinfo.tm_mday = msg->day();
-  timeinfo.tm_hour = msg->hour();
-  timeinfo.tm_min = msg->min();
-  timeinfo.tm_sec = msg->sec();
+  timeinfo.tm_year = msg->year - 1900;
+  timeinfo.tm_mon = msg->month - 1;
+  timeinfo.tm_mday = msg->day;
+  timeinfo.tm_hour = msg->hour;
+  timeinfo.tm_min = msg->min;
+  timeinfo.tm_sec = msg->sec;
 
   std::time_t utc_tt = timegm(&timeinfo);
-  gpsLoc.setTimestamp(utc_tt * 1e+03 + msg->nano() * 1e-06);
-  float f[] = { msg->vel_n() * 1e-03f, msg->vel_e() * 1e-03f, msg->vel_d() * 1e-03f };
+  gpsLoc.setTimestamp(utc_tt * 1e+03 + msg->nano * 1e-06);
+  float f[] = { msg->velN * 1e-03f, msg->velE * 1e-03f, msg->velD * 1e-03f };
   gpsLoc.setVNED(f);
-  gpsLoc.setVerticalAccuracy(msg->v_acc() * 1e-03);
-  gpsLoc.setSpeedAccuracy(msg->s_acc() * 1e-03);
-  gpsLoc.setBearingAccuracyDeg(msg->head_acc() * 1e-05);
+  gpsLoc.setVerticalAccuracy(msg->vAcc * 1e-03);
+  gpsLoc.setSpeedAccuracy(msg->sAcc * 1e-03);
+  gpsLoc.setBearingAccuracyDeg(msg->headAcc * 1e-05);
   return capnp::messageToFlatArray(msg_builder);
 }
 
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
-  auto body = *msg->body();
-
-  if (msg->gnss_id() == ubx_t::gnss_type_t::GNSS_TYPE_GPS) {
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg, const uint8_t *words) {
+  if (msg->gnssId == ubx_t::gnss_type_t::GNSS_TYPE_GPS) {
     // GPS subframes are packed into 10x 4 bytes, each containing 3 actual bytes
     // We will first need to separate the data from the padding and parity
-    assert(body.size() == 10);
+    assert(msg->numWords == 10);
 
-    std::string subframe_data;
-    subframe_data.reserve(30);
-    for (uint32_t word : body) {
+    char subframe_data[30];
+    for (int i = 0; i < 10; i++) {
+      uint32_t word;
+      memcpy(&word, words + i * sizeof(word), sizeof(word));
       word = word >> 6; // TODO: Verify parity
-      subframe_data.push_back(word >> 16);
-      subframe_data.push_back(word >> 8);
-      subframe_data.push_back(word >> 0);
+      subframe_data[3 * i + 0] = word >> 16;
+      subframe_data[3 * i + 1] = word >> 8;
+      subframe_data[3 * i + 2] = word >> 0;
     }
 
-    // Collect subframes in map and parse when we have all the parts
-    kaitai::kstream stream(subframe_data);
-    gps_t subframe(&stream);
-    int subframe_id = subframe.how()->subframe_id();
+    // subframe id from the handover word, bits 2-4 of the second word
+    int subframe_id = (subframe_data[5] >> 2) & 0x7;
+    int sv_id = msg->svId;
 
-    if (subframe_id == 1) gps_subframes[msg->sv_id()].clear();
-    gps_subframes[msg->sv_id()][subframe_id] = subframe_data;
+    // Collect subframes in map and parse when we have all the parts
+    if (subframe_id == 1) gps_subframes[sv_id].clear();
+    gps_subframes[sv_id][subframe_id].assign(subframe_data, sizeof(subframe_data));
 
-    if (gps_subframes[msg->sv_id()].size() == 5) {
+    if (gps_subframes[sv_id].size() == 5) {
       MessageBuilder msg_builder;
       auto eph = msg_builder.initEvent().initUbloxGnss().initEphemeris();
-      eph.setSvId(msg->sv_id());
+      eph.setSvId(sv_id);
 
       // Subframe 1
       {
-        kaitai::kstream stream(gps_subframes[msg->sv_id()][1]);
+        kaitai::kstream stream(gps_subframes[sv_id][1]);
         gps_t subframe(&stream);
         gps_t::subframe_1_t* subframe_1 = static_cast<gps_t::subframe_1_t*>(subframe.body());
 
@@ -200,7 +234,7 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
 
       // Subframe 2
       {
-        kaitai::kstream stream(gps_subframes[msg->sv_id()][2]);
+        kaitai::kstream stream(gps_subframes[sv_id][2]);
         gps_t subframe(&stream);
         gps_t::subframe_2_t* subframe_2 = static_cast<gps_t::subframe_2_t*>(subframe.body());
 
@@ -216,7 +250,7 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
 
       // Subframe 3
       {
-        kaitai::kstream stream(gps_subframes[msg->sv_id()][3]);
+        kaitai::kstream stream(gps_subframes[sv_id][3]);
         gps_t subframe(&stream);
         gps_t::subframe_3_t* subframe_3 = static_cast<gps_t::subframe_3_t*>(subframe.body());
 
@@ -233,7 +267,7 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
 
       // Subframe 4
       {
-        kaitai::kstream stream(gps_subframes[msg->sv_id()][4]);
+        kaitai::kstream stream(gps_subframes[sv_id][4]);
         gps_t subframe(&stream);
         gps_t::subframe_4_t* subframe_4 = static_cast<gps_t::subframe_4_t*>(subframe.body());
 
@@ -260,41 +294,41 @@ kj::Array<capnp::word> UbloxMsgParser::gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg) {
   return kj::Array<capnp::word>();
 }
 
-kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(ubx_t::rxm_rawx_t *msg) {
+kj::Array<capnp::word> UbloxMsgParser::gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg, const uint8_t *measurements) {
   MessageBuilder msg_builder;
   auto mr = msg_builder.initEvent().initUbloxGnss().initMeasurementReport();
-  mr.setRcvTow(msg->rcv_tow());
-  mr.setGpsWeek(msg->week());
-  mr.setLeapSeconds(msg->leap_s());
-  mr.setGpsWeek(msg->week());
-
-  auto mb = mr.initMeasurements(msg->num_meas());
-  auto measurements = *msg->measurements();
-  for(int8_t i = 0; i < msg->num_meas(); i++) {
-    mb[i].setSvId(measurements[i]->sv_id());
-    mb[i].setPseudorange(measurements[i]->pr_mes());
-    mb[i].setCarrierCycles(measurements[i]->cp_mes());
-    mb[i].setDoppler(measurements[i]->do_mes());
-    mb[i].setGnssId(measurements[i]->gnss_id());
-    mb[i].setGlonassFrequencyIndex(measurements[i]->freq_id());
-    mb[i].setLocktime(measurements[i]->lock_time());
-    mb[i].setCno(measurements[i]->cno());
-    mb[i].setPseudorangeStdev(0.01 * (pow(2, (measurements[i]->pr_stdev() & 15)))); // weird scaling, might be wrong
-    mb[i].setCarrierPhaseStdev(0.004 * (measurements[i]->cp_stdev() & 15));
-    mb[i].setDopplerStdev(0.002 * (pow(2, (measurements[i]->do_stdev() & 15)))); // weird scaling, might be wrong
+  mr.setRcvTow(msg->rcvTow);
+  mr.setGpsWeek(msg->week);
+  mr.setLeapSeconds(msg->leapS);
+  mr.setGpsWeek(msg->week);
+
+  auto mb = mr.initMeasurements(msg->numMeas);
+  for(int i = 0; i < msg->numMeas; i++) {
+    auto meas = (const ublox::ubx_rxm_rawx_meas_t *)(measurements + i * sizeof(ublox::ubx_rxm_rawx_meas_t));
+    mb[i].setSvId(meas->svId);
+    mb[i].setPseudorange(meas->prMes);
+    mb[i].setCarrierCycles(meas->cpMes);
+    mb[i].setDoppler(meas->doMes);
+    mb[i].setGnssId(meas->gnssId);
+    mb[i].setGlonassFrequencyIndex(meas->freqId);
+    mb[i].setLocktime(meas->locktime);
+    mb[i].setCno(meas->cno);
+    mb[i].setPseudorangeStdev(0.01 * (pow(2, (meas->prStdev & 15)))); // weird scaling, might be wrong
+    mb[i].setCarrierPhaseStdev(0.004 * (meas->cpStdev & 15));
+    mb[i].setDopplerStdev(0.002 * (pow(2, (meas->doStdev & 15)))); // weird scaling, might be wrong
 
     auto ts = mb[i].initTrackingStatus();
-    auto trk_stat = measurements[i]->trk_stat();
+    auto trk_stat = meas->trkStat;
     ts.setPseudorangeValid(bit_to_bool(trk_stat, 0));
     ts.setCarrierPhaseValid(bit_to_bool(trk_stat, 1));
     ts.setHalfCycleValid(bit_to_bool(trk_stat, 2));
     ts.setHalfCycleSubtracted(bit_to_bool(trk_stat, 3));
   }
 
-  mr.setNumMeas(msg->num_meas());
+  mr.setNumMeas(msg->numMeas);
   auto rs = mr.initReceiverStatus();
-  rs.setLeapSecValid(bit_to_bool(msg->rec_stat(), 0));
-  rs.setClkReset(bit_to_bool(msg->rec_stat(), 2));
+  rs.setLeapSecValid(bit_to_bool(msg->recStat, 0));
+  rs.setClkReset(bit_to_bool(msg->recStat, 2));
   return capnp::messageToFlatArray(msg_builder);
 }
 
@@ -22,6 +22,8 @@ namespace ublox {
   const int UBLOX_HEADER_SIZE = 6;
   const int UBLOX_CHECKSUM_SIZE = 2;
   const int UBLOX_MAX_MSG_SIZE = 65536;
+  // largest payload we parse (RXM-RAWX with 255 measurements), longer ones are corrupted headers
+  const int UBLOX_MAX_PARSED_MSG_SIZE = 8176;
 
   // Boardd still uses these:
   const uint8_t CLASS_NAV = 0x01;
@@ -46,6 +48,85 @@ namespace ublox {
     uint32_t tAccNs;
   } __attribute__((packed));
 
+  // payloads of the hot messages, decoded in place from the parse buffer (little endian)
+  struct ubx_nav_pvt_t {
+    uint32_t iTOW;
+    uint16_t year;
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;
+    uint32_t tAcc;
+    int32_t nano;
+    uint8_t fixType;
+    uint8_t flags;
+    uint8_t flags2;
+    uint8_t numSV;
+    int32_t lon;
+    int32_t lat;
+    int32_t height;
+    int32_t hMSL;
+    uint32_t hAcc;
+    uint32_t vAcc;
+    int32_t velN;
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;
+    int32_t headMot;
+    int32_t sAcc;
+    uint32_t headAcc;
+    uint16_t pDOP;
+    uint8_t flags3;
+    uint8_t reserved1[5];
+    int32_t headVeh;
+    int16_t magDec;
+    uint16_t magAcc;
+  } __attribute__((packed));
+
+  struct ubx_rxm_rawx_t {
+    double rcvTow;
+    uint16_t week;
+    int8_t leapS;
+    uint8_t numMeas;
+    uint8_t recStat;
+    uint8_t reserved1[3];
+  } __attribute__((packed));
+
+  struct ubx_rxm_rawx_meas_t {
+    double prMes;
+    double cpMes;
+    float doMes;
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t reserved2;
+    uint8_t freqId;
+    uint16_t locktime;
+    uint8_t cno;
+    uint8_t prStdev;
+    uint8_t cpStdev;
+    uint8_t doStdev;
+    uint8_t trkStat;
+    uint8_t reserved3;
+  } __attribute__((packed));
+
+  struct ubx_rxm_sfrbx_t {
+    uint8_t gnssId;
+    uint8_t svId;
+    uint8_t reserved1;
+    uint8_t freqId;
+    uint8_t numWords;
+    uint8_t reserved2;
+    uint8_t version;
+    uint8_t reserved3;
+  } __attribute__((packed));
+
+  static_assert(sizeof(ubx_nav_pvt_t) == 92);
+  static_assert(sizeof(ubx_rxm_rawx_t) == 16);
+  static_assert(sizeof(ubx_rxm_rawx_meas_t) == 32);
+  static_assert(sizeof(ubx_rxm_sfrbx_t) == 8);
+
   inline std::string ubx_add_checksum(const std::string &msg) {
     assert(msg.size() > 2);
 
@@ -91,26 +172,27 @@ namespace ublox {
 class UbloxMsgParser {
   public:
     bool add_data(const uint8_t *incoming_data, uint32_t incoming_data_len, size_t &bytes_consumed);
-    inline void reset() {bytes_in_parse_buf = 0;}
-    inline int needed_bytes();
-    inline std::string data() {return std::string((const char*)msg_parse_buf, bytes_in_parse_buf);}
+    void reset();
+    inline std::string data() {return std::string((const char*)msg_parse_buf + parse_start, bytes_in_parse_buf);}
 
     std::pair<std::string, kj::Array<capnp::word>> gen_msg();
-    kj::Array<capnp::word> gen_nav_pvt(ubx_t::nav_pvt_t *msg);
-    kj::Array<capnp::word> gen_rxm_sfrbx(ubx_t::rxm_sfrbx_t *msg);
-    kj::Array<capnp::word> gen_rxm_rawx(ubx_t::rxm_rawx_t *msg);
+    kj::Array<capnp::word> gen_nav_pvt(const ublox::ubx_nav_pvt_t *msg);
+    kj::Array<capnp::word> gen_rxm_sfrbx(const ublox::ubx_rxm_sfrbx_t *msg, const uint8_t *words);
+    kj::Array<capnp::word> gen_rxm_rawx(const ublox::ubx_rxm_rawx_t *msg, const uint8_t *measurements);
     kj::Array<capnp::word> gen_mon_hw(ubx_t::mon_hw_t *msg);
     kj::Array<capnp::word> gen_mon_hw2(ubx_t::mon_hw2_t *msg);
 
   private:
-    inline bool valid_cheksum();
-    inline bool valid();
-    inline bool valid_so_far();
+    inline bool valid_cheksum(const uint8_t *frame, size_t frame_len);
+    inline void resync(size_t skip);
 
     std::unordered_map<int, std::unordered_map<int, std::string>> gps_subframes;
 
+    // Unparsed bytes are msg_parse_buf[parse_start, parse_start + bytes_in_parse_buf). Frames are only
+    // moved to the front when the end of the buffer is reached, which keeps framing linear in the
+    // stream length and every frame contiguous for in place decoding.
+    static const size_t MAX_FRAME_SIZE = ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_PARSED_MSG_SIZE + ublox::UBLOX_CHECKSUM_SIZE;
+    size_t parse_start = 0;
     size_t bytes_in_parse_buf = 0;
-    uint8_t msg_parse_buf[ublox::UBLOX_HEADER_SIZE + ublox::UBLOX_MAX_MSG_SIZE];
-
+    uint8_t msg_parse_buf[2 * MAX_FRAME_SIZE];
 };
-
@@ -2,12 +2,11 @@
 #include <cstdlib>
 #include <mutex>
 
-#include <eigen3/Eigen/Dense>
-
 #include "cereal/messaging/messaging.h"
 #include "cereal/visionipc/visionipc_client.h"
 #include "selfdrive/common/clutil.h"
 #include "selfdrive/common/params.h"
+#include "selfdrive/common/ratekeeper.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/hardware/hw.h"
@@ -25,42 +24,15 @@ void calibration_thread(bool wide_camera) {
 
   SubMaster sm({"liveCalibration"});
 
-  /*
-     import numpy as np
-     from common.transformations.model import medmodel_frame_from_road_frame
-     medmodel_frame_from_ground = medmodel_frame_from_road_frame[:, (0, 1, 3)]
-     ground_from_medmodel_frame = np.linalg.inv(medmodel_frame_from_ground)
-  */
-  Eigen::Matrix<float, 3, 3> ground_from_medmodel_frame;
-  ground_from_medmodel_frame <<
-    0.00000000e+00, 0.00000000e+00, 1.00000000e+00,
-    -1.09890110e-03, 0.00000000e+00, 2.81318681e-01,
-    -1.84808520e-20, 9.00738606e-04,-4.28751576e-02;
-
-  Eigen::Matrix<float, 3, 3> cam_intrinsics = Eigen::Matrix<float, 3, 3, Eigen::RowMajor>(wide_camera ? ecam_intrinsic_matrix.v : fcam_intrinsic_matrix.v);
-  const mat3 yuv_transform = get_model_yuv_transform();
-
   while (!do_exit) {
     sm.update(100);
     if(sm.updated("liveCalibration")) {
       auto extrinsic_matrix = sm["liveCalibration"].getLiveCalibration().getExtrinsicMatrix();
-      Eigen::Matrix<float, 3, 4> extrinsic_matrix_eigen;
+      float extrinsic[4*3];
       for (int i = 0; i < 4*3; i++) {
-        extrinsic_matrix_eigen(i / 4, i % 4) = extrinsic_matrix[i];
+        extrinsic[i] = extrinsic_matrix[i];
       }
-
-      auto camera_frame_from_road_frame = cam_intrinsics * extrinsic_matrix_eigen;
-      Eigen::Matrix<float, 3, 3> camera_frame_from_ground;
-      camera_frame_from_ground.col(0) = camera_frame_from_road_frame.col(0);
-      camera_frame_from_ground.col(1) = camera_frame_from_road_frame.col(1);
-      camera_frame_from_ground.col(2) = camera_frame_from_road_frame.col(3);
-
-      auto warp_matrix = camera_frame_from_ground * ground_from_medmodel_frame;
-      mat3 transform = {};
-      for (int i=0; i<3*3; i++) {
-        transform.v[i] = warp_matrix(i / 3, i % 3);
-      }
-      mat3 model_transform = matmul3(yuv_transform, transform);
+      mat3 model_transform = get_model_transform(extrinsic, wide_camera);
       std::lock_guard lk(transform_lock);
       cur_transform = model_transform;
       live_calib_seen = true;
@@ -70,8 +42,9 @@ void calibration_thread(bool wide_camera) {
 
 void run_model(ModelState &model, VisionIpcClient &vipc_client) {
   // messaging
-  PubMaster pm({"modelV2", "cameraOdometry"});
+  PubMaster pm({"modelV2", "cameraOdometry", "modeldLoopStats"});
   SubMaster sm({"lateralPlan", "roadCameraState"});
+  RateKeeper rk("modeld", MODEL_FREQ);
 
   // setup filter to track dropped frames
   FirstOrderFilter frame_dropped_filter(0., 10., 1. / MODEL_FREQ);
@@ -84,6 +57,7 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client) {
     VisionIpcBufExtra extra = {};
     VisionBuf *buf = vipc_client.recv(&extra);
     if (buf == nullptr) continue;
+    rk.wakeup();
 
     transform_lock.lock();
     mat3 model_transform = cur_transform;
@@ -127,6 +101,13 @@ void run_model(ModelState &model, VisionIpcClient &vipc_client) {
       last = mt1;
       last_vipc_frame_id = extra.frame_id;
     }
+
+    if (rk.statsReady()) {
+      MessageBuilder msg;
+      rk.fillStats(msg.initEvent().initModeldLoopStats());
+      pm.send("modeldLoopStats", msg);
+    }
+    rk.monitorTime();
   }
 }
 
@@ -0,0 +1,226 @@
+// Offline benchmark for modeld and dmonitoringmodeld.
+// Feeds a recorded camera stream through the same prepare/execute/publish path
+// as the daemons and reports per-stage latency, throughput and an output hash.
+//
+//   ./modeld_bench [-d] [-g] [-w] [-n frames] [-s seed] <fcamera.hevc | dcamera.hevc>
+//
+//   -d  run the driver monitoring model instead of the driving model
+//   -g  preprocess the driver frame on the GPU
+//   -w  use the wide camera intrinsics for the driving model
+//   -n  number of frames to run (default: all)
+//   -s  seed for the desire input sequence (default: 0)
+
+#include <getopt.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "selfdrive/common/clutil.h"
+#include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/models/dmonitoring.h"
+#include "selfdrive/modeld/models/driving.h"
+#include "selfdrive/ui/replay/framereader.h"
+
+// extrinsics of a device with zero calibration mounted 1.22m above the road
+// common.transformations.camera.get_view_frame_from_road_frame(0, 0, 0, 1.22)
+const float default_extrinsic[4*3] = {
+  0.0, 1.0, 0.0, 0.0,
+  0.0, 0.0, 1.0, 1.22,
+  1.0, 0.0, 0.0, 0.0,
+};
+
+class LatencyHistogram {
+public:
+  LatencyHistogram(const char *name) : name(name) {}
+  void add(double ms) { samples.push_back(ms); }
+
+  void print() const {
+    if (samples.empty()) return;
+
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](double p) { return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))]; };
+    double sum = 0;
+    for (double s : sorted) sum += s;
+
+    printf("%-10s mean %8.3f ms  p50 %8.3f  p90 %8.3f  p99 %8.3f  max %8.3f\n", name.c_str(),
+           sum / sorted.size(), percentile(0.5), percentile(0.9), percentile(0.99), sorted.back());
+
+    // power of two buckets starting at 1/8 ms
+    int counts[BUCKETS] = {};
+    for (double s : sorted) {
+      int b = 0;
+      while (b < BUCKETS - 1 && s >= bucket_limit(b)) b++;
+      counts[b]++;
+    }
+    for (int b = 0; b < BUCKETS; b++) {
+      if (counts[b] == 0) continue;
+      int bar = (counts[b] * 50 + sorted.size() - 1) / sorted.size();
+      printf("  < %8.3f ms %6d %s\n", bucket_limit(b), counts[b], std::string(bar, '#').c_str());
+    }
+  }
+
+private:
+  static constexpr int BUCKETS = 16;
+  static double bucket_limit(int b) { return 0.125 * (1 << b); }
+
+  std::string name;
+  std::vector<double> samples;
+};
+
+// FNV-1a, so hashes are stable across platforms and runs
+static uint64_t hash_outputs(uint64_t h, const float *data, size_t len) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < len * sizeof(float); i++) {
+    h ^= bytes[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+int main(int argc, char **argv) {
+  bool dmonitoring = false, gpu_preprocess = false, wide_camera = false;
+  int max_frames = -1;
+  unsigned int seed = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "dgwn:s:")) != -1) {
+    switch (opt) {
+      case 'd': dmonitoring = true; break;
+      case 'g': gpu_preprocess = true; break;
+      case 'w': wide_camera = true; break;
+      case 'n': max_frames = atoi(optarg); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-d] [-g] [-w] [-n frames] [-s seed] <video>\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, "usage: %s [-d] [-g] [-w] [-n frames] [-s seed] <video>\n", argv[0]);
+    return 1;
+  }
+
+  FrameReader fr;
+  if (!fr.load(argv[optind])) {
+    fprintf(stderr, "failed to load %s\n", argv[optind]);
+    return 1;
+  }
+  const int frame_count = max_frames < 0 ? fr.getFrameCount() : std::min<int>(max_frames, fr.getFrameCount());
+  std::vector<uint8_t> yuv(fr.getYUVSize());
+
+  LatencyHistogram load_hist("load"), prepare_hist("prepare"), execute_hist("execute"), publish_hist("publish");
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  double total_ms = 0;
+
+  if (dmonitoring) {
+    cl_device_id device_id = NULL;
+    cl_context context = NULL;
+    cl_command_queue q = NULL;
+    cl_mem yuv_cl = NULL;
+    if (gpu_preprocess) {
+      device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+      context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+      q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+      yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY, yuv.size(), NULL, &err));
+    }
+
+    PubMaster pm({"driverState"});
+    DMonitoringModelState model;
+    dmonitoring_init(&model, device_id, context);
+
+    for (int i = 0; i < frame_count; i++) {
+      double t1 = millis_since_boot();
+      if (!fr.get(i, nullptr, yuv.data())) {
+        fprintf(stderr, "failed to decode frame %d\n", i);
+        return 1;
+      }
+      if (yuv_cl != NULL) {
+        CL_CHECK(clEnqueueWriteBuffer(q, yuv_cl, CL_TRUE, 0, yuv.size(), yuv.data(), 0, NULL, NULL));
+      }
+      double t2 = millis_since_boot();
+      DMonitoringResult res = dmonitoring_eval_frame(&model, yuv.data(), fr.width, fr.height, yuv_cl);
+      double t3 = millis_since_boot();
+      dmonitoring_publish(pm, i, res, (t3 - t2) / 1000.0, model.output);
+      double t4 = millis_since_boot();
+
+      load_hist.add(t2 - t1);
+      prepare_hist.add((t3 - t2) - res.dsp_execution_time * 1000.);
+      execute_hist.add(res.dsp_execution_time * 1000.);
+      publish_hist.add(t4 - t3);
+      total_ms += t4 - t2;
+      hash = hash_outputs(hash, model.output, OUTPUT_SIZE);
+    }
+
+    dmonitoring_free(&model);
+    if (context != NULL) {
+      CL_CHECK(clReleaseMemObject(yuv_cl));
+      CL_CHECK(clReleaseCommandQueue(q));
+      CL_CHECK(clReleaseContext(context));
+    }
+  } else {
+    cl_device_id device_id = cl_get_device_id(CL_DEVICE_TYPE_DEFAULT);
+    cl_context context = CL_CHECK_ERR(clCreateContext(NULL, 1, &device_id, NULL, NULL, &err));
+    cl_command_queue q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+    cl_mem yuv_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_READ_ONLY, yuv.size(), NULL, &err));
+
+    PubMaster pm({"modelV2", "cameraOdometry"});
+    ModelState model;
+    model_init(&model, device_id, context);
+    const mat3 transform = get_model_transform(default_extrinsic, wide_camera);
+
+    // desire changes every 5s, drawn from a fixed seed so the outputs are reproducible
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<int> desire_dist(0, DESIRE_LEN - 1);
+    float vec_desire[DESIRE_LEN] = {};
+
+    for (int i = 0; i < frame_count; i++) {
+      if (i % (5 * MODEL_FREQ) == 0) {
+        std::fill_n(vec_desire, DESIRE_LEN, 0.);
+        vec_desire[desire_dist(gen)] = 1.0;
+      }
+
+      double t1 = millis_since_boot();
+      if (!fr.get(i, nullptr, yuv.data())) {
+        fprintf(stderr, "failed to decode frame %d\n", i);
+        return 1;
+      }
+      CL_CHECK(clEnqueueWriteBuffer(q, yuv_cl, CL_TRUE, 0, yuv.size(), yuv.data(), 0, NULL, NULL));
+      double t2 = millis_since_boot();
+      ModelDataRaw model_buf = model_eval_frame(&model, yuv_cl, fr.width, fr.height, transform, vec_desire);
+      double t3 = millis_since_boot();
+      const uint64_t timestamp_eof = i * (1000000000ULL / MODEL_FREQ);
+      model_publish(pm, i, i, 0, model_buf, timestamp_eof, (t3 - t2) / 1000.0,
+                    kj::ArrayPtr<const float>(model.output.data(), model.output.size()));
+      posenet_publish(pm, i, 0, model_buf, timestamp_eof);
+      double t4 = millis_since_boot();
+
+      load_hist.add(t2 - t1);
+      prepare_hist.add(model_buf.prepare_time * 1000.);
+      execute_hist.add(model_buf.execute_time * 1000.);
+      publish_hist.add(t4 - t3);
+      total_ms += t4 - t2;
+      hash = hash_outputs(hash, model.output.data(), model.output.size());
+    }
+
+    model_free(&model);
+    CL_CHECK(clReleaseMemObject(yuv_cl));
+    CL_CHECK(clReleaseCommandQueue(q));
+    CL_CHECK(clReleaseContext(context));
+  }
+
+  printf("%s: %d frames (%dx%d), seed %u\n", dmonitoring ? "dmonitoringmodeld" : "modeld",
+         frame_count, fr.width, fr.height, seed);
+  load_hist.print();
+  prepare_hist.print();
+  execute_hist.print();
+  publish_hist.print();
+  printf("throughput %.2f fps (excluding load)\n", total_ms > 0 ? frame_count * 1000. / total_ms : 0.);
+  printf("output hash %016" PRIx64 "\n", hash);
+  return 0;
+}
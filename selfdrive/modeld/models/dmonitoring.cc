@@ -1,7 +1,8 @@
+#include <algorithm>
+#include <cassert>
 #include <cstring>
 
-#include "libyuv.h"
-
+#include "selfdrive/common/clutil.h"
 #include "selfdrive/common/mat.h"
 #include "selfdrive/common/params.h"
 #include "selfdrive/common/timing.h"
@@ -13,17 +14,23 @@
 #define MODEL_HEIGHT 640
 #define FULL_W 852 // should get these numbers from camerad
 
-void dmonitoring_init(DMonitoringModelState* s) {
+void dmonitoring_init(DMonitoringModelState* s, cl_device_id device_id, cl_context context) {
   s->is_rhd = Params().getBool("IsRHD");
-  for (int x = 0; x < std::size(s->tensor); ++x) {
-    s->tensor[x] = (x - 128.f) * 0.0078125f;
-  }
 
 #ifdef USE_ONNX_MODEL
   s->m = new ONNXModel("../../models/dmonitoring_model.onnx", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME);
 #else
   s->m = new SNPEModel("../../models/dmonitoring_model_q.dlc", &s->output[0], OUTPUT_SIZE, USE_DSP_RUNTIME);
 #endif
+
+  if (context != NULL) {
+    s->q = CL_CHECK_ERR(clCreateCommandQueue(context, device_id, 0, &err));
+    cl_program prg = cl_program_from_file(context, device_id, "models/dmonitoring.cl", "");
+    s->resize_krnl = CL_CHECK_ERR(clCreateKernel(prg, "resize_plane", &err));
+    CL_CHECK(clReleaseProgram(prg));
+    const size_t yuv_buf_len = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2) * 6;
+    s->net_input_cl = CL_CHECK_ERR(clCreateBuffer(context, CL_MEM_WRITE_ONLY, yuv_buf_len * sizeof(float), NULL, &err));
+  }
 }
 
 template <class T>
@@ -32,27 +39,90 @@ static inline T *get_buffer(std::vector<T> &buf, const size_t size) {
   return buf.data();
 }
 
-static inline auto get_yuv_buf(std::vector<uint8_t> &buf, const int width, int height) {
-  uint8_t *y = get_buffer(buf, width * height * 3 / 2);
-  uint8_t *u = y + width * height;
-  uint8_t *v = u + (width /2) * (height / 2);
-  return std::make_tuple(y, u, v);
+struct Rect {int x, y, w, h;};
+
+// center aligned bilinear sample position of dst pixel i, 8 bit fixed point
+static inline int sample_pos(int i, int src_len, int dst_len) {
+  return std::clamp(((2 * i + 1) * src_len * 256) / (2 * dst_len) - 128, 0, (src_len - 1) * 256);
 }
 
-struct Rect {int x, y, w, h;};
-void crop_yuv(uint8_t *raw, int width, int height, uint8_t *y, uint8_t *u, uint8_t *v, const Rect &rect) {
-  uint8_t *raw_y = raw;
-  uint8_t *raw_u = raw_y + (width * height);
-  uint8_t *raw_v = raw_u + ((width / 2) * (height / 2));
-  for (int r = 0; r < rect.h / 2; r++) {
-    memcpy(y + 2 * r * rect.w, raw_y + (2 * r + rect.y) * width + rect.x, rect.w);
-    memcpy(y + (2 * r + 1) * rect.w, raw_y + (2 * r + rect.y + 1) * width + rect.x, rect.w);
-    memcpy(u + r * (rect.w / 2), raw_u + (r + (rect.y / 2)) * width / 2 + (rect.x / 2), rect.w / 2);
-    memcpy(v + r * (rect.w / 2), raw_v + (r + (rect.y / 2)) * width / 2 + (rect.x / 2), rect.w / 2);
+// Crops, optionally mirrors, bilinearly resizes and normalizes one plane in a single pass.
+// Each source row is blended horizontally once into a two row cache, so the vertical blend
+// and the float conversion run over contiguous rows and vectorize. With split_cols the even
+// output columns of row r go to row_dst(r, 0) and the odd ones to row_dst(r, 1).
+// models/dmonitoring.cl does the exact same math on the GPU.
+template <class RowFn>
+static void resize_plane(DMonitoringModelState* s, const uint8_t *src, int stride, const Rect &rect,
+                         bool mirror, int out_w, int out_h, bool split_cols, RowFn row_dst) {
+  const int parts = split_cols ? 2 : 1, part_w = out_w / parts;
+  int *x0 = get_buffer(s->x_idx, out_w);
+  uint16_t *fx = get_buffer(s->x_frac, out_w);
+  for (int k = 0; k < out_w; k++) {
+    const int c = split_cols ? 2 * (k % part_w) + k / part_w : k;
+    const int pos = sample_pos(mirror ? out_w - 1 - c : c, rect.w, out_w);
+    // the last column is its left neighbour's full weight blend, so x0 + 1 stays in the crop
+    x0[k] = std::min(pos >> 8, rect.w - 2);
+    fx[k] = pos - x0[k] * 256;
+  }
+
+  uint16_t *h0 = get_buffer(s->row_buf, out_w * 2), *h1 = h0 + out_w;
+  int h0_src = -1, h1_src = -1;
+  auto hblend = [&](int y, uint16_t *__restrict dst) {
+    const uint8_t *__restrict line = src + (rect.y + y) * stride + rect.x;
+    for (int k = 0; k < out_w; k++) {
+      dst[k] = line[x0[k]] * (256 - fx[k]) + line[x0[k] + 1] * fx[k];
+    }
+  };
+
+  for (int r = 0; r < out_h; r++) {
+    const int pos = sample_pos(r, rect.h, out_h);
+    const int y0 = pos >> 8, y1 = std::min(y0 + 1, rect.h - 1);
+    const uint32_t fy = pos & 0xff;
+    if (y0 == h1_src) {
+      std::swap(h0, h1);
+      std::swap(h0_src, h1_src);
+    }
+    if (y0 != h0_src) {
+      hblend(y0, h0);
+      h0_src = y0;
+    }
+    if (y1 != h1_src) {
+      hblend(y1, h1);
+      h1_src = y1;
+    }
+
+    for (int p = 0; p < parts; p++) {
+      const uint16_t *__restrict a = h0 + p * part_w, *__restrict b = h1 + p * part_w;
+      float *__restrict dst = row_dst(r, p);
+      for (int k = 0; k < part_w; k++) {
+        const uint32_t v = (a[k] * (256 - fy) + b[k] * fy + (1 << 15)) >> 16;
+        dst[k] = v * 0.0078125f - 1.0f;
+      }
+    }
   }
 }
 
-DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height) {
+static void resize_plane_cl(DMonitoringModelState* s, cl_mem yuv_cl, int offset, int stride, const Rect &rect,
+                            bool mirror, int out_offset, int out_w, int out_h, bool is_y) {
+  const int is_mirror = mirror, plane_is_y = is_y;
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 0, sizeof(cl_mem), &yuv_cl));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 1, sizeof(cl_int), &offset));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 2, sizeof(cl_int), &stride));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 3, sizeof(cl_int), &rect.x));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 4, sizeof(cl_int), &rect.y));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 5, sizeof(cl_int), &rect.w));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 6, sizeof(cl_int), &rect.h));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 7, sizeof(cl_int), &is_mirror));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 8, sizeof(cl_mem), &s->net_input_cl));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 9, sizeof(cl_int), &out_offset));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 10, sizeof(cl_int), &out_w));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 11, sizeof(cl_int), &out_h));
+  CL_CHECK(clSetKernelArg(s->resize_krnl, 12, sizeof(cl_int), &plane_is_y));
+  const size_t work_size[2] = {(size_t)out_w, (size_t)out_h};
+  CL_CHECK(clEnqueueNDRangeKernel(s->q, s->resize_krnl, 2, NULL, work_size, NULL, 0, 0, NULL));
+}
+
+DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height, cl_mem yuv_cl) {
   Rect crop_rect;
   if (Hardware::TICI()) {
     const int full_width_tici = 1928;
@@ -73,57 +143,35 @@ DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_
       crop_rect.x += width - crop_rect.w;
     }
   }
+  const Rect crop_rect_uv = {crop_rect.x / 2, crop_rect.y / 2, crop_rect.w / 2, crop_rect.h / 2};
 
-  int resized_width = MODEL_WIDTH;
-  int resized_height = MODEL_HEIGHT;
+  // Y|u|v -> y|y|y|y|u|v
+  const int plane_size = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2);
+  int yuv_buf_len = plane_size * 6;
+  float *net_input_buf = get_buffer(s->net_input_buf, yuv_buf_len);
 
-  auto [cropped_y, cropped_u, cropped_v] = get_yuv_buf(s->cropped_buf, crop_rect.w, crop_rect.h);
-  if (!s->is_rhd) {
-    crop_yuv((uint8_t *)stream_buf, width, height, cropped_y, cropped_u, cropped_v, crop_rect);
+  if (yuv_cl != NULL && s->q != NULL) {
+    resize_plane_cl(s, yuv_cl, 0, width, crop_rect, s->is_rhd, 0, MODEL_WIDTH, MODEL_HEIGHT, true);
+    resize_plane_cl(s, yuv_cl, width * height, width / 2, crop_rect_uv, s->is_rhd,
+                    4 * plane_size, MODEL_WIDTH / 2, MODEL_HEIGHT / 2, false);
+    resize_plane_cl(s, yuv_cl, width * height + (width / 2) * (height / 2), width / 2, crop_rect_uv, s->is_rhd,
+                    5 * plane_size, MODEL_WIDTH / 2, MODEL_HEIGHT / 2, false);
+    CL_CHECK(clEnqueueReadBuffer(s->q, s->net_input_cl, CL_TRUE, 0, yuv_buf_len * sizeof(float), net_input_buf, 0, NULL, NULL));
   } else {
-    auto [mirror_y, mirror_u, mirror_v] = get_yuv_buf(s->premirror_cropped_buf, crop_rect.w, crop_rect.h);
-    crop_yuv((uint8_t *)stream_buf, width, height, mirror_y, mirror_u, mirror_v, crop_rect);
-    libyuv::I420Mirror(mirror_y, crop_rect.w,
-                       mirror_u, crop_rect.w / 2,
-                       mirror_v, crop_rect.w / 2,
-                       cropped_y, crop_rect.w,
-                       cropped_u, crop_rect.w / 2,
-                       cropped_v, crop_rect.w / 2,
-                       crop_rect.w, crop_rect.h);
-  }
-
-  auto [resized_buf, resized_u, resized_v] = get_yuv_buf(s->resized_buf, resized_width, resized_height);
-  uint8_t *resized_y = resized_buf;
-  libyuv::FilterMode mode = libyuv::FilterModeEnum::kFilterBilinear;
-  libyuv::I420Scale(cropped_y, crop_rect.w,
-                    cropped_u, crop_rect.w / 2,
-                    cropped_v, crop_rect.w / 2,
-                    crop_rect.w, crop_rect.h,
-                    resized_y, resized_width,
-                    resized_u, resized_width / 2,
-                    resized_v, resized_width / 2,
-                    resized_width, resized_height,
-                    mode);
-
-  int yuv_buf_len = (MODEL_WIDTH/2) * (MODEL_HEIGHT/2) * 6; // Y|u|v -> y|y|y|y|u|v
-  float *net_input_buf = get_buffer(s->net_input_buf, yuv_buf_len);
-  // one shot conversion, O(n) anyway
-  // yuvframe2tensor, normalize
-  for (int r = 0; r < MODEL_HEIGHT/2; r++) {
-    for (int c = 0; c < MODEL_WIDTH/2; c++) {
-      // Y_ul
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (0*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r)*resized_width + 2*c]];
-      // Y_dl
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (1*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r+1)*resized_width + 2*c]];
-      // Y_ur
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (2*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r)*resized_width + 2*c+1]];
-      // Y_dr
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (3*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_y[(2*r+1)*resized_width + 2*c+1]];
-      // U
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (4*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_u[r*resized_width/2 + c]];
-      // V
-      net_input_buf[(r*MODEL_WIDTH/2) + c + (5*(MODEL_WIDTH/2)*(MODEL_HEIGHT/2))] = s->tensor[resized_v[r*resized_width/2 + c]];
-    }
+    uint8_t *raw_y = (uint8_t *)stream_buf;
+    uint8_t *raw_u = raw_y + (width * height);
+    uint8_t *raw_v = raw_u + ((width / 2) * (height / 2));
+
+    // the four y channels are the 2x2 subsampled pixels: ul, dl, ur, dr
+    resize_plane(s, raw_y, width, crop_rect, s->is_rhd, MODEL_WIDTH, MODEL_HEIGHT, true, [&](int r, int part) {
+      return net_input_buf + ((r & 1) + 2 * part) * plane_size + (r / 2) * (MODEL_WIDTH / 2);
+    });
+    resize_plane(s, raw_u, width / 2, crop_rect_uv, s->is_rhd, MODEL_WIDTH / 2, MODEL_HEIGHT / 2, false, [&](int r, int) {
+      return net_input_buf + 4 * plane_size + r * (MODEL_WIDTH / 2);
+    });
+    resize_plane(s, raw_v, width / 2, crop_rect_uv, s->is_rhd, MODEL_WIDTH / 2, MODEL_HEIGHT / 2, false, [&](int r, int) {
+      return net_input_buf + 5 * plane_size + r * (MODEL_WIDTH / 2);
+    });
   }
 
   //printf("preprocess completed. %d \n", yuv_buf_len);
@@ -197,4 +245,9 @@ void dmonitoring_publish(PubMaster &pm, uint32_t frame_id, const DMonitoringResu
 
 void dmonitoring_free(DMonitoringModelState* s) {
   delete s->m;
+  if (s->q != NULL) {
+    CL_CHECK(clReleaseMemObject(s->net_input_cl));
+    CL_CHECK(clReleaseKernel(s->resize_krnl));
+    CL_CHECK(clReleaseCommandQueue(s->q));
+  }
 }
@@ -0,0 +1,40 @@
+// Crops, optionally mirrors, bilinearly resizes and normalizes one plane of the driver frame.
+// One work item per output pixel, same fixed point math as resize_plane in dmonitoring.cc.
+__kernel void resize_plane(__global uchar const * const src,
+                           int src_offset,
+                           int stride,
+                           int crop_x,
+                           int crop_y,
+                           int crop_w,
+                           int crop_h,
+                           int mirror,
+                           __global float * out,
+                           int out_offset,
+                           int out_w,
+                           int out_h,
+                           int is_y)
+{
+  const int c = get_global_id(0);
+  const int r = get_global_id(1);
+
+  const int d = mirror ? out_w - 1 - c : c;
+  const int px = clamp(((2*d + 1) * crop_w * 256) / (2*out_w) - 128, 0, (crop_w - 1) * 256);
+  const int py = clamp(((2*r + 1) * crop_h * 256) / (2*out_h) - 128, 0, (crop_h - 1) * 256);
+  const int x0 = px >> 8, x1 = min(x0 + 1, crop_w - 1), fx = px & 0xff;
+  const int y0 = py >> 8, y1 = min(y0 + 1, crop_h - 1), fy = py & 0xff;
+
+  __global uchar const * const row0 = src + src_offset + (crop_y + y0) * stride + crop_x;
+  __global uchar const * const row1 = src + src_offset + (crop_y + y1) * stride + crop_x;
+  const int a0 = row0[x0] * (256 - fy) + row1[x0] * fy;
+  const int a1 = row0[x1] * (256 - fy) + row1[x1] * fy;
+  const int v = (a0 * (256 - fx) + a1 * fx + (1 << 15)) >> 16;
+  const float f = v * 0.0078125f - 1.0f;
+
+  if (is_y) {
+    // 2x2 subsampled y channels: ul, dl, ur, dr
+    const int ch = (r & 1) + 2 * (c & 1);
+    out[out_offset + ch * (out_w/2) * (out_h/2) + (r/2) * (out_w/2) + c/2] = f;
+  } else {
+    out[out_offset + r * out_w + c] = f;
+  }
+}
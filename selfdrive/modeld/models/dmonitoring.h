@@ -31,15 +31,19 @@ typedef struct DMonitoringModelState {
   RunModel *m;
   bool is_rhd;
   float output[OUTPUT_SIZE];
-  std::vector<uint8_t> resized_buf;
-  std::vector<uint8_t> cropped_buf;
-  std::vector<uint8_t> premirror_cropped_buf;
   std::vector<float> net_input_buf;
-  float tensor[UINT8_MAX + 1];
+  std::vector<uint16_t> row_buf;
+  std::vector<int> x_idx;
+  std::vector<uint16_t> x_frac;
+
+  // optional GPU preprocessing of the VisionBuf
+  cl_command_queue q = NULL;
+  cl_kernel resize_krnl = NULL;
+  cl_mem net_input_cl = NULL;
 } DMonitoringModelState;
 
-void dmonitoring_init(DMonitoringModelState* s);
-DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height);
+void dmonitoring_init(DMonitoringModelState* s, cl_device_id device_id = NULL, cl_context context = NULL);
+DMonitoringResult dmonitoring_eval_frame(DMonitoringModelState* s, void* stream_buf, int width, int height, cl_mem yuv_cl = NULL);
 void dmonitoring_publish(PubMaster &pm, uint32_t frame_id, const DMonitoringResult &res, float execution_time, kj::ArrayPtr<const float> raw_pred);
 void dmonitoring_free(DMonitoringModelState* s);
 
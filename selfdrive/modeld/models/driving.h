@@ -29,6 +29,8 @@ struct ModelDataRaw {
   float *meta;
   float *desire_pred;
   float *pose;
+  float prepare_time;
+  float execute_time;
 };
 
 typedef struct ModelState {
@@ -48,6 +50,7 @@ void model_init(ModelState* s, cl_device_id device_id, cl_context context);
 ModelDataRaw model_eval_frame(ModelState* s, cl_mem yuv_cl, int width, int height,
                            const mat3 &transform, float *desire_in);
 void model_free(ModelState* s);
+mat3 get_model_transform(const float *extrinsic_matrix, bool wide_camera);
 void poly_fit(float *in_pts, float *in_stds, float *out);
 void model_publish(PubMaster &pm, uint32_t vipc_frame_id, uint32_t frame_id, float frame_drop,
                    const ModelDataRaw &net_outputs, uint64_t timestamp_eof,
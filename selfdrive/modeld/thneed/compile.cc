@@ -28,8 +28,12 @@ int main(int argc, char* argv[]) {
   mdl.execute(input, 0);
 
   // save model
-  bool save_binaries = (argc > 3) && (strcmp(argv[3], "--binary") == 0);
-  mdl.thneed->save(argv[2], save_binaries);
+  if ((argc > 3) && (strcmp(argv[3], "--container") == 0)) {
+    mdl.thneed->save_container(argv[2]);
+  } else {
+    bool save_binaries = (argc > 3) && (strcmp(argv[3], "--binary") == 0);
+    mdl.thneed->save(argv[2], save_binaries);
+  }
   return 0;
 }
 
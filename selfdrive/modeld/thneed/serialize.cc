@@ -1,13 +1,36 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
 #include <cassert>
+#include <cstring>
+#include <map>
 #include <set>
 
 #include "json11.hpp"
+#include "selfdrive/common/util.h"
 #include "selfdrive/modeld/thneed/thneed.h"
 using namespace json11;
 
 extern map<cl_program, string> g_program_source;
 
+static string read_weights(cl_command_queue command_queue, cl_mem val, size_t sz) {
+  string buf(sz, '\x00');
+  // buffers allocated with CL_MEM_HOST_WRITE_ONLY, hence this hack
+  //hexdump((uint32_t*)val, 0x100);
+
+  // the worst hack in thneed, the flags are at 0x14
+  ((uint32_t*)val)[0x14] &= ~CL_MEM_HOST_WRITE_ONLY;
+  cl_int ret = clEnqueueReadBuffer(command_queue, val, CL_TRUE, 0, sz, buf.data(), 0, NULL, NULL);
+  assert(ret == CL_SUCCESS);
+  return buf;
+}
+
 void Thneed::load(const char *filename) {
+  if (load_container(filename)) return;
+
   printf("Thneed::load: loading from %s\n", filename);
 
   FILE *f = fopen(filename, "rb");
@@ -234,21 +257,9 @@ void Thneed::save(const char *filename, bool save_binaries) {
     cl_mem val = *(cl_mem*)(mobj["id"].string_value().data());
     int sz = mobj["size"].int_value();
     if (mobj["needs_load"].bool_value()) {
-      char *buf = (char *)malloc(sz);
-      if (mobj["arg_type"] == "image2d_t" || mobj["arg_type"] == "image1d_t") {
-        assert(false);
-      } else {
-        // buffers allocated with CL_MEM_HOST_WRITE_ONLY, hence this hack
-        //hexdump((uint32_t*)val, 0x100);
-
-        // the worst hack in thneed, the flags are at 0x14
-        ((uint32_t*)val)[0x14] &= ~CL_MEM_HOST_WRITE_ONLY;
-        cl_int ret = clEnqueueReadBuffer(command_queue, val, CL_TRUE, 0, sz, buf, 0, NULL, NULL);
-        assert(ret == CL_SUCCESS);
-      }
+      assert(mobj["arg_type"] != "image2d_t" && mobj["arg_type"] != "image1d_t");
       //printf("saving buffer: %d %p %s\n", sz, buf, mobj["arg_type"].string_value().c_str());
-      saved_buffers.push_back(string(buf, sz));
-      free(buf);
+      saved_buffers.push_back(read_weights(command_queue, val, sz));
     }
   }
 
@@ -289,3 +300,365 @@ Json CLQueuedKernel::to_json() const {
   };
 }
 
+
+// *********** binary container ***********
+// Everything needed to run the model is laid out so it can be mmaped and used in place:
+//   header | objects | programs | kernels | args | strings | (page aligned) data
+// Weights, program sources and binaries live in the data section, each blob page aligned
+// so the weight buffers can be created with CL_MEM_USE_HOST_PTR on top of the mapping.
+
+#define THNEED_CONTAINER_MAGIC 0x424e4854  // "THNB"
+#define THNEED_CONTAINER_VERSION 1
+#define THNEED_CONTAINER_ALIGN 0x1000
+#define THNEED_NO_DATA UINT64_MAX
+
+struct ContainerHeader {
+  uint32_t magic;
+  uint32_t version;
+  char device_key[256];  // device and driver the program binaries were built with
+  uint32_t num_objects, num_programs, num_kernels, num_args;
+  uint32_t meta_size;  // bytes after the header, up to the data section
+  uint32_t meta_crc;
+  uint32_t data_crc;  // only checked with THNEED_VERIFY, checking pages in defeats lazy mapping
+  uint32_t pad;
+  uint64_t data_offset, data_size;
+};
+
+enum ContainerObjectType : uint32_t { OBJECT_BUFFER, OBJECT_IMAGE2D, OBJECT_IMAGE1D };
+
+struct ContainerObject {
+  uint32_t type;
+  int32_t buffer;  // backing buffer object of an image
+  uint64_t size;
+  uint64_t data_offset;  // weights, relative to the data section
+  uint32_t width, height, row_pitch, pad;
+};
+
+struct ContainerProgram {
+  uint32_t name;  // offset in the string table
+  uint32_t pad;
+  uint64_t source_offset, source_size;
+  uint64_t binary_offset, binary_size;
+};
+
+struct ContainerKernel {
+  uint32_t name;
+  uint32_t program;
+  uint32_t work_dim;
+  uint32_t global_work_size[3], local_work_size[3];
+  uint32_t num_args;
+  uint32_t first_arg;
+};
+
+enum ContainerArgType : uint32_t { ARG_VALUE, ARG_MEM, ARG_LOCAL };
+
+struct ContainerArg {
+  uint32_t type;
+  uint32_t size;
+  int32_t object;  // for ARG_MEM, -1 is a NULL cl_mem
+  uint8_t value[20];
+};
+
+static string get_device_key(cl_device_id device_id) {
+  char name[128] = {}, driver[128] = {};
+  clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+  clGetDeviceInfo(device_id, CL_DRIVER_VERSION, sizeof(driver) - 1, driver, NULL);
+  return string(name) + " " + driver;
+}
+
+static cl_program build_program(cl_context context, cl_device_id device_id, const string &device_key,
+                                const char *name, const char *source, size_t source_size,
+                                const uint8_t *binary, size_t binary_size) {
+  cl_int err;
+  cl_program program = NULL;
+  if (binary_size > 0) {
+    program = clCreateProgramWithBinary(context, 1, &device_id, &binary_size, &binary, NULL, &err);
+    if (program != NULL && err == CL_SUCCESS && clBuildProgram(program, 1, &device_id, "", NULL, NULL) == CL_SUCCESS) {
+      return program;
+    }
+    if (program != NULL) clReleaseProgram(program);
+  }
+
+  // binary is from another driver, look for one we compiled before
+  assert(source_size > 0);
+  char cache_name[64];
+  uint32_t key_crc = crc32(0, (const Bytef *)device_key.data(), device_key.size());
+  snprintf(cache_name, sizeof(cache_name), "/%08x%08lx.bin", key_crc, crc32(key_crc, (const Bytef *)source, source_size));
+  const string cache_path = util::getenv("THNEED_CACHE_DIR", "/data/thneed_cache") + cache_name;
+
+  string cached = util::read_file(cache_path);
+  if (cached.size() > 0) {
+    const uint8_t *cached_binary = (const uint8_t *)cached.data();
+    size_t cached_size = cached.size();
+    program = clCreateProgramWithBinary(context, 1, &device_id, &cached_size, &cached_binary, NULL, &err);
+    if (program != NULL && err == CL_SUCCESS && clBuildProgram(program, 1, &device_id, "", NULL, NULL) == CL_SUCCESS) {
+      return program;
+    }
+    if (program != NULL) clReleaseProgram(program);
+  }
+
+  printf("Thneed::load: compiling %s\n", name);
+  program = clCreateProgramWithSource(context, 1, &source, &source_size, &err);
+  assert(program != NULL && err == CL_SUCCESS);
+  err = clBuildProgram(program, 1, &device_id, "", NULL, NULL);
+  assert(err == CL_SUCCESS);
+
+  size_t size = 0;
+  err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL);
+  if (err == CL_SUCCESS && size > 0) {
+    string out(size, '\x00');
+    uint8_t *bufs[1] = { (uint8_t *)out.data() };
+    if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(bufs), &bufs, NULL) == CL_SUCCESS) {
+      mkdir(util::dir_name(cache_path).c_str(), 0775);
+      util::write_file(cache_path.c_str(), out.data(), out.size(), O_WRONLY | O_CREAT | O_TRUNC);
+    }
+  }
+  return program;
+}
+
+bool Thneed::load_container(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  assert(fd >= 0);
+  struct stat st;
+  fstat(fd, &st);
+
+  uint32_t magic = 0;
+  if (st.st_size < (off_t)sizeof(ContainerHeader) || pread(fd, &magic, sizeof(magic), 0) != sizeof(magic) ||
+      magic != THNEED_CONTAINER_MAGIC) {
+    close(fd);
+    return false;
+  }
+
+  printf("Thneed::load_container: mapping %s\n", filename);
+  // private writable mapping, the GPU never writes the weights so no pages are copied
+  container_size = st.st_size;
+  container = mmap(NULL, container_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  assert(container != MAP_FAILED);
+
+  const uint8_t *base = (const uint8_t *)container;
+  const ContainerHeader *hdr = (const ContainerHeader *)base;
+  assert(hdr->version == THNEED_CONTAINER_VERSION);
+  assert(sizeof(ContainerHeader) + hdr->meta_size <= hdr->data_offset);
+  assert(hdr->data_offset + hdr->data_size <= container_size);
+  assert(crc32(0, base + sizeof(ContainerHeader), hdr->meta_size) == hdr->meta_crc);
+  if (getenv("THNEED_VERIFY")) {
+    assert(crc32(0, base + hdr->data_offset, hdr->data_size) == hdr->data_crc);
+  }
+
+  const ContainerObject *objects = (const ContainerObject *)(base + sizeof(ContainerHeader));
+  const ContainerProgram *programs = (const ContainerProgram *)(objects + hdr->num_objects);
+  const ContainerKernel *kernels = (const ContainerKernel *)(programs + hdr->num_programs);
+  const ContainerArg *args = (const ContainerArg *)(kernels + hdr->num_kernels);
+  const char *strings = (const char *)(args + hdr->num_args);
+  uint8_t *data = (uint8_t *)container + hdr->data_offset;
+
+  vector<cl_mem> real_mem(hdr->num_objects, NULL);
+  for (int i = 0; i < hdr->num_objects; i++) {
+    const ContainerObject &obj = objects[i];
+    cl_mem clbuf = NULL;
+
+    if (obj.type == OBJECT_BUFFER) {
+      if (obj.data_offset != THNEED_NO_DATA) {
+        clbuf = clCreateBuffer(context, CL_MEM_USE_HOST_PTR | CL_MEM_READ_WRITE, obj.size, data + obj.data_offset, NULL);
+      } else {
+        clbuf = clCreateBuffer(context, CL_MEM_READ_WRITE, obj.size, NULL, NULL);
+      }
+    } else {
+      // image buffer must already be allocated
+      assert(obj.buffer >= 0 && obj.buffer < i);
+      cl_image_desc desc = {0};
+      desc.image_type = (obj.type == OBJECT_IMAGE2D) ? CL_MEM_OBJECT_IMAGE2D : CL_MEM_OBJECT_IMAGE1D_BUFFER;
+      desc.image_width = obj.width;
+      desc.image_height = obj.height;
+      desc.image_row_pitch = obj.row_pitch;
+      desc.buffer = real_mem[obj.buffer];
+
+      cl_image_format format;
+      format.image_channel_order = CL_RGBA;
+      format.image_channel_data_type = CL_HALF_FLOAT;
+
+      clbuf = clCreateImage(context, CL_MEM_READ_WRITE, &format, &desc, NULL, NULL);
+    }
+    assert(clbuf != NULL);
+    real_mem[i] = clbuf;
+  }
+
+  const string device_key = get_device_key(device_id);
+  const bool same_device = device_key == hdr->device_key;
+  if (!same_device) {
+    printf("Thneed::load_container: built for \"%s\", running on \"%s\"\n", hdr->device_key, device_key.c_str());
+  }
+
+  vector<cl_program> real_programs(hdr->num_programs);
+  for (int i = 0; i < hdr->num_programs; i++) {
+    const ContainerProgram &prg = programs[i];
+    real_programs[i] = build_program(context, device_id, device_key, strings + prg.name,
+                                     (const char *)data + prg.source_offset, prg.source_size,
+                                     data + prg.binary_offset, same_device ? prg.binary_size : 0);
+  }
+
+  for (int i = 0; i < hdr->num_kernels; i++) {
+    const ContainerKernel &k = kernels[i];
+    auto kk = shared_ptr<CLQueuedKernel>(new CLQueuedKernel(this));
+    kk->name = strings + k.name;
+    kk->program = real_programs[k.program];
+    kk->work_dim = k.work_dim;
+    for (int j = 0; j < k.work_dim; j++) {
+      kk->global_work_size[j] = k.global_work_size[j];
+      kk->local_work_size[j] = k.local_work_size[j];
+    }
+    kk->num_args = k.num_args;
+    for (int j = 0; j < k.num_args; j++) {
+      const ContainerArg &arg = args[k.first_arg + j];
+      kk->args_size.push_back(arg.size);
+      if (arg.type == ARG_MEM) {
+        cl_mem val = arg.object >= 0 ? real_mem[arg.object] : NULL;
+        kk->args.push_back(string((char*)&val, sizeof(val)));
+      } else if (arg.type == ARG_VALUE) {
+        kk->args.push_back(string((const char *)arg.value, arg.size));
+      } else {
+        kk->args.push_back(string());
+      }
+    }
+    kq.push_back(kk);
+  }
+
+  clFinish(command_queue);
+  return true;
+}
+
+void Thneed::save_container(const char *filename) {
+  printf("Thneed::save_container: saving to %s\n", filename);
+
+  vector<ContainerObject> objects;
+  vector<ContainerProgram> programs;
+  vector<ContainerKernel> kernels;
+  vector<ContainerArg> args;
+  string strings, data;
+  map<cl_mem, int> object_idx;
+  map<cl_program, int> program_idx;
+
+  auto add_string = [&](const string &s) {
+    uint32_t offset = strings.size();
+    strings.append(s.c_str(), s.size() + 1);
+    return offset;
+  };
+  auto add_data = [&](const string &s) {
+    data.resize((data.size() + THNEED_CONTAINER_ALIGN - 1) & ~(THNEED_CONTAINER_ALIGN - 1));
+    uint64_t offset = data.size();
+    data += s;
+    return offset;
+  };
+  auto add_buffer = [&](cl_mem val, bool needs_load) {
+    if (object_idx.count(val)) return object_idx[val];
+    size_t sz = 0;
+    clGetMemObjectInfo(val, CL_MEM_SIZE, sizeof(sz), &sz, NULL);
+    ContainerObject obj = {OBJECT_BUFFER, -1, sz, THNEED_NO_DATA};
+    if (needs_load) obj.data_offset = add_data(read_weights(command_queue, val, sz));
+    objects.push_back(obj);
+    return object_idx[val] = objects.size() - 1;
+  };
+
+  for (auto &k : kq) {
+    if (program_idx.count(k->program) == 0) {
+      ContainerProgram prg = {add_string(k->name)};
+      if (g_program_source.count(k->program)) {
+        const string &src = g_program_source[k->program];
+        prg.source_offset = add_data(src);
+        prg.source_size = src.size();
+      }
+
+      size_t binary_size = 0;
+      cl_int err = clGetProgramInfo(k->program, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL);
+      assert(err == CL_SUCCESS);
+      if (binary_size > 0) {
+        string sv(binary_size, '\x00');
+        uint8_t* bufs[1] = { (uint8_t*)sv.data(), };
+        err = clGetProgramInfo(k->program, CL_PROGRAM_BINARIES, sizeof(bufs), &bufs, NULL);
+        assert(err == CL_SUCCESS);
+        prg.binary_offset = add_data(sv);
+        prg.binary_size = binary_size;
+      }
+      assert(prg.source_size > 0 || prg.binary_size > 0);
+      programs.push_back(prg);
+      program_idx[k->program] = programs.size() - 1;
+    }
+
+    ContainerKernel ck = {add_string(k->name), (uint32_t)program_idx[k->program], k->work_dim};
+    for (int i = 0; i < k->work_dim; i++) {
+      ck.global_work_size[i] = k->global_work_size[i];
+      ck.local_work_size[i] = k->local_work_size[i];
+    }
+    ck.num_args = k->num_args;
+    ck.first_arg = args.size();
+
+    for (int i = 0; i < k->num_args; i++) {
+      const string &a = k->args[i];
+      ContainerArg arg = {ARG_VALUE, (uint32_t)k->args_size[i], -1};
+      if (a.size() == 0) {
+        arg.type = ARG_LOCAL;
+      } else if (a.size() == 8) {
+        // same as the json format, 8 byte args are cl_mems
+        arg.type = ARG_MEM;
+        cl_mem val = *(cl_mem*)(a.data());
+        if (val != NULL) {
+          bool needs_load = k->arg_names[i] == "weights" || k->arg_names[i] == "biases";
+          if (k->arg_types[i] == "image2d_t" || k->arg_types[i] == "image1d_t") {
+            if (object_idx.count(val) == 0) {
+              cl_mem buf;
+              clGetImageInfo(val, CL_IMAGE_BUFFER, sizeof(buf), &buf, NULL);
+              ContainerObject obj = {k->arg_types[i] == "image2d_t" ? OBJECT_IMAGE2D : OBJECT_IMAGE1D,
+                                     add_buffer(buf, needs_load), 0, THNEED_NO_DATA};
+              size_t width, height, row_pitch;
+              clGetImageInfo(val, CL_IMAGE_WIDTH, sizeof(width), &width, NULL);
+              clGetImageInfo(val, CL_IMAGE_HEIGHT, sizeof(height), &height, NULL);
+              clGetImageInfo(val, CL_IMAGE_ROW_PITCH, sizeof(row_pitch), &row_pitch, NULL);
+              obj.width = width;
+              obj.height = height;
+              obj.row_pitch = row_pitch;
+              obj.size = height * row_pitch;
+              objects.push_back(obj);
+              object_idx[val] = objects.size() - 1;
+            }
+            arg.object = object_idx[val];
+          } else {
+            arg.object = add_buffer(val, needs_load);
+          }
+        }
+      } else {
+        assert(a.size() <= sizeof(arg.value));
+        memcpy(arg.value, a.data(), a.size());
+      }
+      args.push_back(arg);
+    }
+    kernels.push_back(ck);
+  }
+
+  string meta;
+  meta.append((const char *)objects.data(), objects.size() * sizeof(ContainerObject));
+  meta.append((const char *)programs.data(), programs.size() * sizeof(ContainerProgram));
+  meta.append((const char *)kernels.data(), kernels.size() * sizeof(ContainerKernel));
+  meta.append((const char *)args.data(), args.size() * sizeof(ContainerArg));
+  meta.append(strings);
+
+  ContainerHeader hdr = {THNEED_CONTAINER_MAGIC, THNEED_CONTAINER_VERSION};
+  strncpy(hdr.device_key, get_device_key(device_id).c_str(), sizeof(hdr.device_key) - 1);
+  hdr.num_objects = objects.size();
+  hdr.num_programs = programs.size();
+  hdr.num_kernels = kernels.size();
+  hdr.num_args = args.size();
+  hdr.meta_size = meta.size();
+  hdr.meta_crc = crc32(0, (const Bytef *)meta.data(), meta.size());
+  hdr.data_offset = (sizeof(hdr) + meta.size() + THNEED_CONTAINER_ALIGN - 1) & ~(THNEED_CONTAINER_ALIGN - 1);
+  hdr.data_size = data.size();
+  hdr.data_crc = crc32(0, (const Bytef *)data.data(), data.size());
+
+  FILE *f = fopen(filename, "wb");
+  assert(f != NULL);
+  fwrite(&hdr, 1, sizeof(hdr), f);
+  fwrite(meta.data(), 1, meta.size(), f);
+  fseek(f, hdr.data_offset, SEEK_SET);
+  fwrite(data.data(), 1, data.size(), f);
+  fclose(f);
+}
@@ -0,0 +1,44 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/modeld/thneed/thneed.h"
+
+// Measures how long it takes from process start until the first thneed execution.
+//   ./startup_bench <model.thneed> [--cold]
+// --cold drops the page cache first (needs root), like the first modeld start after ignition
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    printf("usage: %s <model.thneed> [--cold]\n", argv[0]);
+    return 1;
+  }
+
+  if ((argc > 2) && (strcmp(argv[2], "--cold") == 0)) {
+    sync();
+    FILE *f = fopen("/proc/sys/vm/drop_caches", "w");
+    if (f == NULL) {
+      printf("can't drop caches, run as root\n");
+      return 1;
+    }
+    fputs("3", f);
+    fclose(f);
+  }
+
+  double t1 = millis_since_boot();
+  Thneed thneed(true);
+  thneed.record = 0;
+  double t2 = millis_since_boot();
+  thneed.load(argv[1]);
+  double t3 = millis_since_boot();
+  thneed.clexec();
+  clFinish(thneed.command_queue);
+  double t4 = millis_since_boot();
+
+  printf("clinit: %7.2f ms\n", t2 - t1);
+  printf("load:   %7.2f ms\n", t3 - t2);
+  printf("exec:   %7.2f ms\n", t4 - t3);
+  printf("total:  %7.2f ms\n", t4 - t1);
+  return 0;
+}
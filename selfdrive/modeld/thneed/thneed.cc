@@ -226,6 +226,10 @@ Thneed::Thneed(bool do_clinit) {
   g_thneed = this;
 }
 
+Thneed::~Thneed() {
+  if (container != NULL) munmap(container, container_size);
+}
+
 void Thneed::stop() {
   find_inputs_outputs();
   printf("Thneed::stop: recorded %lu commands\n", cmds.size());
@@ -93,6 +93,7 @@ class CachedCommand: public CachedIoctl {
 class Thneed {
   public:
     Thneed(bool do_clinit=false);
+    ~Thneed();
     void stop();
     void execute(float **finputs, float *foutput, bool slow=false);
     void wait();
@@ -128,7 +129,13 @@ class Thneed {
     // loading and saving
     void load(const char *filename);
     void save(const char *filename, bool save_binaries=false);
+    void save_container(const char *filename);
   private:
     void clinit();
+    bool load_container(const char *filename);
+
+    // the mmaped container backs the weight buffers, so it lives as long as the Thneed
+    void *container = NULL;
+    size_t container_size = 0;
 };
 
@@ -1,21 +1,48 @@
 
 #include <sys/resource.h>
 
+#include <sstream>
+
 #include "selfdrive/common/util.h"
 #include "selfdrive/proclogd/proclog.h"
 
+const int PROCLOG_INTERVAL_MS = 2000;
+const int THREAD_SAMPLE_INTERVAL_MS = 50;
+
 ExitHandler do_exit;
 
 int main(int argc, char **argv) {
   setpriority(PRIO_PROCESS, 0, -15);
 
+  // the sampler keeps a file open per process
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  // threads of these processes are sampled every THREAD_SAMPLE_INTERVAL_MS, e.g. PROCLOG_PROFILE=camerad,controlsd
+  std::vector<std::string> profiled;
+  std::istringstream names(util::getenv("PROCLOG_PROFILE"));
+  for (std::string name; std::getline(names, name, ',');) {
+    if (!name.empty()) profiled.push_back(name);
+  }
+
+  ProcSampler sampler(profiled);
+  const int interval = sampler.profiling() ? THREAD_SAMPLE_INTERVAL_MS : PROCLOG_INTERVAL_MS;
+
   PubMaster publisher({"procLog"});
-  while (!do_exit) {
-    MessageBuilder msg;
-    buildProcLogMessage(msg);
-    publisher.send("procLog", msg);
+  for (int frame = 0; !do_exit; frame++) {
+    if (sampler.profiling()) {
+      sampler.sampleThreads();
+    }
+    if (frame % (PROCLOG_INTERVAL_MS / interval) == 0) {
+      MessageBuilder msg;
+      sampler.buildProcLogMessage(msg, sampler.profiling() ? interval / 1000. : 0);
+      publisher.send("procLog", msg);
+    }
 
-    util::sleep_for(2000);  // 2 secs
+    util::sleep_for(interval);
   }
 
   return 0;
@@ -1,43 +1,109 @@
 #include "selfdrive/proclogd/proclog.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#include <cassert>
-#include <fstream>
-#include <iterator>
-#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <type_traits>
 
 #include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 
+namespace {
+
+// parse a decimal integer token
+template <typename T>
+bool parse(std::string_view token, T &val) {
+  bool neg = !token.empty() && token[0] == '-';
+  if (neg && std::is_unsigned_v<T>) return false;
+
+  size_t i = neg;
+  if (i == token.size()) return false;
+  T v = 0;
+  for (; i < token.size(); i++) {
+    char c = token[i];
+    if (c < '0' || c > '9') return false;
+    v = v * 10 + (c - '0');
+  }
+  val = neg ? -v : v;
+  return true;
+}
+
+// whitespace separated tokens of a string, without copying
+class Tokenizer {
+public:
+  Tokenizer(std::string_view s) : s(s) {}
+
+  std::string_view next() {
+    while (pos < s.size() && isspace(s[pos])) pos++;
+    size_t start = pos;
+    while (pos < s.size() && !isspace(s[pos])) pos++;
+    return s.substr(start, pos - start);
+  }
+
+  template <typename T>
+  bool next(T &val) { return parse(next(), val); }
+
+  void skipLine() {
+    pos = s.find('\n', pos);
+    pos = pos == std::string_view::npos ? s.size() : pos + 1;
+  }
+
+private:
+  std::string_view s;
+  size_t pos = 0;
+};
+
+}  // namespace
+
 namespace Parser {
 
 // parse /proc/stat
-std::vector<CPUTime> cpuTimes(std::istream &stream) {
+std::vector<CPUTime> cpuTimes(std::string_view stat) {
   std::vector<CPUTime> cpu_times;
-  std::string line;
+  Tokenizer tok(stat);
   // skip the first line for cpu total
-  std::getline(stream, line);
-  while (std::getline(stream, line)) {
-    if (line.compare(0, 3, "cpu") != 0) break;
+  tok.skipLine();
+  while (true) {
+    std::string_view name = tok.next();
+    if (name.size() <= 3 || name.compare(0, 3, "cpu") != 0) break;
 
     CPUTime t = {};
-    std::istringstream iss(line);
-    if (iss.ignore(3) >> t.id >> t.utime >> t.ntime >> t.stime >> t.itime >> t.iowtime >> t.irqtime >> t.sirqtime)
+    if (parse(name.substr(3), t.id) && tok.next(t.utime) && tok.next(t.ntime) && tok.next(t.stime) &&
+        tok.next(t.itime) && tok.next(t.iowtime) && tok.next(t.irqtime) && tok.next(t.sirqtime)) {
       cpu_times.push_back(t);
+    }
+    tok.skipLine();
   }
   return cpu_times;
 }
 
 // parse /proc/meminfo
-std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream) {
-  std::unordered_map<std::string, uint64_t> mem_info;
-  std::string line, key;
-  while (std::getline(stream, line)) {
-    uint64_t val = 0;
-    std::istringstream iss(line);
-    if (iss >> key >> val) {
-      mem_info[key] = val * 1024;
+MemInfo memInfo(std::string_view meminfo) {
+  const std::pair<std::string_view, uint64_t MemInfo::*> fields[] = {
+    {"MemTotal:", &MemInfo::total},
+    {"MemFree:", &MemInfo::free},
+    {"MemAvailable:", &MemInfo::available},
+    {"Buffers:", &MemInfo::buffers},
+    {"Cached:", &MemInfo::cached},
+    {"Active:", &MemInfo::active},
+    {"Inactive:", &MemInfo::inactive},
+    {"Shmem:", &MemInfo::shared},
+  };
+
+  MemInfo mem_info = {};
+  Tokenizer tok(meminfo);
+  for (std::string_view key = tok.next(); !key.empty(); tok.skipLine(), key = tok.next()) {
+    for (auto &[name, field] : fields) {
+      uint64_t val = 0;
+      if (key == name && tok.next(val)) {
+        mem_info.*field = val * 1024;
+        break;
+      }
     }
   }
   return mem_info;
@@ -63,63 +129,67 @@ enum StatPos {
 };
 
 // parse /proc/pid/stat
-std::optional<ProcStat> procStat(std::string stat) {
+std::optional<ProcStat> procStat(std::string_view stat) {
   // To avoid being fooled by names containing a closing paren, scan backwards.
   auto open_paren = stat.find('(');
   auto close_paren = stat.rfind(')');
-  if (open_paren == std::string::npos || close_paren == std::string::npos || open_paren > close_paren) {
+  if (open_paren == std::string_view::npos || close_paren == std::string_view::npos || open_paren > close_paren) {
     return std::nullopt;
   }
 
-  std::string name = stat.substr(open_paren + 1, close_paren - open_paren - 1);
-  // repace space in name with _
-  std::replace(&stat[open_paren], &stat[close_paren], ' ', '_');
-  std::istringstream iss(stat);
-  std::vector<std::string> v{std::istream_iterator<std::string>(iss),
-                             std::istream_iterator<std::string>()};
-  try {
-    if (v.size() != StatPos::MAX_FIELD) {
-      throw std::invalid_argument("stat");
-    }
-    ProcStat p = {
-      .name = name,
-      .pid = stoi(v[StatPos::pid - 1]),
-      .state = v[StatPos::state - 1][0],
-      .ppid = stoi(v[StatPos::ppid - 1]),
-      .utime = stoul(v[StatPos::utime - 1]),
-      .stime = stoul(v[StatPos::stime - 1]),
-      .cutime = stol(v[StatPos::cutime - 1]),
-      .cstime = stol(v[StatPos::cstime - 1]),
-      .priority = stol(v[StatPos::priority - 1]),
-      .nice = stol(v[StatPos::nice - 1]),
-      .num_threads = stol(v[StatPos::num_threads - 1]),
-      .starttime = stoull(v[StatPos::starttime - 1]),
-      .vms = stoul(v[StatPos::vsize - 1]),
-      .rss = stoul(v[StatPos::rss - 1]),
-      .processor = stoi(v[StatPos::processor - 1]),
-    };
-    return p;
-  } catch (const std::invalid_argument &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
-  } catch (const std::out_of_range &e) {
-    LOGE("failed to parse procStat (%s) :%s", e.what(), stat.c_str());
+  std::string_view v[StatPos::MAX_FIELD];
+  v[StatPos::pid - 1] = Tokenizer(stat.substr(0, open_paren)).next();
+  v[1] = stat.substr(open_paren + 1, close_paren - open_paren - 1);
+  int n = 2;
+  Tokenizer tok(stat.substr(close_paren + 1));
+  for (std::string_view t = tok.next(); !t.empty() && n <= StatPos::MAX_FIELD; t = tok.next()) {
+    if (n < StatPos::MAX_FIELD) v[n] = t;
+    n++;
+  }
+
+  ProcStat p = {};
+  bool ok = n == StatPos::MAX_FIELD && !v[StatPos::state - 1].empty() &&
+            parse(v[StatPos::pid - 1], p.pid) &&
+            parse(v[StatPos::ppid - 1], p.ppid) &&
+            parse(v[StatPos::utime - 1], p.utime) &&
+            parse(v[StatPos::stime - 1], p.stime) &&
+            parse(v[StatPos::cutime - 1], p.cutime) &&
+            parse(v[StatPos::cstime - 1], p.cstime) &&
+            parse(v[StatPos::priority - 1], p.priority) &&
+            parse(v[StatPos::nice - 1], p.nice) &&
+            parse(v[StatPos::num_threads - 1], p.num_threads) &&
+            parse(v[StatPos::starttime - 1], p.starttime) &&
+            parse(v[StatPos::vsize - 1], p.vms) &&
+            parse(v[StatPos::rss - 1], p.rss) &&
+            parse(v[StatPos::processor - 1], p.processor);
+  if (!ok) {
+    LOGE("failed to parse procStat :%.*s", (int)stat.size(), stat.data());
+    return std::nullopt;
+  }
+  p.state = v[StatPos::state - 1][0];
+  p.name = v[1];
+  return p;
+}
+
+// parse /proc/pid/schedstat, returns the time spent on the cpu in ns
+std::optional<uint64_t> schedRunTime(std::string_view schedstat) {
+  uint64_t run_ns = 0;
+  if (Tokenizer(schedstat).next(run_ns)) {
+    return run_ns;
   }
   return std::nullopt;
 }
 
-// return list of PIDs from /proc
-std::vector<int> pids() {
+// return list of PIDs from /proc, or of the thread ids from /proc/pid/task
+std::vector<int> pids(const std::string &dir) {
   std::vector<int> ids;
-  DIR *d = opendir("/proc");
-  assert(d);
-  char *p_end;
+  DIR *d = opendir(dir.c_str());
+  if (!d) return ids;
   struct dirent *de = NULL;
   while ((de = readdir(d))) {
-    if (de->d_type == DT_DIR) {
-      int pid = strtol(de->d_name, &p_end, 10);
-      if (p_end == (de->d_name + strlen(de->d_name))) {
-        ids.push_back(pid);
-      }
+    int pid = 0;
+    if (de->d_type == DT_DIR && parse(std::string_view(de->d_name), pid)) {
+      ids.push_back(pid);
     }
   }
   closedir(d);
@@ -127,13 +197,14 @@ std::vector<int> pids() {
 }
 
 // null-delimited cmdline arguments to vector
-std::vector<std::string> cmdline(std::istream &stream) {
+std::vector<std::string> cmdline(std::string_view cmdline) {
   std::vector<std::string> ret;
-  std::string line;
-  while (std::getline(stream, line, '\0')) {
-    if (!line.empty()) {
-      ret.push_back(line);
+  while (!cmdline.empty()) {
+    size_t end = std::min(cmdline.find('\0'), cmdline.size());
+    if (end > 0) {
+      ret.emplace_back(cmdline.substr(0, end));
     }
+    cmdline.remove_prefix(std::min(end + 1, cmdline.size()));
   }
   return ret;
 }
@@ -146,8 +217,7 @@ const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
     cache.name = name;
     std::string proc_path = "/proc/" + std::to_string(pid);
     cache.exe = util::readlink(proc_path + "/exe");
-    std::ifstream stream(proc_path + "/cmdline");
-    cache.cmdline = cmdline(stream);
+    cache.cmdline = cmdline(util::read_file(proc_path + "/cmdline"));
   }
   return cache;
 }
@@ -157,9 +227,31 @@ const ProcCache &getProcExtraInfo(int pid, const std::string &name) {
 const double jiffy = sysconf(_SC_CLK_TCK);
 const size_t page_size = sysconf(_SC_PAGE_SIZE);
 
-void buildCPUTimes(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/stat");
-  std::vector<CPUTime> stats = Parser::cpuTimes(stream);
+ProcFile::ProcFile(const std::string &path) : fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+
+ProcFile::~ProcFile() {
+  if (fd >= 0) close(fd);
+}
+
+std::string_view ProcFile::read(std::string &buf) {
+  if (fd < 0) return {};
+  if (buf.size() < 4096) buf.resize(4096);
+  while (true) {
+    ssize_t n = pread(fd, buf.data(), buf.size(), 0);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return {};
+    }
+    if (n < buf.size()) return std::string_view(buf.data(), n);
+    buf.resize(buf.size() * 2);
+  }
+}
+
+ProcSampler::ProcSampler(const std::vector<std::string> &profiled)
+    : profiled(profiled), stat_file("/proc/stat"), meminfo_file("/proc/meminfo") {}
+
+void ProcSampler::buildCPUTimes(cereal::ProcLog::Builder &builder) {
+  std::vector<CPUTime> stats = Parser::cpuTimes(stat_file.read(buf));
 
   auto log_cpu_times = builder.initCpuTimes(stats.size());
   for (int i = 0; i < stats.size(); ++i) {
@@ -176,32 +268,103 @@ void buildCPUTimes(cereal::ProcLog::Builder &builder) {
   }
 }
 
-void buildMemInfo(cereal::ProcLog::Builder &builder) {
-  std::ifstream stream("/proc/meminfo");
-  auto mem_info = Parser::memInfo(stream);
+void ProcSampler::buildMemInfo(cereal::ProcLog::Builder &builder) {
+  MemInfo mem_info = Parser::memInfo(meminfo_file.read(buf));
 
   auto mem = builder.initMem();
-  mem.setTotal(mem_info["MemTotal:"]);
-  mem.setFree(mem_info["MemFree:"]);
-  mem.setAvailable(mem_info["MemAvailable:"]);
-  mem.setBuffers(mem_info["Buffers:"]);
-  mem.setCached(mem_info["Cached:"]);
-  mem.setActive(mem_info["Active:"]);
-  mem.setInactive(mem_info["Inactive:"]);
-  mem.setShared(mem_info["Shmem:"]);
+  mem.setTotal(mem_info.total);
+  mem.setFree(mem_info.free);
+  mem.setAvailable(mem_info.available);
+  mem.setBuffers(mem_info.buffers);
+  mem.setCached(mem_info.cached);
+  mem.setActive(mem_info.active);
+  mem.setInactive(mem_info.inactive);
+  mem.setShared(mem_info.shared);
 }
 
-void buildProcs(cereal::ProcLog::Builder &builder) {
+bool ProcSampler::isProfiled(const ProcStat &stat, const ProcCache &extra_info) const {
+  for (const std::string &name : profiled) {
+    if (stat.name == name) return true;
+    for (const std::string &arg : extra_info.cmdline) {
+      if (arg.find(name) != std::string::npos) return true;
+    }
+  }
+  return false;
+}
+
+void ProcSampler::updateProfiledThreads(int pid, ProfiledProc &proc) {
+  std::string task_path = "/proc/" + std::to_string(pid) + "/task/";
+  std::vector<int> tids = Parser::pids(task_path);
+  std::sort(tids.begin(), tids.end());
+
+  for (auto it = proc.threads.begin(); it != proc.threads.end();) {
+    it = std::binary_search(tids.begin(), tids.end(), it->first) ? std::next(it) : proc.threads.erase(it);
+  }
+  for (int tid : tids) {
+    ProfiledThread &t = proc.threads[tid];
+    if (!t.stat) {
+      std::string path = task_path + std::to_string(tid);
+      t.tid = tid;
+      t.stat = std::make_unique<ProcFile>(path + "/stat");
+      t.schedstat = std::make_unique<ProcFile>(path + "/schedstat");
+    }
+  }
+}
+
+void ProcSampler::sampleThreads() {
+  for (auto &[pid, proc] : profiled_procs) {
+    for (auto &[tid, t] : proc.threads) {
+      uint64_t now = nanos_since_boot();
+      std::optional<uint64_t> run_ns;
+      if (t.schedstat->valid()) {
+        run_ns = Parser::schedRunTime(t.schedstat->read(buf));
+      } else if (auto stat = Parser::procStat(t.stat->read(buf))) {
+        // kernels without schedstat, only jiffy resolution
+        run_ns = (uint64_t)((stat->utime + stat->stime) * (1e9 / jiffy));
+      }
+      if (!run_ns) continue;
+
+      if (t.last_sample_ns) {
+        t.usage.push_back(float(*run_ns - t.last_run_ns) / (now - t.last_sample_ns));
+      }
+      t.last_run_ns = *run_ns;
+      t.last_sample_ns = now;
+    }
+  }
+}
+
+void ProcSampler::buildProcs(cereal::ProcLog::Builder &builder, float thread_sample_interval) {
   auto pids = Parser::pids();
-  std::vector<ProcStat> proc_stats;
-  proc_stats.reserve(pids.size());
+  std::sort(pids.begin(), pids.end());
+
+  // close the files of exited processes
+  for (auto it = proc_files.begin(); it != proc_files.end();) {
+    it = std::binary_search(pids.begin(), pids.end(), it->first) ? std::next(it) : proc_files.erase(it);
+  }
+
+  proc_stats.clear();
   for (int pid : pids) {
-    std::string path = "/proc/" + std::to_string(pid) + "/stat";
-    if (auto stat = Parser::procStat(util::read_file(path))) {
-      proc_stats.push_back(*stat);
+    std::string_view stat;
+    auto &file = proc_files[pid];
+    if (file) stat = file->read(buf);
+    if (stat.empty()) {
+      // first sample, or the pid was reused
+      std::string path = "/proc/" + std::to_string(pid) + "/stat";
+      file = std::make_unique<ProcFile>(path);
+      stat = file->read(buf);
+    }
+    if (!file->valid()) {
+      // retried on the next sample
+      proc_files.erase(pid);
+    }
+    if (auto s = Parser::procStat(stat)) {
+      proc_stats.push_back(*s);
     }
   }
 
+  std::unordered_map<int, ProfiledProc> prev_profiled;
+  prev_profiled.swap(profiled_procs);
+
   auto procs = builder.initProcs(proc_stats.size());
   for (size_t i = 0; i < proc_stats.size(); i++) {
     auto l = procs[i];
@@ -228,12 +391,50 @@ void buildProcs(cereal::ProcLog::Builder &builder) {
     for (size_t i = 0; i < lcmdline.size(); i++) {
       lcmdline.set(i, extra_info.cmdline[i]);
     }
+
+    if (!profiling() || !isProfiled(r, extra_info)) continue;
+
+    // keep the threads sampled so far, unless the pid was reused
+    ProfiledProc &proc = profiled_procs[r.pid];
+    if (auto it = prev_profiled.find(r.pid); it != prev_profiled.end() && it->second.name == r.name) {
+      proc = std::move(it->second);
+    }
+    proc.name = r.name;
+
+    std::vector<std::pair<const ProfiledThread *, ProcStat>> thread_stats;
+    for (auto &[tid, t] : proc.threads) {
+      if (auto stat = Parser::procStat(t.stat->read(buf))) {
+        thread_stats.emplace_back(&t, *stat);
+      }
+    }
+    auto lthreads = l.initThreads(thread_stats.size());
+    for (size_t j = 0; j < thread_stats.size(); j++) {
+      auto lt = lthreads[j];
+      const auto &[t, stat] = thread_stats[j];
+      lt.setTid(t->tid);
+      lt.setName(stat.name);
+      lt.setState(stat.state);
+      lt.setProcessor(stat.processor);
+      lt.setCpuUser(stat.utime / jiffy);
+      lt.setCpuSystem(stat.stime / jiffy);
+      auto lusage = lt.initCpuUsage(t->usage.size());
+      for (size_t k = 0; k < t->usage.size(); k++) {
+        lusage.set(k, t->usage[k]);
+      }
+    }
+
+    // new threads are picked up here, with the process list
+    updateProfiledThreads(r.pid, proc);
+    for (auto &[tid, t] : proc.threads) {
+      t.usage.clear();
+    }
   }
+  builder.setThreadSampleInterval(thread_sample_interval);
 }
 
-void buildProcLogMessage(MessageBuilder &msg) {
+void ProcSampler::buildProcLogMessage(MessageBuilder &msg, float thread_sample_interval) {
   auto procLog = msg.initEvent().initProcLog();
-  buildProcs(procLog);
+  buildProcs(procLog, thread_sample_interval);
   buildCPUTimes(procLog);
   buildMemInfo(procLog);
 }
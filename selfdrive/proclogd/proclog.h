@@ -1,5 +1,7 @@
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -11,6 +13,10 @@ struct CPUTime {
   unsigned long iowtime, irqtime, sirqtime;
 };
 
+struct MemInfo {
+  uint64_t total, free, available, buffers, cached, active, inactive, shared;
+};
+
 struct ProcCache {
   int pid;
   std::string name, exe;
@@ -28,13 +34,65 @@ struct ProcStat {
 
 namespace Parser {
 
-std::vector<int> pids();
-std::optional<ProcStat> procStat(std::string stat);
-std::vector<std::string> cmdline(std::istream &stream);
-std::vector<CPUTime> cpuTimes(std::istream &stream);
-std::unordered_map<std::string, uint64_t> memInfo(std::istream &stream);
+std::vector<int> pids(const std::string &dir = "/proc");
+std::optional<ProcStat> procStat(std::string_view stat);
+std::vector<std::string> cmdline(std::string_view cmdline);
+std::vector<CPUTime> cpuTimes(std::string_view stat);
+MemInfo memInfo(std::string_view meminfo);
+std::optional<uint64_t> schedRunTime(std::string_view schedstat);
 const ProcCache &getProcExtraInfo(int pid, const std::string &name);
 
 };  // namespace Parser
 
-void buildProcLogMessage(MessageBuilder &msg);
+// A file in /proc that is kept open and read again with pread on every sample.
+class ProcFile {
+public:
+  ProcFile(const std::string &path);
+  ~ProcFile();
+  bool valid() const { return fd >= 0; }
+  // reads the whole file into buf, returns an empty view when the file is gone
+  std::string_view read(std::string &buf);
+
+private:
+  int fd;
+};
+
+// Samples /proc for procLog. The files are opened once and read into a
+// reused buffer, so sampling doesn't allocate or open anything for known
+// processes.
+//
+// The threads of the profiled processes are also sampled at a higher rate in
+// sampleThreads(), their cpu usage over each interval is sent with the next
+// procLog.
+class ProcSampler {
+public:
+  ProcSampler(const std::vector<std::string> &profiled = {});
+  bool profiling() const { return !profiled.empty(); }
+  void sampleThreads();
+  void buildProcLogMessage(MessageBuilder &msg, float thread_sample_interval = 0);
+
+private:
+  struct ProfiledThread {
+    int tid;
+    std::unique_ptr<ProcFile> stat, schedstat;
+    uint64_t last_run_ns, last_sample_ns;
+    std::vector<float> usage;
+  };
+  struct ProfiledProc {
+    std::string name;
+    std::unordered_map<int, ProfiledThread> threads;
+  };
+
+  void buildCPUTimes(cereal::ProcLog::Builder &builder);
+  void buildMemInfo(cereal::ProcLog::Builder &builder);
+  void buildProcs(cereal::ProcLog::Builder &builder, float thread_sample_interval);
+  void updateProfiledThreads(int pid, ProfiledProc &proc);
+  bool isProfiled(const ProcStat &stat, const ProcCache &extra_info) const;
+
+  std::vector<std::string> profiled;
+  ProcFile stat_file, meminfo_file;
+  std::unordered_map<int, std::unique_ptr<ProcFile>> proc_files;
+  std::unordered_map<int, ProfiledProc> profiled_procs;
+  std::vector<ProcStat> proc_stats;
+  std::string buf;
+};
@@ -1,11 +1,14 @@
 #include "bmx055_accel.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 
-BMX055_Accel::BMX055_Accel(I2CBus *bus) : I2CSensor(bus) {}
+// 125 Hz bandwidth is a 250 Hz data rate, published at 100 Hz like the polled sensors
+BMX055_Accel::BMX055_Accel(I2CBus *bus) : I2CSensor(bus), timestamper(250.0), decimator(250.0, 100.0) {}
 
 int BMX055_Accel::init() {
   int ret = 0;
@@ -39,15 +42,65 @@ int BMX055_Accel::init() {
     goto fail;
   }
 
+  // Stream mode keeps the newest frames when full
+  ret = set_register(BMX055_ACCEL_I2C_REG_FIFO_CONFIG_1, BMX055_ACCEL_FIFO_MODE_STREAM | BMX055_ACCEL_FIFO_DATA_XYZ);
+  if (ret < 0) {
+    goto fail;
+  }
+
 fail:
   return ret;
 }
 
+int BMX055_Accel::queue_events() {
+  const uint64_t t_read = nanos_since_boot();
+  uint8_t status;
+  int ret = read_register(BMX055_ACCEL_I2C_REG_FIFO_STATUS, &status, 1);
+  if (ret < 0) {
+    LOGE("Reading FIFO status failed: %d", ret);
+    return 0;
+  }
+
+  if (status & BMX055_ACCEL_FIFO_OVERRUN) {
+    LOGW("BMX055 accel FIFO overrun, samples lost");
+    timestamper.reset();
+    // Rewriting the config empties the FIFO and clears the flag
+    set_register(BMX055_ACCEL_I2C_REG_FIFO_CONFIG_1, BMX055_ACCEL_FIFO_MODE_STREAM | BMX055_ACCEL_FIFO_DATA_XYZ);
+    return 0;
+  }
+
+  const int frames = std::min(status & BMX055_ACCEL_FIFO_FRAME_COUNT, BMX055_ACCEL_FIFO_DEPTH);
+  if (frames == 0) {
+    return 0;
+  }
+
+  uint8_t buffer[BMX055_ACCEL_FIFO_DEPTH * 6];
+  ret = read_burst(BMX055_ACCEL_I2C_REG_FIFO, buffer, frames * 6);
+  if (ret < 0) {
+    LOGE("Reading FIFO failed: %d", ret);
+    return 0;
+  }
+
+  // assume the newest frame was taken half a period before the read
+  uint64_t timestamps[BMX055_ACCEL_FIFO_DEPTH];
+  timestamper.stamp(timestamps, frames, frames - 1, t_read - timestamper.period_ns() / 2);
+  for (int i = 0; i < frames; i++) {
+    if (!decimator.keep(timestamps[i])) {
+      continue;
+    }
+    FifoSample sample = {timestamps[i]};
+    memcpy(sample.data, &buffer[i * 6], sizeof(sample.data));
+    samples.push_back(sample);
+  }
+  return samples.size();
+}
+
 void BMX055_Accel::get_event(cereal::SensorEventData::Builder &event) {
-  uint64_t start_time = nanos_since_boot();
+  assert(!samples.empty());
+  const uint64_t start_time = samples.front().timestamp;
   uint8_t buffer[6];
-  int len = read_register(BMX055_ACCEL_I2C_REG_X_LSB, buffer, sizeof(buffer));
-  assert(len == 6);
+  memcpy(buffer, samples.front().data, sizeof(buffer));
+  samples.pop_front();
 
   // 12 bit = +-2g
   float scale = 9.81 * 2.0f / (1 << 11);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <deque>
+
+#include "selfdrive/sensord/sensors/fifo.h"
 #include "selfdrive/sensord/sensors/i2c_sensor.h"
 
 // Address of the chip on the bus
@@ -9,13 +12,21 @@
 #define BMX055_ACCEL_I2C_REG_ID     0x00
 #define BMX055_ACCEL_I2C_REG_X_LSB  0x02
 #define BMX055_ACCEL_I2C_REG_TEMP   0x08
+#define BMX055_ACCEL_I2C_REG_FIFO_STATUS 0x0E
 #define BMX055_ACCEL_I2C_REG_BW     0x10
 #define BMX055_ACCEL_I2C_REG_HBW    0x13
+#define BMX055_ACCEL_I2C_REG_FIFO_CONFIG_1 0x3E
 #define BMX055_ACCEL_I2C_REG_FIFO   0x3F
 
 // Constants
 #define BMX055_ACCEL_CHIP_ID        0xFA
 
+#define BMX055_ACCEL_FIFO_MODE_STREAM   (0b10 << 6)
+#define BMX055_ACCEL_FIFO_DATA_XYZ      0b00
+#define BMX055_ACCEL_FIFO_OVERRUN       (1 << 7)
+#define BMX055_ACCEL_FIFO_FRAME_COUNT   0x7F
+#define BMX055_ACCEL_FIFO_DEPTH         32
+
 #define BMX055_ACCEL_HBW_ENABLE       0b10000000
 #define BMX055_ACCEL_HBW_DISABLE      0b00000000
 
@@ -30,8 +41,12 @@
 
 class BMX055_Accel : public I2CSensor {
   uint8_t get_device_address() {return BMX055_ACCEL_I2C_ADDR;}
+  FifoTimestamper timestamper;
+  FifoDecimator decimator;
+  std::deque<FifoSample> samples;
 public:
   BMX055_Accel(I2CBus *bus);
   int init();
+  int queue_events();
   void get_event(cereal::SensorEventData::Builder &event);
 };
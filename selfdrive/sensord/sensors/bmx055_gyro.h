@@ -1,5 +1,8 @@
 #pragma once
 
+#include <deque>
+
+#include "selfdrive/sensord/sensors/fifo.h"
 #include "selfdrive/sensord/sensors/i2c_sensor.h"
 
 // Address of the chip on the bus
@@ -8,14 +11,22 @@
 // Registers of the chip
 #define BMX055_GYRO_I2C_REG_ID         0x00
 #define BMX055_GYRO_I2C_REG_RATE_X_LSB 0x02
+#define BMX055_GYRO_I2C_REG_FIFO_STATUS 0x0E
 #define BMX055_GYRO_I2C_REG_RANGE      0x0F
 #define BMX055_GYRO_I2C_REG_BW         0x10
 #define BMX055_GYRO_I2C_REG_HBW        0x13
+#define BMX055_GYRO_I2C_REG_FIFO_CONFIG_1 0x3E
 #define BMX055_GYRO_I2C_REG_FIFO       0x3F
 
 // Constants
 #define BMX055_GYRO_CHIP_ID         0x0F
 
+#define BMX055_GYRO_FIFO_MODE_STREAM   (0b10 << 6)
+#define BMX055_GYRO_FIFO_DATA_XYZ      0b00
+#define BMX055_GYRO_FIFO_OVERRUN       (1 << 7)
+#define BMX055_GYRO_FIFO_FRAME_COUNT   0x7F
+#define BMX055_GYRO_FIFO_DEPTH         100
+
 #define BMX055_GYRO_HBW_ENABLE       0b10000000
 #define BMX055_GYRO_HBW_DISABLE      0b00000000
 
@@ -25,13 +36,17 @@
 #define BMX055_GYRO_RANGE_250       0b011
 #define BMX055_GYRO_RANGE_125       0b100
 
-#define BMX055_GYRO_BW_116HZ 0b0010
+#define BMX055_GYRO_BW_116HZ 0b0010 // 1 kHz data rate, published at 100 Hz
 
 
 class BMX055_Gyro : public I2CSensor {
   uint8_t get_device_address() {return BMX055_GYRO_I2C_ADDR;}
+  FifoTimestamper timestamper;
+  FifoDecimator decimator;
+  std::deque<FifoSample> samples;
 public:
   BMX055_Gyro(I2CBus *bus);
   int init();
+  int queue_events();
   void get_event(cereal::SensorEventData::Builder &event);
 };
@@ -0,0 +1,53 @@
+#include "fifo.h"
+
+#include <algorithm>
+#include <cmath>
+
+// the period estimate moves slowly, a single late interrupt shouldn't skew a whole burst
+const double PERIOD_FILTER_K = 0.02;
+// anchors further off than this are missed interrupts or overruns, not clock drift
+const double PERIOD_MAX_DEVIATION = 0.05;
+
+FifoTimestamper::FifoTimestamper(double odr_hz) : nominal_period(1e9 / odr_hz), period(1e9 / odr_hz) {}
+
+void FifoTimestamper::reset() {
+  last_anchor_time = 0;
+}
+
+void FifoTimestamper::stamp(uint64_t *timestamps, int n, int anchor, uint64_t t_anchor) {
+  if (n <= 0) {
+    return;
+  }
+
+  const uint64_t anchor_idx = samples_total + anchor;
+  if (last_anchor_time != 0 && anchor_idx > last_anchor_idx && t_anchor > last_anchor_time) {
+    const double measured = double(t_anchor - last_anchor_time) / (anchor_idx - last_anchor_idx);
+    if (std::abs(measured - nominal_period) < PERIOD_MAX_DEVIATION * nominal_period) {
+      period += PERIOD_FILTER_K * (measured - period);
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    uint64_t ts = t_anchor + (int64_t)std::llround((i - anchor) * period);
+    // jitter on the anchor must not reorder samples across bursts
+    ts = std::max(ts, last_timestamp + 1);
+    timestamps[i] = last_timestamp = ts;
+  }
+
+  samples_total += n;
+  last_anchor_idx = anchor_idx;
+  last_anchor_time = t_anchor;
+}
+
+FifoDecimator::FifoDecimator(double odr_hz, double rate_hz) : sample_period(1e9 / odr_hz), period(1e9 / rate_hz) {}
+
+bool FifoDecimator::keep(uint64_t timestamp) {
+  // samples are up to half a sample period early for their slot
+  if (next != 0 && timestamp + sample_period / 2 < next) {
+    return false;
+  }
+  // start over after a gap instead of catching up on the missed slots
+  const bool gap = next == 0 || timestamp > next + period;
+  next = (gap ? timestamp : next) + std::llround(period);
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// One 3-axis sample read from a sensor's FIFO, in the layout of its data registers
+struct FifoSample {
+  uint64_t timestamp;
+  uint8_t data[6];
+};
+
+// The sensors only tell us how many samples are in their FIFO, not when they were
+// taken. Each burst is placed around one anchor sample with a known time (the
+// watermark sample at the interrupt, or the newest sample when polling) and the
+// sample period is tracked across bursts to follow the sensor's clock.
+class FifoTimestamper {
+public:
+  FifoTimestamper(double odr_hz);
+  // samples were lost, the next burst doesn't continue the previous one
+  void reset();
+  // timestamps n consecutive samples, the anchor-th of which was taken at t_anchor
+  void stamp(uint64_t *timestamps, int n, int anchor, uint64_t t_anchor);
+  double period_ns() const { return period; }
+
+private:
+  const double nominal_period;
+  double period;
+  uint64_t samples_total = 0;
+  uint64_t last_anchor_idx = 0;
+  uint64_t last_anchor_time = 0;
+  uint64_t last_timestamp = 0;
+};
+
+// Publishes a sensor's samples at a lower rate than its data rate. Keeps the first
+// sample of every output period, so the rate holds when the ratio isn't an integer.
+class FifoDecimator {
+public:
+  FifoDecimator(double odr_hz, double rate_hz);
+  bool keep(uint64_t timestamp);
+
+private:
+  const double sample_period;
+  const double period;
+  uint64_t next = 0;
+};
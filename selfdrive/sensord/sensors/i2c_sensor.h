@@ -21,6 +21,7 @@ public:
   I2CSensor(I2CBus *bus);
   int read_register(uint register_address, uint8_t *buffer, uint8_t len);
   int set_register(uint register_address, uint8_t data);
+  int read_burst(uint register_address, uint8_t *buffer, uint16_t len);
   virtual int init() = 0;
   virtual void get_event(cereal::SensorEventData::Builder &event) = 0;
 };
@@ -5,7 +5,7 @@
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 
-LSM6DS3_Accel::LSM6DS3_Accel(I2CBus *bus) : I2CSensor(bus) {}
+LSM6DS3_Accel::LSM6DS3_Accel(I2CBus *bus, LSM6DS3_Fifo *fifo) : I2CSensor(bus), fifo(fifo) {}
 
 int LSM6DS3_Accel::init() {
   int ret = 0;
@@ -38,13 +38,27 @@ fail:
   return ret;
 }
 
+int LSM6DS3_Accel::queue_events() {
+  return fifo != nullptr ? fifo->accel.size() : 1;
+}
+
 void LSM6DS3_Accel::get_event(cereal::SensorEventData::Builder &event) {
+  if (fifo != nullptr) {
+    assert(!fifo->accel.empty());
+    const FifoSample &sample = fifo->accel.front();
+    fill_event(event, sample.data, sample.timestamp);
+    fifo->accel.pop_front();
+    return;
+  }
 
   uint64_t start_time = nanos_since_boot();
   uint8_t buffer[6];
   int len = read_register(LSM6DS3_ACCEL_I2C_REG_OUTX_L_XL, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
+  fill_event(event, buffer, start_time);
+}
 
+void LSM6DS3_Accel::fill_event(cereal::SensorEventData::Builder &event, const uint8_t *buffer, uint64_t timestamp) {
   float scale = 9.81 * 2.0f / (1 << 15);
   float x = read_16_bit(buffer[0], buffer[1]) * scale;
   float y = read_16_bit(buffer[2], buffer[3]) * scale;
@@ -54,7 +68,7 @@ void LSM6DS3_Accel::get_event(cereal::SensorEventData::Builder &event) {
   event.setVersion(1);
   event.setSensor(SENSOR_ACCELEROMETER);
   event.setType(SENSOR_TYPE_ACCELEROMETER);
-  event.setTimestamp(start_time);
+  event.setTimestamp(timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initAcceleration();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "selfdrive/sensord/sensors/i2c_sensor.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
 
 // Address of the chip on the bus
 #define LSM6DS3_ACCEL_I2C_ADDR       0x6A
@@ -19,8 +20,12 @@
 class LSM6DS3_Accel : public I2CSensor {
   uint8_t get_device_address() {return LSM6DS3_ACCEL_I2C_ADDR;}
   cereal::SensorEventData::SensorSource source = cereal::SensorEventData::SensorSource::LSM6DS3;
+  LSM6DS3_Fifo *fifo;
+  void fill_event(cereal::SensorEventData::Builder &event, const uint8_t *buffer, uint64_t timestamp);
 public:
-  LSM6DS3_Accel(I2CBus *bus);
+  // Samples come from the shared FIFO when one is given, otherwise the data registers are polled
+  LSM6DS3_Accel(I2CBus *bus, LSM6DS3_Fifo *fifo = nullptr);
   int init();
+  int queue_events();
   void get_event(cereal::SensorEventData::Builder &event);
 };
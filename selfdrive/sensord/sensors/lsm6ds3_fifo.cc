@@ -0,0 +1,114 @@
+#include "lsm6ds3_fifo.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "selfdrive/common/swaglog.h"
+#include "selfdrive/common/timing.h"
+
+LSM6DS3_Fifo::LSM6DS3_Fifo(I2CBus *bus) : bus(bus), timestamper(104.0) {}
+
+int LSM6DS3_Fifo::reset() {
+  // going through bypass mode empties the FIFO, so reads start on a frame boundary again
+  int ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_MODE_BYPASS);
+  if (ret < 0) {
+    return ret;
+  }
+  timestamper.reset();
+  return bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_CTRL5, LSM6DS3_FIFO_ODR_104HZ | LSM6DS3_FIFO_MODE_CONTINUOUS);
+}
+
+int LSM6DS3_Fifo::init() {
+  int ret = 0;
+
+  // Watermark in words
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_CTRL1, LSM6DS3_FIFO_WATERMARK * LSM6DS3_FIFO_FRAME_WORDS);
+  if (ret < 0) {
+    goto fail;
+  }
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_CTRL2, 0);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  // Both sensors at their full 104 Hz data rate
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_CTRL3, LSM6DS3_FIFO_DEC_GYRO_NONE | LSM6DS3_FIFO_DEC_XL_NONE);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = bus->set_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_INT1_CTRL, LSM6DS3_FIFO_INT1_FTH);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = reset();
+
+fail:
+  return ret;
+}
+
+int LSM6DS3_Fifo::drain(uint64_t t_irq) {
+  const uint64_t t_read = nanos_since_boot();
+
+  uint8_t status[4];
+  int ret = bus->read_register(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_STATUS1, status, sizeof(status));
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (status[1] & LSM6DS3_FIFO_STATUS2_OVER_RUN) {
+    LOGW("LSM6DS3 FIFO overrun, samples lost");
+    return reset();
+  }
+
+  int words = ((status[1] & 0x0F) << 8) | status[0];
+  const int pattern = ((status[3] & 0x03) << 8) | status[2];
+
+  // Drop the rest of a partially read frame
+  if (pattern != 0) {
+    const int skip = std::min(words, LSM6DS3_FIFO_FRAME_WORDS - pattern);
+    uint8_t discard[LSM6DS3_FIFO_FRAME_SIZE];
+    ret = bus->read_burst(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, discard, skip * 2);
+    if (ret < 0) {
+      return ret;
+    }
+    words -= skip;
+    timestamper.reset();
+  }
+
+  const int frames = words / LSM6DS3_FIFO_FRAME_WORDS;
+  if (frames == 0) {
+    return 0;
+  }
+
+  buf.resize(frames * LSM6DS3_FIFO_FRAME_SIZE);
+  ret = bus->read_burst(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, buf.data(), buf.size());
+  if (ret < 0) {
+    return ret;
+  }
+
+  // The newest frame is anchored. When it is the watermark frame, it landed just before
+  // the interrupt woke us. Otherwise, when polling or with frames queued behind the
+  // watermark, assume it was taken half a period before the read.
+  timestamps.resize(frames);
+  if (t_irq != 0 && frames <= LSM6DS3_FIFO_WATERMARK) {
+    timestamper.stamp(timestamps.data(), frames, frames - 1, std::min(t_irq, t_read));
+  } else {
+    timestamper.stamp(timestamps.data(), frames, frames - 1, t_read - timestamper.period_ns() / 2);
+  }
+  // nothing can have been sampled after the read
+  for (uint64_t &ts : timestamps) {
+    ts = std::min(ts, t_read);
+  }
+
+  for (int i = 0; i < frames; i++) {
+    const uint8_t *frame = &buf[i * LSM6DS3_FIFO_FRAME_SIZE];
+    FifoSample g = {timestamps[i]}, a = {timestamps[i]};
+    memcpy(g.data, frame, sizeof(g.data));
+    memcpy(a.data, frame + sizeof(g.data), sizeof(a.data));
+    gyro.push_back(g);
+    accel.push_back(a);
+  }
+  return frames;
+}
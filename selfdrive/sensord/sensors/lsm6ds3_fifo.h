@@ -0,0 +1,55 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "selfdrive/common/i2c.h"
+#include "selfdrive/sensord/sensors/fifo.h"
+
+// Address of the chip on the bus
+#define LSM6DS3_FIFO_I2C_ADDR       0x6A
+
+// Registers of the chip
+#define LSM6DS3_FIFO_I2C_REG_CTRL1      0x06
+#define LSM6DS3_FIFO_I2C_REG_CTRL2      0x07
+#define LSM6DS3_FIFO_I2C_REG_CTRL3      0x08
+#define LSM6DS3_FIFO_I2C_REG_CTRL5      0x0A
+#define LSM6DS3_FIFO_I2C_REG_INT1_CTRL  0x0D
+#define LSM6DS3_FIFO_I2C_REG_STATUS1    0x3A
+#define LSM6DS3_FIFO_I2C_REG_DATA_OUT_L 0x3E
+
+// Constants
+#define LSM6DS3_FIFO_DEC_GYRO_NONE  (0b001 << 3)
+#define LSM6DS3_FIFO_DEC_XL_NONE    0b001
+#define LSM6DS3_FIFO_ODR_104HZ      (0b0100 << 3)
+#define LSM6DS3_FIFO_MODE_BYPASS    0b000
+#define LSM6DS3_FIFO_MODE_CONTINUOUS 0b110
+#define LSM6DS3_FIFO_INT1_FTH       (1 << 3)
+#define LSM6DS3_FIFO_STATUS2_OVER_RUN (1 << 6)
+
+// gyro and accel share the FIFO, each frame is Gx Gy Gz XLx XLy XLz in 16 bit words
+#define LSM6DS3_FIFO_FRAME_WORDS    6
+#define LSM6DS3_FIFO_FRAME_SIZE     (LSM6DS3_FIFO_FRAME_WORDS * 2)
+// frames queued before INT1 is raised. Every frame wakes sensord so the
+// sensors without a FIFO are still read at ~100 Hz.
+#define LSM6DS3_FIFO_WATERMARK      1
+
+
+// Drains the FIFO shared by LSM6DS3_Accel and LSM6DS3_Gyro into per sensor queues
+class LSM6DS3_Fifo {
+  I2CBus *bus;
+  FifoTimestamper timestamper;
+  std::vector<uint8_t> buf;
+  std::vector<uint64_t> timestamps;
+  int reset();
+
+public:
+  std::deque<FifoSample> accel;
+  std::deque<FifoSample> gyro;
+
+  LSM6DS3_Fifo(I2CBus *bus);
+  int init();
+  // Reads all complete frames. t_irq is when the watermark interrupt woke us, 0 when polling.
+  // No sample is stamped later than the read.
+  int drain(uint64_t t_irq);
+};
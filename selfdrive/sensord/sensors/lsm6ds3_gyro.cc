@@ -9,7 +9,7 @@
 #define DEG2RAD(x) ((x) * M_PI / 180.0)
 
 
-LSM6DS3_Gyro::LSM6DS3_Gyro(I2CBus *bus) : I2CSensor(bus) {}
+LSM6DS3_Gyro::LSM6DS3_Gyro(I2CBus *bus, LSM6DS3_Fifo *fifo) : I2CSensor(bus), fifo(fifo) {}
 
 int LSM6DS3_Gyro::init() {
   int ret = 0;
@@ -42,13 +42,27 @@ fail:
   return ret;
 }
 
+int LSM6DS3_Gyro::queue_events() {
+  return fifo != nullptr ? fifo->gyro.size() : 1;
+}
+
 void LSM6DS3_Gyro::get_event(cereal::SensorEventData::Builder &event) {
+  if (fifo != nullptr) {
+    assert(!fifo->gyro.empty());
+    const FifoSample &sample = fifo->gyro.front();
+    fill_event(event, sample.data, sample.timestamp);
+    fifo->gyro.pop_front();
+    return;
+  }
 
   uint64_t start_time = nanos_since_boot();
   uint8_t buffer[6];
   int len = read_register(LSM6DS3_GYRO_I2C_REG_OUTX_L_G, buffer, sizeof(buffer));
   assert(len == sizeof(buffer));
+  fill_event(event, buffer, start_time);
+}
 
+void LSM6DS3_Gyro::fill_event(cereal::SensorEventData::Builder &event, const uint8_t *buffer, uint64_t timestamp) {
   float scale = 8.75 / 1000.0;
   float x = DEG2RAD(read_16_bit(buffer[0], buffer[1]) * scale);
   float y = DEG2RAD(read_16_bit(buffer[2], buffer[3]) * scale);
@@ -58,7 +72,7 @@ void LSM6DS3_Gyro::get_event(cereal::SensorEventData::Builder &event) {
   event.setVersion(2);
   event.setSensor(SENSOR_GYRO_UNCALIBRATED);
   event.setType(SENSOR_TYPE_GYROSCOPE_UNCALIBRATED);
-  event.setTimestamp(start_time);
+  event.setTimestamp(timestamp);
 
   float xyz[] = {y, -x, z};
   auto svec = event.initGyroUncalibrated();
@@ -6,5 +6,8 @@ class Sensor {
 public:
   virtual ~Sensor() {};
   virtual int init() = 0;
+  // Number of events to publish this loop, get_event is called once for each.
+  // Sensors with a hardware FIFO drain it here.
+  virtual int queue_events() { return 1; }
   virtual void get_event(cereal::SensorEventData::Builder &event) = 0;
 };
@@ -1,11 +1,15 @@
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/resource.h>
+#include <unistd.h>
 
-#include <chrono>
-#include <thread>
+#include <algorithm>
 #include <vector>
 
 #include "cereal/messaging/messaging.h"
+#include "selfdrive/common/gpio.h"
 #include "selfdrive/common/i2c.h"
+#include "selfdrive/common/ratekeeper.h"
 #include "selfdrive/common/swaglog.h"
 #include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
@@ -16,6 +20,7 @@
 #include "selfdrive/sensord/sensors/constants.h"
 #include "selfdrive/sensord/sensors/light_sensor.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_accel.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_gyro.h"
 #include "selfdrive/sensord/sensors/lsm6ds3_temp.h"
 #include "selfdrive/sensord/sensors/mmc5603nj_magn.h"
@@ -23,8 +28,29 @@
 
 #define I2C_BUS_IMU 1
 
+// Longest wait for the FIFO watermark before draining anyway. One frame at 104 Hz takes 9.6 ms.
+#define IRQ_TIMEOUT_MS 15
+// Waits in a row that time out before the interrupt is given up on, and the FIFOs are polled
+#define IRQ_TIMEOUT_LIMIT 10
+
 ExitHandler do_exit;
 
+// Returns true if the interrupt fired, false on timeout
+static bool wait_for_interrupt(int fd, int timeout_ms) {
+  struct pollfd pfd = {};
+  pfd.fd = fd;
+  pfd.events = POLLPRI | POLLERR;
+  int ret = HANDLE_EINTR(poll(&pfd, 1, timeout_ms));
+  if (ret <= 0) {
+    return false;
+  }
+
+  // Reading the value acknowledges the edge
+  char value[2];
+  lseek(fd, 0, SEEK_SET);
+  return HANDLE_EINTR(read(fd, value, sizeof(value))) > 0;
+}
+
 int sensor_loop() {
   I2CBus *i2c_bus_imu;
 
@@ -40,8 +66,9 @@ int sensor_loop() {
   BMX055_Magn bmx055_magn(i2c_bus_imu);
   BMX055_Temp bmx055_temp(i2c_bus_imu);
 
-  LSM6DS3_Accel lsm6ds3_accel(i2c_bus_imu);
-  LSM6DS3_Gyro lsm6ds3_gyro(i2c_bus_imu);
+  LSM6DS3_Fifo lsm6ds3_fifo(i2c_bus_imu);
+  LSM6DS3_Accel lsm6ds3_accel(i2c_bus_imu, &lsm6ds3_fifo);
+  LSM6DS3_Gyro lsm6ds3_gyro(i2c_bus_imu, &lsm6ds3_fifo);
   LSM6DS3_Temp lsm6ds3_temp(i2c_bus_imu);
 
   MMC5603NJ_Magn mmc5603nj_magn(i2c_bus_imu);
@@ -79,24 +106,86 @@ int sensor_loop() {
     }
   }
 
-  PubMaster pm({"sensorEvents"});
+  if (lsm6ds3_fifo.init() < 0) {
+    LOGE("Error initializing LSM6DS3 FIFO");
+    return -1;
+  }
 
+  // Without the watermark interrupt the FIFOs are polled every 10 ms
+  int irq_fd = gpio_get_irq_fd(GPIO_LSM_INT);
+  if (irq_fd < 0) {
+    LOGW("LSM6DS3 interrupt not available, polling");
+  }
+
+  PubMaster pm({"sensorEvents", "sensordLoopStats"});
+
+  // the interrupt fires every LSM6DS3_FIFO_WATERMARK frames at 104 Hz
+  RateKeeper rk("sensord", irq_fd >= 0 ? 104. / LSM6DS3_FIFO_WATERMARK : 100.);
+
+  int irq_timeouts = 0;
   while (!do_exit) {
-    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    // a timed out wait drains the FIFOs, but isn't an iteration of the paced loop
+    uint64_t t_irq = 0;
+    if (irq_fd >= 0) {
+      if (wait_for_interrupt(irq_fd, IRQ_TIMEOUT_MS)) {
+        t_irq = nanos_since_boot();
+        rk.wakeup();
+        irq_timeouts = 0;
+      } else if (++irq_timeouts == IRQ_TIMEOUT_LIMIT) {
+        // the FIFO has a frame every 9.6 ms, so the interrupt isn't reaching us
+        LOGW("LSM6DS3 interrupt timed out %d times in a row, polling", irq_timeouts);
+        close(irq_fd);
+        irq_fd = -1;
+        rk = RateKeeper("sensord", 100.);
+      }
+    }
 
-    const int num_events = sensors.size();
-    MessageBuilder msg;
-    auto sensor_events = msg.initEvent().initSensorEvents(num_events);
+    int ret = lsm6ds3_fifo.drain(t_irq);
+    if (ret < 0) {
+      LOGE("Reading LSM6DS3 FIFO failed: %d", ret);
+    }
 
-    for (int i = 0; i < num_events; i++) {
-      auto event = sensor_events[i];
-      sensors[i]->get_event(event);
+    // FIFO sensors return a burst of older samples, stage all events
+    // so sensorEvents can be published in timestamp order
+    capnp::MallocMessageBuilder scratch;
+    std::vector<capnp::Orphan<cereal::SensorEventData>> events;
+    for (Sensor *sensor : sensors) {
+      const int queued = sensor->queue_events();
+      for (int j = 0; j < queued; j++) {
+        events.push_back(scratch.getOrphanage().newOrphan<cereal::SensorEventData>());
+        auto event = events.back().get();
+        sensor->get_event(event);
+      }
+    }
+    std::stable_sort(events.begin(), events.end(), [](const auto &a, const auto &b) {
+      return a.getReader().getTimestamp() < b.getReader().getTimestamp();
+    });
+
+    MessageBuilder msg;
+    auto sensor_events = msg.initEvent().initSensorEvents(events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+      sensor_events.setWithCaveats(i, events[i].getReader());
     }
 
     pm.send("sensorEvents", msg);
 
-    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
-    std::this_thread::sleep_for(std::chrono::milliseconds(10) - (end - begin));
+    if (rk.statsReady()) {
+      MessageBuilder stats_msg;
+      rk.fillStats(stats_msg.initEvent().initSensordLoopStats());
+      pm.send("sensordLoopStats", stats_msg);
+    }
+
+    if (irq_fd >= 0) {
+      if (t_irq != 0) {
+        rk.monitorTime();
+      }
+    } else {
+      rk.keepTime();
+    }
+  }
+
+  if (irq_fd >= 0) {
+    close(irq_fd);
   }
   return 0;
 }
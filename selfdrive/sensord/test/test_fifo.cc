@@ -0,0 +1,237 @@
+#define CATCH_CONFIG_MAIN
+#include "catch2/catch.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <map>
+
+#include "selfdrive/common/timing.h"
+#include "selfdrive/sensord/sensors/fifo.h"
+#include "selfdrive/sensord/sensors/lsm6ds3_fifo.h"
+
+const double LSM6DS3_PERIOD_NS = 1e9 / 104.0;
+
+// Register map and FIFO of an LSM6DS3 behind a simulated bus
+class SimulatedLSM6DS3 : public I2CBus {
+public:
+  std::map<uint, uint8_t> registers;
+  std::deque<uint8_t> fifo;
+  int words_read = 0;
+  bool overrun = false;
+
+  void push_frame(int16_t gyro, int16_t accel) {
+    for (int16_t v : {gyro, gyro, gyro, accel, accel, accel}) {
+      fifo.push_back(v & 0xFF);
+      fifo.push_back((v >> 8) & 0xFF);
+    }
+  }
+
+  int read_register(uint8_t device_address, uint register_address, uint8_t *buffer, uint8_t len) override {
+    REQUIRE(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    if (register_address == LSM6DS3_FIFO_I2C_REG_STATUS1) {
+      REQUIRE(len == 4);
+      const int words = fifo.size() / 2;
+      const int pattern = words_read % LSM6DS3_FIFO_FRAME_WORDS;
+      buffer[0] = words & 0xFF;
+      buffer[1] = ((words >> 8) & 0x0F) | (overrun ? LSM6DS3_FIFO_STATUS2_OVER_RUN : 0);
+      buffer[2] = pattern & 0xFF;
+      buffer[3] = (pattern >> 8) & 0x03;
+      return len;
+    }
+    for (int i = 0; i < len; i++) {
+      buffer[i] = registers[register_address + i];
+    }
+    return len;
+  }
+
+  int set_register(uint8_t device_address, uint register_address, uint8_t data) override {
+    REQUIRE(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    registers[register_address] = data;
+    if (register_address == LSM6DS3_FIFO_I2C_REG_CTRL5 && (data & 0x07) == LSM6DS3_FIFO_MODE_BYPASS) {
+      fifo.clear();
+      words_read = 0;
+      overrun = false;
+    }
+    return 0;
+  }
+
+  int read_burst(uint8_t device_address, uint register_address, uint8_t *buffer, uint16_t len) override {
+    REQUIRE(device_address == LSM6DS3_FIFO_I2C_ADDR);
+    REQUIRE(register_address == LSM6DS3_FIFO_I2C_REG_DATA_OUT_L);
+    REQUIRE(len <= fifo.size());
+    for (int i = 0; i < len; i++) {
+      buffer[i] = fifo.front();
+      fifo.pop_front();
+    }
+    words_read += len / 2;
+    return len;
+  }
+};
+
+static int16_t sample_value(const FifoSample &s, int axis) {
+  return (int16_t)(s.data[2 * axis] | (s.data[2 * axis + 1] << 8));
+}
+
+TEST_CASE("LSM6DS3 FIFO configuration") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL1] == LSM6DS3_FIFO_WATERMARK * LSM6DS3_FIFO_FRAME_WORDS);
+  REQUIRE(bus.registers[LSM6DS3_FIFO_I2C_REG_INT1_CTRL] == LSM6DS3_FIFO_INT1_FTH);
+  REQUIRE((bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL5] & 0x07) == LSM6DS3_FIFO_MODE_CONTINUOUS);
+}
+
+TEST_CASE("LSM6DS3 FIFO drains bursts into accel and gyro queues") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  for (int i = 0; i < 5; i++) {
+    bus.push_frame(100 + i, -100 - i);
+  }
+  const uint64_t t_irq = nanos_since_boot();
+  REQUIRE(fifo.drain(t_irq) == 5);
+  const uint64_t t_after = nanos_since_boot();
+  REQUIRE(bus.fifo.empty());
+  REQUIRE(fifo.gyro.size() == 5);
+  REQUIRE(fifo.accel.size() == 5);
+
+  for (int i = 0; i < 5; i++) {
+    for (int axis = 0; axis < 3; axis++) {
+      REQUIRE(sample_value(fifo.gyro[i], axis) == 100 + i);
+      REQUIRE(sample_value(fifo.accel[i], axis) == -100 - i);
+    }
+    REQUIRE(fifo.gyro[i].timestamp == fifo.accel[i].timestamp);
+  }
+
+  // frames queued behind the watermark frame came in after the interrupt, the newest
+  // is placed just before the read
+  REQUIRE(fifo.gyro[4].timestamp <= t_after);
+  REQUIRE(fifo.gyro[4].timestamp + LSM6DS3_PERIOD_NS >= t_irq);
+  for (int i = 1; i < 5; i++) {
+    const double dt = fifo.gyro[i].timestamp - fifo.gyro[i - 1].timestamp;
+    REQUIRE(std::abs(dt - LSM6DS3_PERIOD_NS) < 1.0);
+  }
+
+  // partial frames stay in the FIFO
+  bus.push_frame(1, 1);
+  bus.fifo.resize(bus.fifo.size() - 2);
+  REQUIRE(fifo.drain(t_irq + 5 * LSM6DS3_PERIOD_NS) == 0);
+  REQUIRE(bus.fifo.size() == LSM6DS3_FIFO_FRAME_SIZE - 2);
+}
+
+TEST_CASE("LSM6DS3 FIFO realigns to frame boundaries") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  for (int i = 0; i < 3; i++) {
+    bus.push_frame(i, i);
+  }
+  // something read the first two words of a frame
+  uint8_t partial[4];
+  bus.read_burst(LSM6DS3_FIFO_I2C_ADDR, LSM6DS3_FIFO_I2C_REG_DATA_OUT_L, partial, sizeof(partial));
+
+  REQUIRE(fifo.drain(0) == 2);
+  REQUIRE(sample_value(fifo.gyro[0], 0) == 1);
+  REQUIRE(sample_value(fifo.accel[1], 2) == 2);
+}
+
+TEST_CASE("LSM6DS3 FIFO resets on overrun") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  for (int i = 0; i < 10; i++) {
+    bus.push_frame(i, i);
+  }
+  bus.overrun = true;
+  REQUIRE(fifo.drain(0) == 0);
+  REQUIRE(fifo.gyro.empty());
+  REQUIRE(bus.fifo.empty());
+  REQUIRE(!bus.overrun);
+  REQUIRE((bus.registers[LSM6DS3_FIFO_I2C_REG_CTRL5] & 0x07) == LSM6DS3_FIFO_MODE_CONTINUOUS);
+}
+
+TEST_CASE("LSM6DS3 FIFO follows the sensor clock") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  // sensor runs 1% fast, with interrupts at every watermark
+  const double period = LSM6DS3_PERIOD_NS / 1.01;
+  const uint64_t t0 = nanos_since_boot() - 10000000000ULL;
+  uint64_t last_timestamp = 0;
+  for (int burst = 0; burst < 500; burst++) {
+    for (int i = 0; i < LSM6DS3_FIFO_WATERMARK; i++) {
+      bus.push_frame(0, 0);
+    }
+    const uint64_t t_irq = t0 + std::llround(((burst + 1) * LSM6DS3_FIFO_WATERMARK - 1) * period);
+    REQUIRE(fifo.drain(t_irq) == LSM6DS3_FIFO_WATERMARK);
+
+    for (const FifoSample &s : fifo.gyro) {
+      REQUIRE(s.timestamp > last_timestamp);
+      if (burst == 499) {
+        const double dt = s.timestamp - last_timestamp;
+        REQUIRE(std::abs(dt - period) < 0.001 * period);
+      }
+      last_timestamp = s.timestamp;
+    }
+    fifo.gyro.clear();
+    fifo.accel.clear();
+  }
+}
+
+TEST_CASE("LSM6DS3 FIFO never stamps samples after the read") {
+  SimulatedLSM6DS3 bus;
+  LSM6DS3_Fifo fifo(&bus);
+  REQUIRE(fifo.init() == 0);
+
+  // a backlog behind the watermark frame
+  for (int i = 0; i < 5; i++) {
+    bus.push_frame(0, 0);
+  }
+  REQUIRE(fifo.drain(nanos_since_boot()) == 5);
+  // and a wakeup time that isn't before the read
+  bus.push_frame(0, 0);
+  REQUIRE(fifo.drain(nanos_since_boot() + 1000000000ULL) == 1);
+
+  const uint64_t t_after = nanos_since_boot();
+  for (const FifoSample &s : fifo.gyro) {
+    REQUIRE(s.timestamp <= t_after);
+  }
+}
+
+TEST_CASE("FifoDecimator publishes at the output rate") {
+  for (double odr : {1000.0, 250.0, 104.0}) {
+    FifoDecimator decimator(odr, 100.0);
+    const double sample_period = 1e9 / odr;
+    int kept = 0;
+    uint64_t last = 0;
+    for (int i = 0; i < odr * 10; i++) {
+      const uint64_t ts = 1000000000ULL + std::llround(i * sample_period);
+      if (decimator.keep(ts)) {
+        // never closer than one output period, minus the rounding to whole samples
+        REQUIRE((last == 0 || ts - last > 1e7 - sample_period));
+        last = ts;
+        kept++;
+      }
+    }
+    REQUIRE(std::abs(kept - std::min(odr, 100.0) * 10) <= 1);
+  }
+}
+
+TEST_CASE("FifoTimestamper keeps timestamps increasing across jittery anchors") {
+  FifoTimestamper timestamper(100.0);
+  uint64_t ts[4];
+  timestamper.stamp(ts, 4, 3, 100000000ULL);
+  REQUIRE(ts[3] == 100000000ULL);
+  REQUIRE(ts[0] == 70000000ULL);
+
+  // the next anchor came in early, before the previous burst ended
+  timestamper.stamp(ts, 2, 1, 95000000ULL);
+  REQUIRE(ts[0] > 100000000ULL);
+  REQUIRE(ts[1] > ts[0]);
+}
@@ -1,6 +1,9 @@
 #include "selfdrive/ui/paint.h"
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
 
 #ifdef __APPLE__
 #include <OpenGL/gl3.h>
@@ -16,6 +19,7 @@
 #include <nanovg_gl.h>
 #include <nanovg_gl_utils.h>
 
+#include "selfdrive/common/timing.h"
 #include "selfdrive/common/util.h"
 #include "selfdrive/hardware/hw.h"
 #include "selfdrive/ui/ui.h"
@@ -124,27 +128,156 @@ static void draw_lead(UIState *s, const cereal::ModelDataV2::LeadDataV3::Reader
   }
 }
 
-static void ui_draw_line(UIState *s, const line_vertices_data &vd, NVGcolor *color, NVGpaint *paint) {
-  if (vd.cnt == 0) return;
+// The model lines are triangle strips drawn with GL straight from a vertex
+// buffer, which is only refilled when a new model arrives. As nanovg paths they
+// were tessellated again every frame. The shader fades out the last pixel at
+// both sides of a strip, in place of nanovg's antialiasing.
+const char line_vertex_shader[] =
+#ifdef NANOVG_GL3_IMPLEMENTATION
+  "#version 150 core\n"
+#else
+  "#version 300 es\n"
+#endif
+  "in vec2 aPosition;\n"
+  "uniform vec2 uViewSize;\n"
+  "out float vSide;\n"
+  "out float vY;\n"
+  "void main() {\n"
+  "  gl_Position = vec4(2.0 * aPosition.x / uViewSize.x - 1.0, 1.0 - 2.0 * aPosition.y / uViewSize.y, 0.0, 1.0);\n"
+  // the vertices alternate between the left and right side
+  "  vSide = float(gl_VertexID % 2);\n"
+  "  vY = aPosition.y;\n"
+  "}\n";
+
+const char line_fragment_shader[] =
+#ifdef NANOVG_GL3_IMPLEMENTATION
+  "#version 150 core\n"
+#else
+  "#version 300 es\n"
+#endif
+  "precision highp float;\n"
+  "in float vSide;\n"
+  "in float vY;\n"
+  "uniform vec4 uStartColor;\n"
+  "uniform vec4 uEndColor;\n"
+  "uniform vec2 uGradientY;\n"
+  "out vec4 colorOut;\n"
+  "void main() {\n"
+  "  float t = clamp((vY - uGradientY.x) / (uGradientY.y - uGradientY.x), 0.0, 1.0);\n"
+  "  float edge = min(vSide, 1.0 - vSide) / fwidth(vSide);\n"
+  "  colorOut = mix(uStartColor, uEndColor, t) * clamp(edge + 0.5, 0.0, 1.0);\n"
+  "}\n";
+
+// vertex buffer slots, one per line of the scene
+enum LineSlot {
+  LINE_SLOT_LANE_LINES = 0,
+  LINE_SLOT_ROAD_EDGES = LINE_SLOT_LANE_LINES + 4,
+  LINE_SLOT_TRACK = LINE_SLOT_ROAD_EDGES + 2,
+  LINE_SLOT_COUNT,
+};
+const int LINE_SLOT_SIZE = TRAJECTORY_SIZE * 2;
+
+struct LineRenderer {
+  GLuint program = 0, vao = 0, vbo = 0;
+  GLint view_size_loc, start_color_loc, end_color_loc, gradient_y_loc;
+  int counts[LINE_SLOT_COUNT] = {};
+  // modelV2 frame the buffer holds the lines of
+  uint64_t model_frame = 0;
+};
+
+static LineRenderer line_renderer;
+
+static GLuint compile_shader(GLenum type, const char *src) {
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &src, NULL);
+  glCompileShader(shader);
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    std::cerr << "line shader: " << log << std::endl;
+  }
+  assert(status);
+  return shader;
+}
 
-  const vertex_data *v = &vd.v[0];
-  nvgBeginPath(s->vg);
-  nvgMoveTo(s->vg, v[0].x, v[0].y);
-  for (int i = 1; i < vd.cnt; i++) {
-    nvgLineTo(s->vg, v[i].x, v[i].y);
-  }
-  nvgClosePath(s->vg);
-  if (color) {
-    nvgFillColor(s->vg, *color);
-  } else if (paint) {
-    nvgFillPaint(s->vg, *paint);
-  }
-  nvgFill(s->vg);
+static void line_renderer_init(LineRenderer &r) {
+  GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, line_vertex_shader);
+  GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, line_fragment_shader);
+  r.program = glCreateProgram();
+  glAttachShader(r.program, vertex_shader);
+  glAttachShader(r.program, fragment_shader);
+  glBindAttribLocation(r.program, 0, "aPosition");
+  glLinkProgram(r.program);
+  GLint status;
+  glGetProgramiv(r.program, GL_LINK_STATUS, &status);
+  assert(status);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  r.view_size_loc = glGetUniformLocation(r.program, "uViewSize");
+  r.start_color_loc = glGetUniformLocation(r.program, "uStartColor");
+  r.end_color_loc = glGetUniformLocation(r.program, "uEndColor");
+  r.gradient_y_loc = glGetUniformLocation(r.program, "uGradientY");
+
+  glGenVertexArrays(1, &r.vao);
+  glGenBuffers(1, &r.vbo);
+  glBindVertexArray(r.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, r.vbo);
+  glBufferData(GL_ARRAY_BUFFER, LINE_SLOT_COUNT * LINE_SLOT_SIZE * sizeof(vertex_data), NULL, GL_DYNAMIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_data), (const GLvoid *)0);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void line_renderer_upload(LineRenderer &r, const UIScene &scene) {
+  const line_vertices_data *lines[LINE_SLOT_COUNT] = {
+    &scene.lane_line_vertices[0], &scene.lane_line_vertices[1], &scene.lane_line_vertices[2], &scene.lane_line_vertices[3],
+    &scene.road_edge_vertices[0], &scene.road_edge_vertices[1],
+    &scene.track_vertices,
+  };
+  vertex_data vertices[LINE_SLOT_COUNT * LINE_SLOT_SIZE];
+  for (int i = 0; i < LINE_SLOT_COUNT; i++) {
+    r.counts[i] = lines[i]->cnt;
+    std::copy_n(lines[i]->v, lines[i]->cnt, &vertices[i * LINE_SLOT_SIZE]);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, r.vbo);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// fills the strip of a line with a vertical gradient, start_color at start_y and end_color at end_y
+static void ui_draw_line(const LineRenderer &r, int slot, NVGcolor start_color, NVGcolor end_color, float start_y, float end_y) {
+  if (r.counts[slot] < 4) return;
+
+  // premultiplied, like nanovg blends
+  glUniform4f(r.start_color_loc, start_color.r * start_color.a, start_color.g * start_color.a, start_color.b * start_color.a, start_color.a);
+  glUniform4f(r.end_color_loc, end_color.r * end_color.a, end_color.g * end_color.a, end_color.b * end_color.a, end_color.a);
+  glUniform2f(r.gradient_y_loc, start_y, end_y);
+  glDrawArrays(GL_TRIANGLE_STRIP, slot * LINE_SLOT_SIZE, r.counts[slot]);
+}
+
+static void ui_draw_line(const LineRenderer &r, int slot, NVGcolor color) {
+  ui_draw_line(r, slot, color, color, 0, 1);
 }
 
 static void ui_draw_vision_lane_lines(UIState *s) {
   const UIScene &scene = s->scene;
-  NVGpaint track_bg;
+  LineRenderer &r = line_renderer;
+  const uint64_t model_frame = s->sm->rcv_frame("modelV2");
+  if (model_frame != r.model_frame) {
+    line_renderer_upload(r, scene);
+    r.model_frame = model_frame;
+  }
+
+  // the lines are drawn right away, under everything nanovg renders at the end of the frame
+  glUseProgram(r.program);
+  glBindVertexArray(r.vao);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  glUniform2f(r.view_size_loc, s->fb_w, s->fb_h);
+
   int steerOverride = scene.car_state.getSteeringPressed();
   float steer_max_v = scene.steerMax_V - (1.5 * (scene.steerMax_V - 0.9));
   int torque_scale = (int)fabs(255*(float)scene.output_scale*steer_max_v);
@@ -168,30 +301,34 @@ static void ui_draw_vision_lane_lines(UIState *s) {
       if (!scene.comma_stock_ui) {
         color = nvgRGBAf(red_lvl_line, green_lvl_line, 0, 1);
       }
-      ui_draw_line(s, scene.lane_line_vertices[i], &color, nullptr);
+      ui_draw_line(r, LINE_SLOT_LANE_LINES + i, color);
     }
 
     // paint road edges
     for (int i = 0; i < std::size(scene.road_edge_vertices); i++) {
       NVGcolor color = nvgRGBAf(1.0, 0.0, 0.0, std::clamp<float>(1.0 - scene.road_edge_stds[i], 0.0, 1.0));
-      ui_draw_line(s, scene.road_edge_vertices[i], &color, nullptr);
+      ui_draw_line(r, LINE_SLOT_ROAD_EDGES + i, color);
     }
   }
+  NVGcolor track_start, track_end;
   if (scene.controls_state.getEnabled() && !scene.comma_stock_ui) {
     if (steerOverride) {
-      track_bg = nvgLinearGradient(s->vg, s->fb_w, s->fb_h, s->fb_w, s->fb_h*.4,
-        COLOR_BLACK_ALPHA(80), COLOR_BLACK_ALPHA(20));
+      track_start = COLOR_BLACK_ALPHA(80);
+      track_end = COLOR_BLACK_ALPHA(20);
     } else {
-      track_bg = nvgLinearGradient(s->vg, s->fb_w, s->fb_h, s->fb_w, s->fb_h*.4,
-        nvgRGBA(red_lvl, green_lvl, 0, 150), nvgRGBA((int)(0.7*red_lvl), (int)(0.7*green_lvl), 0, 20));
+      track_start = nvgRGBA(red_lvl, green_lvl, 0, 150);
+      track_end = nvgRGBA((int)(0.7*red_lvl), (int)(0.7*green_lvl), 0, 20);
     }
   } else {
     // Draw white vision track
-    track_bg = nvgLinearGradient(s->vg, s->fb_w, s->fb_h, s->fb_w, s->fb_h * .4,
-                                        COLOR_WHITE_ALPHA(150), COLOR_WHITE_ALPHA(20));
+    track_start = COLOR_WHITE_ALPHA(150);
+    track_end = COLOR_WHITE_ALPHA(20);
   }
   // paint path
-  ui_draw_line(s, scene.track_vertices, nullptr, &track_bg);
+  ui_draw_line(r, LINE_SLOT_TRACK, track_start, track_end, s->fb_h, s->fb_h * .4);
+
+  glBindVertexArray(0);
+  glUseProgram(0);
 }
 
 // Draw all world space objects.
@@ -301,6 +438,7 @@ static void ui_draw_standstill(UIState *s) {
 
   if (scene.standStill) {
     nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
+    nvgFontFace(s->vg, "sans-semibold");
     nvgFontSize(s->vg, 125);
     nvgFillColor(s->vg, COLOR_ORANGE_ALPHA(240));
     ui_print(s, viz_standstill_x, viz_standstill_y, "STOP");
@@ -651,20 +789,25 @@ static void ui_draw_vision_face(UIState *s) {
 }
 
 //BB START: functions added for the display of various items
-static int bb_ui_draw_measure(UIState *s, const char* bb_value, const char* bb_uom, const char* bb_label,
-    int bb_x, int bb_y, int bb_uom_dx,
-    NVGcolor bb_valueColor, NVGcolor bb_labelColor, NVGcolor bb_uomColor,
-    int bb_valueFontSize, int bb_labelFontSize, int bb_uomFontSize )  {
+static void bb_ui_draw_measure_value(UIState *s, const char* bb_value, const char* bb_uom,
+    int bb_x, int bb_y, NVGcolor bb_valueColor, int bb_valueFontSize, int bb_uomFontSize) {
   nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_BASELINE);
   int dx = 0;
   if (strlen(bb_uom) > 0) {
     dx = (int)(bb_uomFontSize*2.5/2);
    }
-  //print value
   nvgFontFace(s->vg, "sans-semibold");
   nvgFontSize(s->vg, bb_valueFontSize*2.5);
   nvgFillColor(s->vg, bb_valueColor);
   nvgText(s->vg, bb_x-dx/2, bb_y+ (int)(bb_valueFontSize*2.5)+5, bb_value, NULL);
+}
+
+static int bb_ui_draw_measure(UIState *s, const char* bb_value, const char* bb_uom, const char* bb_label,
+    int bb_x, int bb_y, int bb_uom_dx,
+    NVGcolor bb_valueColor, NVGcolor bb_labelColor, NVGcolor bb_uomColor,
+    int bb_valueFontSize, int bb_labelFontSize, int bb_uomFontSize )  {
+  //print value
+  bb_ui_draw_measure_value(s, bb_value, bb_uom, bb_x, bb_y, bb_valueColor, bb_valueFontSize, bb_uomFontSize);
   //print label
   nvgFontFace(s->vg, "sans-regular");
   nvgFontSize(s->vg, bb_labelFontSize*2.5);
@@ -901,27 +1044,14 @@ static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w )
         value_fontSize, label_fontSize, uom_fontSize );
     bb_ry = bb_y + bb_h;
   }
-  //add steering angle
+  //add steering angle, the value changes every frame and is drawn by bb_ui_draw_steer_angle
   if (true) {
-    char val_str[16];
     char uom_str[6];
-    //std::string angle_val = std::to_string(int(scene.angleSteers*10)/10) + "°";
-    NVGcolor val_color = COLOR_GREEN_ALPHA(200);
-    //show Orange if more than 30 degrees
-    //show red if  more than 50 degrees
-    if(((int)(scene.angleSteers) < -30) || ((int)(scene.angleSteers) > 30)) {
-      val_color = COLOR_ORANGE_ALPHA(200);
-    }
-    if(((int)(scene.angleSteers) < -50) || ((int)(scene.angleSteers) > 50)) {
-      val_color = COLOR_RED_ALPHA(200);
-    }
-    // steering is in degrees
-    snprintf(val_str, sizeof(val_str), "%.1f°",(scene.angleSteers));
     snprintf(uom_str, sizeof(uom_str), "   °");
 
-    bb_h +=bb_ui_draw_measure(s, val_str, uom_str, "현재조향각",
+    bb_h +=bb_ui_draw_measure(s, "", uom_str, "현재조향각",
         bb_rx, bb_ry, bb_uom_dx,
-        val_color, lab_color, uom_color,
+        COLOR_GREEN_ALPHA(200), lab_color, uom_color,
         value_fontSize, label_fontSize, uom_fontSize );
     bb_ry = bb_y + bb_h;
   }
@@ -977,9 +1107,149 @@ static void bb_ui_draw_measures_right(UIState *s, int bb_x, int bb_y, int bb_w )
   nvgStroke(s->vg);
 }
 
+// the steering angle row of bb_ui_draw_measures_right, outside of its cached layer
+static void bb_ui_draw_steer_angle(UIState *s, int bb_x, int bb_y, int bb_w ) {
+  const UIScene &scene = s->scene;
+  int value_fontSize=30*0.8;
+  int label_fontSize=15*0.8;
+  int uom_fontSize = 15*0.8;
+  // below the lead distance and relative speed rows
+  int bb_ry = bb_y + 5 + 2 * ((int)((value_fontSize + label_fontSize)*2.5) + 5);
+
+  char val_str[16];
+  NVGcolor val_color = COLOR_GREEN_ALPHA(200);
+  //show Orange if more than 30 degrees
+  //show red if  more than 50 degrees
+  if(((int)(scene.angleSteers) < -30) || ((int)(scene.angleSteers) > 30)) {
+    val_color = COLOR_ORANGE_ALPHA(200);
+  }
+  if(((int)(scene.angleSteers) < -50) || ((int)(scene.angleSteers) > 50)) {
+    val_color = COLOR_RED_ALPHA(200);
+  }
+  // steering is in degrees
+  snprintf(val_str, sizeof(val_str), "%.1f°",(scene.angleSteers));
+  bb_ui_draw_measure_value(s, val_str, "   °", bb_x + (int)(bb_w/2), bb_ry, val_color, value_fontSize, uom_fontSize);
+}
+
 //BB END: functions added for the display of various items
 
+// Panels that only depend on a few slowly changing values are drawn into a
+// framebuffer of their own and composited as an image. They are redrawn when
+// one of the values they are keyed on, or their rect, changes.
+struct UILayer {
+  const char *name;
+  NVGLUframebuffer *fb = nullptr;
+  Rect rect = {};
+  std::vector<float> key;
+
+  // for the profiler overlay
+  uint32_t reused = 0, redrawn = 0;
+  double redraw_ms = 0;
+};
+
+static UILayer measures_left_layer = {"measures_l"};
+static UILayer measures_right_layer = {"measures_r"};
+static UILayer tpms_layer = {"tpms"};
+static UILayer date_time_layer = {"date_time"};
+static UILayer live_tune_layer = {"live_tune"};
+static UILayer *const ui_layers[] = {&measures_left_layer, &measures_right_layer, &tpms_layer, &date_time_layer, &live_tune_layer};
+
+// UI_PROFILE shows the draw time and how much the layers save
+static const bool env_ui_profile = getenv("UI_PROFILE") != NULL;
+
+// the values are compared as floats, use the precision that is displayed
+template <typename... Args>
+static std::array<float, sizeof...(Args)> layer_key(Args... args) {
+  return {(float)args...};
+}
+
+template <size_t N, typename F>
+static void ui_draw_layer(UIState *s, UILayer &layer, const Rect &rect, const std::array<float, N> &key, F draw) {
+  const bool resized = !layer.fb || rect.w != layer.rect.w || rect.h != layer.rect.h;
+  const bool moved = rect.x != layer.rect.x || rect.y != layer.rect.y;
+  if (resized || moved || !std::equal(key.begin(), key.end(), layer.key.begin(), layer.key.end())) {
+    const double start = millis_since_boot();
+    if (resized) {
+      if (layer.fb) nvgluDeleteFramebuffer(layer.fb);
+      layer.fb = nvgluCreateFramebuffer(s->vg, rect.w, rect.h, 0);
+      if (!layer.fb) {
+        layer.key.clear();
+        draw();
+        return;
+      }
+    }
+    layer.rect = rect;
+    layer.key.assign(key.begin(), key.end());
+
+    // a layer is a nanovg frame of its own, flush what was drawn so far
+    nvgEndFrame(s->vg);
+    GLint fbo, viewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &fbo);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, layer.fb->fbo);
+    glViewport(0, 0, rect.w, rect.h);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    nvgBeginFrame(s->vg, rect.w, rect.h, 1.0f);
+    nvgTranslate(s->vg, -rect.x, -rect.y);
+    draw();
+    nvgEndFrame(s->vg);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    nvgBeginFrame(s->vg, s->fb_w, s->fb_h, 1.0f);
+
+    layer.redrawn++;
+    layer.redraw_ms = millis_since_boot() - start;
+  } else {
+    layer.reused++;
+  }
+
+  nvgBeginPath(s->vg);
+  nvgRect(s->vg, rect.x, rect.y, rect.w, rect.h);
+  nvgFillPaint(s->vg, nvgImagePattern(s->vg, rect.x, rect.y, rect.w, rect.h, 0, layer.fb->image, 1.0f));
+  nvgFill(s->vg);
+}
+
+static void ui_draw_profile(UIState *s, double draw_ms) {
+  // averages over windows of a few seconds
+  static int frames = 0;
+  static double draw_ms_sum = 0;
+  static std::vector<std::string> lines;
+
+  frames++;
+  draw_ms_sum += draw_ms;
+  if (frames == UI_FREQ * 5) {
+    lines.clear();
+    double saved_ms = 0;
+    for (UILayer *layer : ui_layers) {
+      const uint32_t total = layer->reused + layer->redrawn;
+      if (total == 0) continue;
+
+      // compositing the image costs next to nothing compared to the redraw
+      saved_ms += layer->reused * layer->redraw_ms;
+      lines.push_back(util::string_format("%-10s %3.0f%% reused, %.2f ms to redraw",
+                                          layer->name, 100.0 * layer->reused / total, layer->redraw_ms));
+      layer->reused = layer->redrawn = 0;
+    }
+    lines.insert(lines.begin(), util::string_format("draw %.2f ms/frame, layers save ~%.2f ms/frame",
+                                                    draw_ms_sum / frames, saved_ms / frames));
+    frames = 0;
+    draw_ms_sum = 0;
+  }
+
+  nvgFontFace(s->vg, "sans-regular");
+  nvgFontSize(s->vg, 30);
+  nvgTextAlign(s->vg, NVG_ALIGN_LEFT | NVG_ALIGN_TOP);
+  nvgFillColor(s->vg, COLOR_WHITE_ALPHA(200));
+  for (int i = 0; i < (int)lines.size(); i++) {
+    nvgText(s->vg, bdr_s + 200, s->fb_h - footer_h + i * 32, lines[i].c_str(), NULL);
+  }
+}
+
 static void bb_ui_draw_UI(UIState *s) {
+  const UIScene &scene = s->scene;
   const int bb_dml_w = 180;
   const int bb_dml_x = bdr_s;
   const int bb_dml_y = bdr_s + 220;
@@ -988,8 +1258,42 @@ static void bb_ui_draw_UI(UIState *s) {
   const int bb_dmr_x = s->fb_w - bb_dmr_w - bdr_s;
   const int bb_dmr_y = bdr_s + 220;
 
-  bb_ui_draw_measures_right(s, bb_dml_x, bb_dml_y, bb_dml_w);
-  bb_ui_draw_measures_left(s, bb_dmr_x, bb_dmr_y-20, bb_dmr_w);
+  // room for the most rows either panel has, and the frame's stroke
+  const int bb_h = 560;
+
+  auto lead_one = (*s->sm)["modelV2"].getModelV2().getLeadsV3()[0];
+  const bool lead = lead_one.getProb() > .5;
+  const float lead_d = lead ? lead_one.getX()[0] - 2.5 : 0;
+  const float lead_v = lead ? lead_one.getV()[0] - scene.car_state.getVEgoOP() : 0;
+  const bool enabled = scene.controls_state.getEnabled();
+  ui_draw_layer(s, measures_right_layer, {bb_dml_x - 20, bb_dml_y - 20, bb_dml_w + 40, bb_h},
+                layer_key(lead, (int)lead_d, lead_d < 10 ? roundf(lead_d * 10) : 0, (int)(lead_v * 3.6),
+                          scene.is_metric ? 0 : (int)(lead_v * 2.2374144), scene.is_metric,
+                          enabled, roundf(scene.steerRatio * 100),
+                          scene.longitudinal_control, scene.cruise_gap, scene.dynamic_tr_mode, roundf(scene.dynamic_tr_value * 100)),
+                [=] { bb_ui_draw_measures_right(s, bb_dml_x, bb_dml_y, bb_dml_w); });
+  bb_ui_draw_steer_angle(s, bb_dml_x, bb_dml_y, bb_dml_w);
+
+  const float gps = scene.gpsAccuracyUblox;
+  const bool charging = scene.deviceState.getBatteryStatus() == "Charging";
+  ui_draw_layer(s, measures_left_layer, {bb_dmr_x - 20, bb_dmr_y - 40, bb_dmr_w + 40, bb_h},
+                layer_key((int)scene.cpuTemp, scene.cpuTemp > 75, scene.cpuTemp > 85, scene.cpuPerc, scene.batt_less,
+                          (int)scene.ambientTemp, scene.ambientTemp > 45, scene.ambientTemp > 50, scene.fanSpeed / 1000,
+                          (int)scene.batTemp, scene.batTemp > 40, scene.batTemp > 50, (int)scene.batPercent, charging,
+                          gps != 0, gps > 0.85, gps > 1.3, gps > 9.99, gps > 99,
+                          gps > 9.99 ? roundf(gps * 10) : roundf(gps * 100), scene.satelliteCount, roundf(scene.altitudeUblox)),
+                [=] { bb_ui_draw_measures_left(s, bb_dmr_x, bb_dmr_y-20, bb_dmr_w); });
+}
+
+static void ui_draw_tpms_layer(UIState *s) {
+  const UIScene &scene = s->scene;
+  const float p[4] = {scene.tpmsPressureFl, scene.tpmsPressureFr, scene.tpmsPressureRl, scene.tpmsPressureRr};
+  const float spread = *std::max_element(p, p + 4) - *std::min_element(p, p + 4);
+  ui_draw_layer(s, tpms_layer, {s->fb_w - (bdr_s+425) - 10, bdr_s - 10, 250, 180},
+                layer_key(spread > 3,
+                          roundf(p[0] * 10), p[0] < 34, p[0] > 50, roundf(p[1] * 10), p[1] < 34, p[1] > 50,
+                          roundf(p[2] * 10), p[2] < 34, p[2] > 50, roundf(p[3] * 10), p[3] < 34, p[3] > 50),
+                [=] { ui_draw_tpms(s); });
 }
 
 static void draw_navi_button(UIState *s) {
@@ -1005,6 +1309,7 @@ static void draw_navi_button(UIState *s) {
   nvgStrokeColor(s->vg, nvgRGBA(255,255,255,80));
   nvgStrokeWidth(s->vg, 6);
   nvgStroke(s->vg);
+  nvgFontFace(s->vg, "sans-semibold");
   nvgFontSize(s->vg, 45);
   if (s->scene.map_is_running) {
     NVGcolor fillColor = nvgRGBA(0,0,255,80);
@@ -1028,6 +1333,7 @@ static void draw_laneless_button(UIState *s) {
   nvgStrokeColor(s->vg, nvgRGBA(255,255,255,80));
   nvgStrokeWidth(s->vg, 6);
   nvgStroke(s->vg);
+  nvgFontFace(s->vg, "sans-semibold");
   nvgFontSize(s->vg, 45);
   if (s->scene.lateralPlan.lanelessModeStatus) {
     NVGcolor fillColor = nvgRGBA(0,255,0,80);
@@ -1059,7 +1365,7 @@ static void ui_draw_vision_header(UIState *s) {
   ui_draw_vision_event(s);
   if (!s->scene.comma_stock_ui) {
     bb_ui_draw_UI(s);
-    ui_draw_tpms(s);
+    ui_draw_tpms_layer(s);
     draw_navi_button(s);
   }
   if (s->scene.end_to_end && !s->scene.comma_stock_ui) {
@@ -1123,16 +1429,12 @@ static void ui_draw_vision_car(UIState *s) {
 }
 
 // draw date/time
-void draw_kr_date_time(UIState *s) {
+void draw_kr_date_time(UIState *s, const struct tm &tm) {
   int rect_w = 600;
   const int rect_h = 50;
   int rect_x = s->fb_w/2 - rect_w/2;
   const int rect_y = 0;
   char dayofweek[50];
-
-  // Get local time to display
-  time_t t = time(NULL);
-  struct tm tm = *localtime(&t);
   char now[50];
   if (tm.tm_wday == 0) {
     strcpy(dayofweek, "SUN");
@@ -1159,6 +1461,7 @@ void draw_kr_date_time(UIState *s) {
   }
 
   nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_TOP);
+  nvgFontFace(s->vg, "sans-semibold");
   nvgBeginPath(s->vg);
   nvgRoundedRect(s->vg, rect_x, rect_y, rect_w, rect_h, 0);
   nvgFillColor(s->vg, nvgRGBA(0, 0, 0, 0));
@@ -1214,6 +1517,7 @@ static void ui_draw_live_tune_panel(UIState *s) {
   nvgFill(s->vg);
 
   //param value
+  nvgFontFace(s->vg, "sans-semibold");
   nvgFontSize(s->vg, 150);
   nvgTextAlign(s->vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
   if (s->scene.live_tune_panel_list == 0) {
@@ -1293,6 +1597,28 @@ static void ui_draw_auto_hold(UIState *s) {
   ui_draw_text(s, rect.centerX(), rect.centerY(), "AUTO HOLD", 90, COLOR_GREEN_ALPHA(150), "sans-bold");
 }
 
+static void ui_draw_live_tune_layer(UIState *s) {
+  const UIScene &scene = s->scene;
+  ui_draw_layer(s, live_tune_layer, {s->fb_w/2 - 480, 560, 960, 370},
+                layer_key(scene.live_tune_panel_list, scene.list_count, scene.lateralControlMethod,
+                          scene.cameraOffset, scene.pathOffset, scene.osteerRateCost,
+                          scene.pidKp, scene.pidKi, scene.pidKd, scene.pidKf,
+                          scene.indiInnerLoopGain, scene.indiOuterLoopGain, scene.indiTimeConstant, scene.indiActuatorEffectiveness,
+                          scene.lqrScale, scene.lqrKi, scene.lqrDcGain),
+                [=] { ui_draw_live_tune_panel(s); });
+}
+
+static void ui_draw_date_time_layer(UIState *s) {
+  // Get local time to display
+  time_t t = time(NULL);
+  struct tm tm = *localtime(&t);
+  const bool show_time = s->scene.kr_time_show;
+  ui_draw_layer(s, date_time_layer, {s->fb_w/2 - 400, 0, 800, 70},
+                layer_key(s->scene.kr_date_show, show_time, tm.tm_year, tm.tm_mon, tm.tm_mday, tm.tm_wday,
+                          show_time ? tm.tm_hour : 0, show_time ? tm.tm_min : 0, show_time ? tm.tm_sec : 0),
+                [=] { draw_kr_date_time(s, tm); });
+}
+
 static void ui_draw_vision(UIState *s) {
   const UIScene *scene = &s->scene;
   // Draw augmented elements
@@ -1308,10 +1634,10 @@ static void ui_draw_vision(UIState *s) {
     }
   }
   if (scene->live_tune_panel_enable) {
-    ui_draw_live_tune_panel(s);
+    ui_draw_live_tune_layer(s);
   }
   if ((scene->kr_date_show || scene->kr_time_show) && !scene->comma_stock_ui) {
-    draw_kr_date_time(s);
+    ui_draw_date_time_layer(s);
   }
   if (scene->brakeHold && !scene->comma_stock_ui) {
     ui_draw_auto_hold(s);
@@ -1323,13 +1649,23 @@ void ui_draw(UIState *s, int w, int h) {
   if (s->fb_w != w || s->fb_h != h) {
     ui_resize(s, w, h);
   }
+  // cpu time of the last frame, flushing nanovg included
+  static double draw_ms = 0;
+  const double start = millis_since_boot();
+
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   nvgBeginFrame(s->vg, s->fb_w, s->fb_h, 1.0f);
   ui_draw_vision(s);
   dashcam(s);
+  if (env_ui_profile) {
+    ui_draw_profile(s, draw_ms);
+  }
+  // nanovg does the tessellation and the gl calls here
   nvgEndFrame(s->vg);
   glDisable(GL_BLEND);
+
+  draw_ms = millis_since_boot() - start;
 }
 
 void ui_draw_image(const UIState *s, const Rect &r, const char *name, float alpha) {
@@ -1402,6 +1738,8 @@ void ui_nvg_init(UIState *s) {
     s->images[name] = nvgCreateImage(s->vg, file, 1);
     assert(s->images[name] != 0);
   }
+
+  line_renderer_init(line_renderer);
 }
 
 void ui_resize(UIState *s, int width, int height) {
@@ -142,6 +142,7 @@ void MapWindow::timerUpdate() {
       last_position = coordinate;
       last_bearing = bearing;
       velocity_filter.update(velocity);
+      updateSegmentMatch();
     }
   }
 
@@ -187,9 +188,8 @@ void MapWindow::timerUpdate() {
   if (segment.isValid()) {
     auto cur_maneuver = segment.maneuver();
     auto attrs = cur_maneuver.extendedAttributes();
-    if (cur_maneuver.isValid() && attrs.contains("mapbox.banner_instructions")) {
-      float along_geometry = distance_along_geometry(segment.path(), to_QGeoCoordinate(*last_position));
-      float distance_to_maneuver = segment.distance() - along_geometry;
+    if (cur_maneuver.isValid() && attrs.contains("mapbox.banner_instructions") && segment_match) {
+      float distance_to_maneuver = segment.distance() - segment_match->along;
       emit distanceChanged(std::max(0.0f, distance_to_maneuver));
 
       m_map->setPitch(MAX_PITCH); // TODO: smooth pitching based on maneuver distance
@@ -205,7 +205,7 @@ void MapWindow::timerUpdate() {
       if (!shouldRecompute() && (distance_to_maneuver < -MANEUVER_TRANSITION_THRESHOLD)) {
         auto next_segment = segment.nextRouteSegment();
         if (next_segment.isValid()) {
-          segment = next_segment;
+          setSegment(next_segment);
 
           recompute_backoff = std::max(0, recompute_backoff - 1);
           recompute_countdown = 0;
@@ -310,7 +310,7 @@ void MapWindow::recomputeRoute() {
 
 void MapWindow::updateETA() {
   if (segment.isValid()) {
-    float progress = distance_along_geometry(segment.path(), to_QGeoCoordinate(*last_position)) / segment.distance();
+    float progress = (segment_match ? segment_match->along : 0) / segment.distance();
     float total_distance = segment.distance() * (1.0 - progress);
     float total_time = segment.travelTime() * (1.0 - progress);
     float total_time_typical = get_time_typical(segment) * (1.0 - progress);
@@ -352,7 +352,7 @@ void MapWindow::routeCalculated(QGeoRouteReply *reply) {
       qWarning() << "Got route response";
 
       route = reply->routes().at(0);
-      segment = route.firstRouteSegment();
+      setSegment(route.firstRouteSegment());
 
       auto route_points = coordinate_list_to_collection(route.path());
       QMapbox::Feature feature(QMapbox::Feature::LineStringType, route_points, {}, {});
@@ -378,8 +378,21 @@ void MapWindow::routeCalculated(QGeoRouteReply *reply) {
   reply->deleteLater();
 }
 
+void MapWindow::setSegment(const QGeoRouteSegment &new_segment) {
+  segment = new_segment;
+  segment_geometry = RouteGeometry(segment.path());
+  updateSegmentMatch();
+}
+
+void MapWindow::updateSegmentMatch() {
+  segment_match = std::nullopt;
+  if (segment.isValid() && last_position) {
+    segment_match = segment_geometry.match(to_QGeoCoordinate(*last_position));
+  }
+}
+
 void MapWindow::clearRoute() {
-  segment = QGeoRouteSegment();
+  setSegment(QGeoRouteSegment());
   nav_destination = QMapbox::Coordinate();
 
   if (!m_map.isNull()) {
@@ -398,19 +411,8 @@ bool MapWindow::shouldRecompute() {
     return true;
   }
 
-  // Compute closest distance to all line segments in the current path
-  float min_d = REROUTE_DISTANCE + 1;
-  auto path = segment.path();
-  auto cur = to_QGeoCoordinate(*last_position);
-  for (size_t i = 0; i < path.size() - 1; i++) {
-    auto a = path[i];
-    auto b = path[i+1];
-    if (a.distanceTo(b) < 1.0) {
-      continue;
-    }
-    min_d = std::min(min_d, minimum_distance(a, b, cur));
-  }
-  return min_d > REROUTE_DISTANCE;
+  // Closest distance to the line segments in the current path
+  return !segment_match || segment_match->distance > REROUTE_DISTANCE;
 
   // TODO: Check for going wrong way in segment
 }
@@ -26,6 +26,7 @@
 #include "selfdrive/common/params.h"
 #include "selfdrive/common/util.h"
 #include "cereal/messaging/messaging.h"
+#include "selfdrive/ui/qt/maps/map_helpers.h"
 
 class MapInstructions : public QWidget {
   Q_OBJECT
@@ -117,6 +118,9 @@ private:
   QGeoRoutingManager *routing_manager;
   QGeoRoute route;
   QGeoRouteSegment segment;
+  RouteGeometry segment_geometry;
+  // where last_position is on the segment, matched once per position update
+  std::optional<RouteGeometry::Match> segment_match;
 
   MapInstructions* map_instructions;
   MapETA* map_eta;
@@ -128,6 +132,8 @@ private:
   int recompute_backoff = 0;
   int recompute_countdown = 0;
   void calculateRoute(QMapbox::Coordinate destination);
+  void setSegment(const QGeoRouteSegment &new_segment);
+  void updateSegmentMatch();
   void clearRoute();
   bool shouldRecompute();
   void updateETA();
@@ -1,5 +1,9 @@
 #include "selfdrive/ui/qt/maps/map_helpers.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 #include <QJsonDocument>
 #include <QJsonObject>
 
@@ -66,66 +70,139 @@ QMapbox::CoordinatesCollections coordinate_list_to_collection(QList<QGeoCoordina
   return collections;
 }
 
-static QGeoCoordinate sub(QGeoCoordinate v, QGeoCoordinate w) {
-  return QGeoCoordinate(v.latitude() - w.latitude(), v.longitude() - w.longitude());
+std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param) {
+  QString json_str = QString::fromStdString(Params().get(param));
+  if (json_str.isEmpty()) return {};
+
+  QJsonDocument doc = QJsonDocument::fromJson(json_str.toUtf8());
+  if (doc.isNull()) return {};
+
+  QJsonObject json = doc.object();
+  if (json["latitude"].isDouble() && json["longitude"].isDouble()) {
+    QMapbox::Coordinate coord(json["latitude"].toDouble(), json["longitude"].toDouble());
+    return coord;
+  } else {
+    return {};
+  }
 }
 
-static QGeoCoordinate add(QGeoCoordinate v, QGeoCoordinate w) {
-  return QGeoCoordinate(v.latitude() + w.latitude(), v.longitude() + w.longitude());
+const double EARTH_RADIUS = 6371008.8;  // mean radius, like QGeoCoordinate
+const double GRID_CELL_SIZE = 100;
+// how far past the last matched edge the path is searched first
+const double FORWARD_WINDOW = 500;
+// a forward match further away than this is checked against the grid
+const double FORWARD_MAX_DISTANCE = 15;
+const double NEARBY_RADIUS = 1000;
+
+static inline int64_t cell_key(int x, int y) {
+  return ((int64_t)x << 32) | (uint32_t)y;
 }
 
-static QGeoCoordinate mul(QGeoCoordinate v, float c) {
-  return QGeoCoordinate(c * v.latitude(), c * v.longitude());
+RouteGeometry::RouteGeometry(const QList<QGeoCoordinate> &path) {
+  points.reserve(path.size());
+  double along = 0;
+  for (int i = 0; i < path.size(); i++) {
+    if (i > 0) along += path[i - 1].distanceTo(path[i]);
+    const double lat = path[i].latitude() * M_PI / 180, lon = path[i].longitude() * M_PI / 180;
+    points.push_back({lat, lon, std::cos(lat), along});
+  }
+  if (points.empty()) return;
+
+  // every edge is added to the cells it passes through, sampled at half a cell
+  cos_lat_ref = points[0].cos_lat;
+  for (int i = 0; i + 1 < (int)points.size(); i++) {
+    const Point &a = points[i], &b = points[i + 1];
+    const int steps = std::ceil((b.along - a.along) / (GRID_CELL_SIZE / 2)) + 1;
+    std::pair<int, int> prev = {INT32_MIN, INT32_MIN};
+    for (int j = 0; j <= steps; j++) {
+      const double t = (double)j / steps;
+      const auto c = cell(a.lat + t * (b.lat - a.lat), a.lon + t * (b.lon - a.lon));
+      if (c == prev) continue;
+      auto &edges = grid[cell_key(c.first, c.second)];
+      if (edges.empty() || edges.back() != i) edges.push_back(i);
+      prev = c;
+    }
+  }
 }
 
-static float dot(QGeoCoordinate v, QGeoCoordinate w) {
-  return v.latitude() * w.latitude() + v.longitude() * w.longitude();
+std::pair<int, int> RouteGeometry::cell(double lat, double lon) const {
+  return {(int)std::floor(lon * cos_lat_ref * EARTH_RADIUS / GRID_CELL_SIZE),
+          (int)std::floor(lat * EARTH_RADIUS / GRID_CELL_SIZE)};
 }
 
-float minimum_distance(QGeoCoordinate a, QGeoCoordinate b, QGeoCoordinate p) {
-  const QGeoCoordinate ap = sub(p, a);
-  const QGeoCoordinate ab = sub(b, a);
-  const float t = std::clamp(dot(ap, ab) / dot(ab, ab), 0.0f, 1.0f);
-  const QGeoCoordinate projection = add(a, mul(ab, t));
-  return projection.distanceTo(p);
+RouteGeometry::Match RouteGeometry::matchEdge(int edge, double lat, double lon) const {
+  const Point &a = points[edge];
+  if (edge + 1 >= (int)points.size()) {
+    const double x = (lon - a.lon) * a.cos_lat * EARTH_RADIUS, y = (lat - a.lat) * EARTH_RADIUS;
+    return {edge, (float)std::hypot(x, y), (float)a.along};
+  }
+
+  const Point &b = points[edge + 1];
+  const double ex = (b.lon - a.lon) * a.cos_lat * EARTH_RADIUS, ey = (b.lat - a.lat) * EARTH_RADIUS;
+  const double px = (lon - a.lon) * a.cos_lat * EARTH_RADIUS, py = (lat - a.lat) * EARTH_RADIUS;
+  const double len_sq = ex * ex + ey * ey;
+  const double t = len_sq > 0 ? std::clamp((px * ex + py * ey) / len_sq, 0.0, 1.0) : 0.0;
+  const double d = std::hypot(px - t * ex, py - t * ey);
+  return {edge, (float)d, (float)(a.along + t * (b.along - a.along))};
 }
 
-float distance_along_geometry(QList<QGeoCoordinate> geometry, QGeoCoordinate pos) {
-  if (geometry.size() <= 2) {
-    return geometry[0].distanceTo(pos);
+static inline void keep_closest(std::optional<RouteGeometry::Match> &best, const RouteGeometry::Match &m) {
+  if (!best || m.distance < best->distance) best = m;
+}
+
+std::optional<RouteGeometry::Match> RouteGeometry::matchForward(double lat, double lon) const {
+  if (last_edge < 0) return std::nullopt;
+
+  // the previous edge too, the position can jitter back over a vertex
+  const int edge_count = std::max(1, (int)points.size() - 1);
+  const double end = points[last_edge].along + FORWARD_WINDOW;
+  std::optional<Match> best;
+  for (int i = std::max(0, last_edge - 1); i < edge_count && points[i].along <= end; i++) {
+    keep_closest(best, matchEdge(i, lat, lon));
   }
+  return best;
+}
 
-  // 1. Find segment that is closest to current position
-  // 2. Total distance is sum of distance to start of closest segment
-  //    + all previous segments
-  double total_distance = 0;
-  double total_distance_closest = 0;
-  double closest_distance = std::numeric_limits<double>::max();
-
-  for (int i = 0; i < geometry.size() - 1; i++) {
-    double d = minimum_distance(geometry[i], geometry[i+1], pos);
-    if (d < closest_distance) {
-      closest_distance = d;
-      total_distance_closest = total_distance + geometry[i].distanceTo(pos);
+std::optional<RouteGeometry::Match> RouteGeometry::matchNearby(double lat, double lon, double radius) const {
+  const auto [cx, cy] = cell(lat, lon);
+  const int r = std::ceil(radius / GRID_CELL_SIZE) + 1;
+  std::optional<Match> best;
+  for (int x = cx - r; x <= cx + r; x++) {
+    for (int y = cy - r; y <= cy + r; y++) {
+      auto it = grid.find(cell_key(x, y));
+      if (it == grid.end()) continue;
+      for (int edge : it->second) {
+        keep_closest(best, matchEdge(edge, lat, lon));
+      }
     }
-    total_distance += geometry[i].distanceTo(geometry[i+1]);
   }
-
-  return total_distance_closest;
+  if (best && best->distance > radius) return std::nullopt;
+  return best;
 }
 
-std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param) {
-  QString json_str = QString::fromStdString(Params().get(param));
-  if (json_str.isEmpty()) return {};
-
-  QJsonDocument doc = QJsonDocument::fromJson(json_str.toUtf8());
-  if (doc.isNull()) return {};
+std::optional<RouteGeometry::Match> RouteGeometry::matchAll(double lat, double lon) const {
+  const int edge_count = std::max(1, (int)points.size() - 1);
+  std::optional<Match> best;
+  for (int i = 0; i < edge_count; i++) {
+    keep_closest(best, matchEdge(i, lat, lon));
+  }
+  return best;
+}
 
-  QJsonObject json = doc.object();
-  if (json["latitude"].isDouble() && json["longitude"].isDouble()) {
-    QMapbox::Coordinate coord(json["latitude"].toDouble(), json["longitude"].toDouble());
-    return coord;
-  } else {
-    return {};
+std::optional<RouteGeometry::Match> RouteGeometry::match(const QGeoCoordinate &pos) {
+  if (points.empty()) return std::nullopt;
+
+  const double lat = pos.latitude() * M_PI / 180, lon = pos.longitude() * M_PI / 180;
+  std::optional<Match> m = matchForward(lat, lon);
+  if (!m || m->distance > FORWARD_MAX_DISTANCE) {
+    // off the path or somewhere else on it, only far away from it the whole path is searched
+    std::optional<Match> nearby = matchNearby(lat, lon, NEARBY_RADIUS);
+    if (nearby) {
+      keep_closest(m, *nearby);
+    } else {
+      m = matchAll(lat, lon);
+    }
   }
+  last_edge = m->edge;
+  return m;
 }
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <eigen3/Eigen/Dense>
 #include <QMapboxGL>
 #include <QGeoCoordinate>
@@ -21,6 +24,45 @@ QMapbox::CoordinatesCollections model_to_collection(
 QMapbox::CoordinatesCollections coordinate_to_collection(QMapbox::Coordinate c);
 QMapbox::CoordinatesCollections coordinate_list_to_collection(QList<QGeoCoordinate> coordinate_list);
 
-float minimum_distance(QGeoCoordinate a, QGeoCoordinate b, QGeoCoordinate p);
 std::optional<QMapbox::Coordinate> coordinate_from_param(std::string param);
-float distance_along_geometry(QList<QGeoCoordinate> geometry, QGeoCoordinate pos);
+
+// The path of a route segment, indexed to match positions to it. The distances
+// to the edges are computed on a plane tangent at the edge, the distance along
+// the path from great circle lengths summed up front.
+//
+// A match first searches forward from the last matched edge, which is where the
+// car almost always is, so following the route costs the same on any length of
+// path. When the car isn't near there, the edges around it are looked up in a
+// grid of cells.
+class RouteGeometry {
+public:
+  struct Match {
+    int edge;
+    float distance;  // from the path, in m
+    float along;     // from the start of the path to the closest point, in m
+  };
+
+  RouteGeometry() = default;
+  RouteGeometry(const QList<QGeoCoordinate> &path);
+  bool isValid() const { return !points.empty(); }
+  // closest point on the path, std::nullopt if the path is empty
+  std::optional<Match> match(const QGeoCoordinate &pos);
+
+private:
+  struct Point {
+    double lat, lon;  // radians
+    double cos_lat;
+    double along;     // distance from the start of the path, in m
+  };
+
+  Match matchEdge(int edge, double lat, double lon) const;
+  std::optional<Match> matchForward(double lat, double lon) const;
+  std::optional<Match> matchNearby(double lat, double lon, double radius) const;
+  std::optional<Match> matchAll(double lat, double lon) const;
+  std::pair<int, int> cell(double lat, double lon) const;
+
+  std::vector<Point> points;
+  double cos_lat_ref = 1;
+  std::unordered_map<int64_t, std::vector<int>> grid;  // edges that pass through a cell
+  int last_edge = -1;
+};
@@ -5,11 +5,7 @@
 namespace {
 
 const char frame_vertex_shader[] =
-#ifdef NANOVG_GL3_IMPLEMENTATION
-  "#version 150 core\n"
-#else
-  "#version 300 es\n"
-#endif
+  GLSL_VERSION
   "in vec4 aPosition;\n"
   "in vec4 aTexCoord;\n"
   "uniform mat4 uTransform;\n"
@@ -19,23 +15,21 @@ const char frame_vertex_shader[] =
   "  vTexCoord = aTexCoord;\n"
   "}\n";
 
+#ifdef QCOM
 const char frame_fragment_shader[] =
-#ifdef NANOVG_GL3_IMPLEMENTATION
-  "#version 150 core\n"
-#else
-  "#version 300 es\n"
-#endif
+  GLSL_VERSION
   "precision mediump float;\n"
-  "uniform sampler2D uTexture;\n"
   "in vec4 vTexCoord;\n"
   "out vec4 colorOut;\n"
+  "uniform sampler2D uTexture;\n"
   "void main() {\n"
   "  colorOut = texture(uTexture, vTexCoord.xy);\n"
-#ifdef QCOM
   "  vec3 dz = vec3(0.0627f, 0.0627f, 0.0627f);\n"
   "  colorOut.rgb = ((vec3(1.0f, 1.0f, 1.0f) - dz) * colorOut.rgb / vec3(1.0f, 1.0f, 1.0f)) + dz;\n"
-#endif
   "}\n";
+#else
+const char *frame_fragment_shader = YUVTexture::fragment_shader;
+#endif
 
 const mat4 device_transform = {{
   1.0,  0.0, 0.0, 0.0,
@@ -44,6 +38,21 @@ const mat4 device_transform = {{
   0.0,  0.0, 0.0, 1.0,
 }};
 
+// EON imports the ion backed rgb buffers as textures, everything else
+// uploads the yuv stream, which is half the size
+VisionStreamType get_vipc_stream_type(VisionStreamType type) {
+#ifdef QCOM
+  return type;
+#else
+  switch (type) {
+    case VISION_STREAM_RGB_BACK: return VISION_STREAM_YUV_BACK;
+    case VISION_STREAM_RGB_FRONT: return VISION_STREAM_YUV_FRONT;
+    case VISION_STREAM_RGB_WIDE: return VISION_STREAM_YUV_WIDE;
+    default: return type;
+  }
+#endif
+}
+
 mat4 get_driver_view_transform() {
   const float driver_view_ratio = 1.333;
   mat4 transform;
@@ -105,6 +114,9 @@ CameraViewWidget::~CameraViewWidget() {
     glDeleteVertexArrays(1, &frame_vao);
     glDeleteBuffers(1, &frame_vbo);
     glDeleteBuffers(1, &frame_ibo);
+#ifndef QCOM
+    yuv_texture.reset();
+#endif
   }
   doneCurrent();
 }
@@ -148,6 +160,11 @@ void CameraViewWidget::initializeGL() {
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   glBindVertexArray(0);
 
+#ifndef QCOM
+  yuv_texture = std::make_unique<YUVTexture>();
+  assert(glGetError() == GL_NO_ERROR);
+#endif
+
   setStreamType(stream_type);
 }
 
@@ -168,7 +185,7 @@ void CameraViewWidget::resizeGL(int w, int h) {
 void CameraViewWidget::setStreamType(VisionStreamType type) {
   if (!vipc_client || type != stream_type) {
     stream_type = type;
-    vipc_client.reset(new VisionIpcClient("camerad", stream_type, true));
+    vipc_client.reset(new VisionIpcClient("camerad", get_vipc_stream_type(stream_type), true));
     updateFrameMat(width(), height());
   }
 }
@@ -212,17 +229,26 @@ void CameraViewWidget::paintGL() {
   glViewport(0, 0, width(), height());
 
   glBindVertexArray(frame_vao);
-  glActiveTexture(GL_TEXTURE0);
-
-  glBindTexture(GL_TEXTURE_2D, texture[latest_frame->idx]->frame_tex);
-  if (!Hardware::EON()) {
-    // this is handled in ion on QCOM
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, latest_frame->width, latest_frame->height,
-                  0, GL_RGB, GL_UNSIGNED_BYTE, latest_frame->addr);
-  }
 
   glUseProgram(program->programId());
+#ifdef QCOM
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture[latest_frame->idx]->frame_tex);
   glUniform1i(program->uniformLocation("uTexture"), 0);
+#else
+  if (!frame_uploaded) {
+    if (!yuv_texture->upload(latest_frame)) {
+      LOGE("failed to map the frame pixel buffer");
+    }
+    frame_uploaded = true;
+  }
+  const char *samplers[3] = {"uTextureY", "uTextureU", "uTextureV"};
+  for (int i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + i);
+    glBindTexture(GL_TEXTURE_2D, yuv_texture->textures[i]);
+    glUniform1i(program->uniformLocation(samplers[i]), i);
+  }
+#endif
   glUniformMatrix4fv(program->uniformLocation("uTransform"), 1, GL_TRUE, frame_mat.v);
 
   assert(glGetError() == GL_NO_ERROR);
@@ -230,11 +256,13 @@ void CameraViewWidget::paintGL() {
   glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, (const void *)0);
   glDisableVertexAttribArray(0);
   glBindVertexArray(0);
+  glActiveTexture(GL_TEXTURE0);
 }
 
 void CameraViewWidget::updateFrame() {
   if (!vipc_client->connected && vipc_client->connect(false)) {
     // init vision
+#ifdef QCOM
     for (int i = 0; i < vipc_client->num_buffers; i++) {
       texture[i].reset(new EGLImageTexture(&vipc_client->buffers[i]));
 
@@ -248,6 +276,7 @@ void CameraViewWidget::updateFrame() {
       glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
       assert(glGetError() == GL_NO_ERROR);
     }
+#endif
     latest_frame = nullptr;
     resizeGL(width(), height());
   }
@@ -257,6 +286,9 @@ void CameraViewWidget::updateFrame() {
     buf = vipc_client->recv();
     if (buf != nullptr) {
       latest_frame = buf;
+#ifndef QCOM
+      frame_uploaded = false;
+#endif
       update();
       emit frameUpdated();
     } else {
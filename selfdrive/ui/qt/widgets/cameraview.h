@@ -41,8 +41,14 @@ private:
   VisionBuf *latest_frame = nullptr;
   GLuint frame_vao, frame_vbo, frame_ibo;
   mat4 frame_mat;
-  std::unique_ptr<EGLImageTexture> texture[UI_BUF_COUNT];
   QOpenGLShaderProgram *program;
 
+#ifdef QCOM
+  std::unique_ptr<EGLImageTexture> texture[UI_BUF_COUNT];
+#else
+  std::unique_ptr<YUVTexture> yuv_texture;
+  bool frame_uploaded = false;
+#endif
+
   VisionStreamType stream_type;
 };
@@ -1,6 +1,15 @@
 #include "selfdrive/ui/replay/framereader.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstring>
+#include <list>
+#include <map>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
 
 static int ffmpeg_lockmgr_cb(void **arg, enum AVLockOp op) {
   std::mutex *mutex = (std::mutex *)*arg;
@@ -32,35 +41,90 @@ public:
   ~AVInitializer() { avformat_network_deinit(); }
 };
 
-FrameReader::FrameReader() {
-  static AVInitializer av_initializer;
-}
+namespace {
 
-FrameReader::~FrameReader() {
-  // wait until thread is finished.
-  exit_ = true;
-  cv_decode_.notify_all();
-  cv_frame_.notify_all();
-  if (decode_thread_.joinable()) {
-    decode_thread_.join();
-  }
-
-  // free all.
-  for (auto &f : frames_) {
-    av_free_packet(&f.pkt);
-    if (f.data) {
-      delete[] f.data;
+typedef std::shared_ptr<const std::vector<uint8_t>> CachedFrame;
+
+// a 1928x1208 I420 frame is 3.5MB, this holds a few segments worth of GOPs
+const size_t DEFAULT_CACHE_SIZE = 512 * 1024 * 1024;
+
+class FrameCache {
+public:
+  CachedFrame get(uint64_t reader, int idx) {
+    std::lock_guard lk(lock);
+    auto it = index.find({reader, idx});
+    if (it == index.end()) return nullptr;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->second;
+  }
+
+  void put(uint64_t reader, int idx, CachedFrame frame) {
+    std::lock_guard lk(lock);
+    const Key key = {reader, idx};
+    if (index.count(key)) return;
+    lru.emplace_front(key, frame);
+    index[key] = lru.begin();
+    size += frame->size();
+    evict();
+  }
+
+  void erase(uint64_t reader) {
+    std::lock_guard lk(lock);
+    for (auto it = lru.begin(); it != lru.end();) {
+      if (it->first.first == reader) {
+        size -= it->second->size();
+        index.erase(it->first);
+        it = lru.erase(it);
+      } else {
+        ++it;
+      }
     }
   }
-  while (!buffer_pool.empty()) {
-    delete[] buffer_pool.front();
-    buffer_pool.pop();
+
+  void setCapacity(size_t bytes) {
+    std::lock_guard lk(lock);
+    capacity = bytes;
+    evict();
+  }
+
+private:
+  typedef std::pair<uint64_t, int> Key;
+
+  void evict() {
+    while (size > capacity && !lru.empty()) {
+      size -= lru.back().second->size();
+      index.erase(lru.back().first);
+      lru.pop_back();
+    }
   }
-  if (frmRgb_) {
-    av_frame_free(&frmRgb_);
+
+  std::mutex lock;
+  // most recently used first
+  std::list<std::pair<Key, CachedFrame>> lru;
+  std::map<Key, decltype(lru)::iterator> index;
+  size_t size = 0, capacity = DEFAULT_CACHE_SIZE;
+};
+
+FrameCache &frame_cache() {
+  static FrameCache cache;
+  return cache;
+}
+
+std::atomic<uint64_t> next_reader_id = 0;
+
+}  // namespace
+
+FrameReader::FrameReader() : id_(next_reader_id++) {
+  static AVInitializer av_initializer;
+}
+
+FrameReader::~FrameReader() {
+  frame_cache().erase(id_);
+
+  if (frame_) {
+    av_frame_free(&frame_);
   }
   if (pCodecCtx_) {
-    avcodec_close(pCodecCtx_);
     avcodec_free_context(&pCodecCtx_);
   }
   if (pFormatCtx_) {
@@ -71,6 +135,10 @@ FrameReader::~FrameReader() {
   }
 }
 
+void FrameReader::setCacheSize(size_t bytes) {
+  frame_cache().setCapacity(bytes);
+}
+
 bool FrameReader::load(const std::string &url) {
   pFormatCtx_ = avformat_alloc_context();
   if (avformat_open_input(&pFormatCtx_, url.c_str(), NULL, NULL) != 0) {
@@ -80,108 +148,148 @@ bool FrameReader::load(const std::string &url) {
   avformat_find_stream_info(pFormatCtx_, NULL);
   av_dump_format(pFormatCtx_, 0, url.c_str(), 0);
 
-  auto pCodecCtxOrig = pFormatCtx_->streams[0]->codec;
-  auto pCodec = avcodec_find_decoder(pCodecCtxOrig->codec_id);
+  const AVCodecParameters *codecpar = pFormatCtx_->streams[0]->codecpar;
+  auto pCodec = avcodec_find_decoder(codecpar->codec_id);
   if (!pCodec) return false;
 
   pCodecCtx_ = avcodec_alloc_context3(pCodec);
-  int ret = avcodec_copy_context(pCodecCtx_, pCodecCtxOrig);
-  if (ret != 0) return false;
+  int ret = avcodec_parameters_to_context(pCodecCtx_, codecpar);
+  if (ret < 0) return false;
 
+  // frame and slice threads, one per core
+  pCodecCtx_->thread_count = 0;
+  pCodecCtx_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
   ret = avcodec_open2(pCodecCtx_, pCodec, NULL);
   if (ret < 0) return false;
 
-  width = pCodecCtxOrig->width;
-  height = pCodecCtxOrig->height;
+  width = codecpar->width;
+  height = codecpar->height;
 
   sws_ctx_ = sws_getContext(width, height, AV_PIX_FMT_YUV420P,
                             width, height, AV_PIX_FMT_BGR24,
                             SWS_BILINEAR, NULL, NULL, NULL);
   if (!sws_ctx_) return false;
 
-  frmRgb_ = av_frame_alloc();
-  if (!frmRgb_) return false;
+  frame_ = av_frame_alloc();
+  if (!frame_) return false;
 
-  frames_.reserve(60 * 20);  // 20fps, one minute
-  do {
-    Frame &frame = frames_.emplace_back();
-    int err = av_read_frame(pFormatCtx_, &frame.pkt);
-    if (err < 0) {
-      frames_.pop_back();
-      valid_ = (err == AVERROR_EOF);
-      break;
-    }
-  } while (!exit_);
+  // index the packets, their data is read again when the frame is decoded
+  packets_.reserve(60 * 20);  // 20fps, one minute
+  AVPacket *pkt = av_packet_alloc();
+  int err = 0;
+  while ((err = av_read_frame(pFormatCtx_, pkt)) >= 0) {
+    packets_.push_back({pkt->pos, (pkt->flags & AV_PKT_FLAG_KEY) != 0});
+    av_packet_unref(pkt);
+  }
+  av_packet_free(&pkt);
 
+  valid_ = (err == AVERROR_EOF) && !packets_.empty();
   if (valid_) {
-    decode_thread_ = std::thread(&FrameReader::decodeThread, this);
+    // decoding always starts at a keyframe
+    packets_[0].keyframe = true;
+    valid_ = seek(0);
   }
   return valid_;
 }
 
-uint8_t *FrameReader::get(int idx) {
-  if (!valid_ || idx < 0 || idx >= frames_.size()) {
-    return nullptr;
+bool FrameReader::get(int idx, uint8_t *rgb, uint8_t *yuv) {
+  if (!valid_ || idx < 0 || idx >= packets_.size()) {
+    return false;
   }
+
   std::unique_lock lk(mutex_);
-  decode_idx_ = idx;
-  cv_decode_.notify_one();
-  cv_frame_.wait(lk, [=] { return exit_ || frames_[idx].data || frames_[idx].failed; });
-  return frames_[idx].data;
-}
+  CachedFrame frame = frame_cache().get(id_, idx);
+  if (!frame) {
+    frame = decode(idx);
+    if (!frame) return false;
+  }
 
-void FrameReader::decodeThread() {
-  int idx = 0;
-  while (!exit_) {
-    const int from = std::max(idx - 15, 0);
-    const int to = std::min(idx + 20, (int)frames_.size());
-    for (int i = 0; i < frames_.size() && !exit_; ++i) {
-      Frame &frame = frames_[i];
-      if (i >= from && i < to) {
-        if (frame.data || frame.failed) continue;
-
-        uint8_t *dat = decodeFrame(&frame.pkt);
-        std::unique_lock lk(mutex_);
-        frame.data = dat;
-        frame.failed = !dat;
-        cv_frame_.notify_all();
-      } else if (frame.data) {
-        buffer_pool.push(frame.data);
-        frame.data = nullptr;
-        frame.failed = false;
-      }
+  if (yuv) {
+    memcpy(yuv, frame->data(), frame->size());
+  }
+  if (rgb) {
+    uint8_t *src[4], *dst[4];
+    int src_linesize[4], dst_linesize[4];
+    av_image_fill_arrays(src, src_linesize, frame->data(), AV_PIX_FMT_YUV420P, width, height, 1);
+    av_image_fill_arrays(dst, dst_linesize, rgb, AV_PIX_FMT_BGR24, width, height, 1);
+    if (sws_scale(sws_ctx_, src, src_linesize, 0, height, dst, dst_linesize) <= 0) {
+      return false;
     }
-
-    // sleep & wait
-    std::unique_lock lk(mutex_);
-    cv_decode_.wait(lk, [=] { return exit_ || decode_idx_ != -1; });
-    idx = decode_idx_;
-    decode_idx_ = -1;
   }
+  return true;
 }
 
-uint8_t *FrameReader::decodeFrame(AVPacket *pkt) {
-  int gotFrame;
-  AVFrame *f = av_frame_alloc();
-  avcodec_decode_video2(pCodecCtx_, f, &gotFrame, pkt);
+std::shared_ptr<const std::vector<uint8_t>> FrameReader::decode(int idx) {
+  int keyframe = idx;
+  while (keyframe > 0 && !packets_[keyframe].keyframe) {
+    keyframe--;
+  }
+
+  // keep decoding from the current position, unless idx was passed already or
+  // starting over at its keyframe is closer
+  const int next_output = decoding_.empty() ? next_packet_ : decoding_.front();
+  if (idx < next_output || keyframe > next_packet_) {
+    if (!seek(keyframe)) return nullptr;
+  }
 
-  uint8_t *dat = nullptr;
-  if (gotFrame) {
-    if (!buffer_pool.empty()) {
-      dat = buffer_pool.front();
-      buffer_pool.pop();
+  CachedFrame result;
+  AVPacket *pkt = av_packet_alloc();
+  while (!result) {
+    int ret = avcodec_receive_frame(pCodecCtx_, frame_);
+    if (ret == 0 && decoding_.empty()) {
+      av_frame_unref(frame_);
+    } else if (ret == 0) {
+      // frames come out in the order their packets went in
+      const int i = decoding_.front();
+      decoding_.pop_front();
+
+      auto dat = std::make_shared<std::vector<uint8_t>>(getYUVSize());
+      av_image_copy_to_buffer(dat->data(), dat->size(), frame_->data, frame_->linesize,
+                              AV_PIX_FMT_YUV420P, width, height, 1);
+      av_frame_unref(frame_);
+      frame_cache().put(id_, i, dat);
+      if (i == idx) {
+        result = dat;
+      } else if (i > idx) {
+        // idx didn't decode
+        break;
+      }
+    } else if (ret == AVERROR(EAGAIN)) {
+      if (av_read_frame(pFormatCtx_, pkt) < 0) {
+        // end of the file, flush out the frames still in the decoder
+        avcodec_send_packet(pCodecCtx_, NULL);
+        continue;
+      }
+      const int i = packetIndex(pkt->pos);
+      next_packet_ = i + 1;
+      if (avcodec_send_packet(pCodecCtx_, pkt) == 0) {
+        decoding_.push_back(i);
+      }
+      av_packet_unref(pkt);
     } else {
-      dat = new uint8_t[getRGBSize()];
+      // drained or broken, the next decode has to seek
+      decoding_.clear();
+      next_packet_ = packets_.size();
+      break;
     }
+  }
+  av_packet_free(&pkt);
+  return result;
+}
 
-    int ret = avpicture_fill((AVPicture *)frmRgb_, dat, AV_PIX_FMT_BGR24, f->width, f->height);
-    assert(ret > 0);
-    if (sws_scale(sws_ctx_, (const uint8_t **)f->data, f->linesize, 0,
-                  f->height, frmRgb_->data, frmRgb_->linesize) <= 0) {
-      delete[] dat;
-      dat = nullptr;
-    }
+bool FrameReader::seek(int keyframe_idx) {
+  avcodec_flush_buffers(pCodecCtx_);
+  decoding_.clear();
+  next_packet_ = keyframe_idx;
+  return av_seek_frame(pFormatCtx_, 0, packets_[keyframe_idx].pos, AVSEEK_FLAG_BYTE) >= 0;
+}
+
+int FrameReader::packetIndex(int64_t pos) const {
+  auto it = std::lower_bound(packets_.begin(), packets_.end(), pos,
+                             [](const PacketInfo &p, int64_t pos) { return p.pos < pos; });
+  if (pos >= 0 && it != packets_.end() && it->pos == pos) {
+    return it - packets_.begin();
   }
-  av_frame_free(&f);
-  return dat;
+  // no position to go by, assume it's the next one
+  return next_packet_;
 }
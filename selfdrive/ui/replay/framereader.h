@@ -2,12 +2,11 @@
 
 #include <unistd.h>
 
-#include <atomic>
-#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
-#include <thread>
 #include <vector>
 
 // independent of QT, needs ffmpeg
@@ -17,39 +16,49 @@ extern "C" {
 #include <libswscale/swscale.h>
 }
 
+// Decodes frames of a video on demand. load() only indexes the packets, they
+// are read again when a frame is needed: sequential reads continue decoding
+// where the last one stopped, anything else seeks to the closest keyframe.
+//
+// Decoded frames of all readers share one LRU cache that is bounded in bytes,
+// see setCacheSize().
 class FrameReader {
 public:
   FrameReader();
   ~FrameReader();
   bool load(const std::string &url);
-  uint8_t *get(int idx);
+  // writes frame idx to the caller's buffers, either can be null.
+  // rgb is BGR24 of getRGBSize() bytes, yuv is I420 of getYUVSize() bytes
+  bool get(int idx, uint8_t *rgb, uint8_t *yuv);
   int getRGBSize() const { return width * height * 3; }
-  size_t getFrameCount() const { return frames_.size(); }
+  int getYUVSize() const { return width * height * 3 / 2; }
+  size_t getFrameCount() const { return packets_.size(); }
   bool valid() const { return valid_; }
 
+  static void setCacheSize(size_t bytes);
+
   int width = 0, height = 0;
 
 private:
-  void decodeThread();
-  uint8_t *decodeFrame(AVPacket *pkt);
-  struct Frame {
-    AVPacket pkt = {};
-    uint8_t *data = nullptr;
-    bool failed = false;
+  struct PacketInfo {
+    int64_t pos;
+    bool keyframe;
   };
-  std::vector<Frame> frames_;
+  std::shared_ptr<const std::vector<uint8_t>> decode(int idx);
+  bool seek(int keyframe_idx);
+  int packetIndex(int64_t pos) const;
+
+  const uint64_t id_;
+  std::vector<PacketInfo> packets_;
 
   AVFormatContext *pFormatCtx_ = nullptr;
   AVCodecContext *pCodecCtx_ = nullptr;
-  AVFrame *frmRgb_ = nullptr;
-  std::queue<uint8_t *> buffer_pool;
+  AVFrame *frame_ = nullptr;
   struct SwsContext *sws_ctx_ = nullptr;
 
   std::mutex mutex_;
-  std::condition_variable cv_decode_;
-  std::condition_variable cv_frame_;
-  int decode_idx_ = 0;
-  std::atomic<bool> exit_ = false;
+  // next packet to read and the frames that were sent to the decoder, in order
+  int next_packet_ = 0;
+  std::deque<int> decoding_;
   bool valid_ = false;
-  std::thread decode_thread_;
 };
@@ -0,0 +1,123 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "selfdrive/ui/replay/framereader.h"
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+const std::string TEST_VIDEO_URL = "https://commadataci.blob.core.windows.net/openpilotci/0c94aa1e1296d7c6/2021-05-05--19-48-37/0/fcamera.hevc";
+
+static uint64_t frame_hash(const uint8_t *dat, size_t size) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i++) {
+    h = (h ^ dat[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+// hashes of every frame from a plain front to back decode, without any seeking
+static std::vector<uint64_t> sequential_decode(const std::string &url) {
+  AVFormatContext *fmt_ctx = nullptr;
+  REQUIRE(avformat_open_input(&fmt_ctx, url.c_str(), NULL, NULL) == 0);
+  REQUIRE(avformat_find_stream_info(fmt_ctx, NULL) >= 0);
+  const AVCodecParameters *codecpar = fmt_ctx->streams[0]->codecpar;
+  auto codec = avcodec_find_decoder(codecpar->codec_id);
+  REQUIRE(codec != nullptr);
+  AVCodecContext *codec_ctx = avcodec_alloc_context3(codec);
+  REQUIRE(avcodec_parameters_to_context(codec_ctx, codecpar) >= 0);
+  REQUIRE(avcodec_open2(codec_ctx, codec, NULL) >= 0);
+
+  std::vector<uint64_t> hashes;
+  std::vector<uint8_t> yuv(codecpar->width * codecpar->height * 3 / 2);
+  AVPacket *pkt = av_packet_alloc();
+  AVFrame *frame = av_frame_alloc();
+  bool eof = false;
+  while (true) {
+    int ret = avcodec_receive_frame(codec_ctx, frame);
+    if (ret == 0) {
+      av_image_copy_to_buffer(yuv.data(), yuv.size(), frame->data, frame->linesize,
+                              AV_PIX_FMT_YUV420P, codecpar->width, codecpar->height, 1);
+      hashes.push_back(frame_hash(yuv.data(), yuv.size()));
+      av_frame_unref(frame);
+    } else if (ret == AVERROR(EAGAIN) && !eof) {
+      if (av_read_frame(fmt_ctx, pkt) < 0) {
+        eof = true;
+        avcodec_send_packet(codec_ctx, NULL);
+      } else {
+        avcodec_send_packet(codec_ctx, pkt);
+        av_packet_unref(pkt);
+      }
+    } else {
+      break;
+    }
+  }
+  av_frame_free(&frame);
+  av_packet_free(&pkt);
+  avcodec_free_context(&codec_ctx);
+  avformat_close_input(&fmt_ctx);
+  return hashes;
+}
+
+TEST_CASE("FrameReader matches a sequential decode") {
+  const std::vector<uint64_t> expected = sequential_decode(TEST_VIDEO_URL);
+  REQUIRE(expected.size() > 0);
+
+  FrameReader fr;
+  REQUIRE(fr.load(TEST_VIDEO_URL));
+  REQUIRE(fr.getFrameCount() == expected.size());
+  std::vector<uint8_t> yuv(fr.getYUVSize());
+
+  auto check = [&](int idx) {
+    INFO("frame " << idx);
+    REQUIRE(fr.get(idx, nullptr, yuv.data()));
+    REQUIRE(frame_hash(yuv.data(), yuv.size()) == expected[idx]);
+  };
+
+  // no cache, every get decodes
+  FrameReader::setCacheSize(0);
+
+  SECTION("sequential reads") {
+    for (size_t i = 0; i < expected.size(); i++) {
+      check(i);
+    }
+  }
+
+  SECTION("random seeks") {
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> dist(0, expected.size() - 1);
+    for (int i = 0; i < 100; i++) {
+      check(dist(rng));
+    }
+    // backwards within one GOP and across the start of the file
+    check(expected.size() - 1);
+    check(expected.size() - 2);
+    check(0);
+  }
+
+  SECTION("reads past the end") {
+    check(expected.size() - 1);
+    REQUIRE(!fr.get(expected.size(), nullptr, yuv.data()));
+    REQUIRE(!fr.get(-1, nullptr, yuv.data()));
+    // the decoder was flushed at the end of the file, reading again has to seek
+    check(expected.size() - 1);
+    check(0);
+    check(1);
+  }
+
+  SECTION("cached frames") {
+    FrameReader::setCacheSize(64 * fr.getYUVSize());
+    for (int i = 0; i < 30; i++) {
+      check(i);
+    }
+    for (int i = 29; i >= 0; i--) {
+      check(i);
+    }
+  }
+
+  FrameReader::setCacheSize(512 * 1024 * 1024);
+}
@@ -53,18 +53,76 @@ static void update_leads(UIState *s, const cereal::ModelDataV2::Reader &model) {
   }
 }
 
-static void update_line_data(const UIState *s, const cereal::ModelDataV2::XYZTData::Reader &line,
-                             float y_off, float z_off, line_vertices_data *pvd, int max_idx) {
+// The points of all lines of a model are projected to the screen in one pass.
+// The camera intrinsics and car space transform are folded into a single
+// matrix, which leaves a loop without branches over flat arrays that the
+// compiler vectorizes.
+struct LineBatch {
+  static constexpr int MAX_LINES = 7;
+  static constexpr int MAX_POINTS = MAX_LINES * TRAJECTORY_SIZE * 2;
+
+  // calibrated frame, then screen
+  float x[MAX_POINTS], y[MAX_POINTS], z[MAX_POINTS];
+  float screen_x[MAX_POINTS], screen_y[MAX_POINTS];
+  bool visible[MAX_POINTS];
+  int size = 0;
+
+  struct Line {
+    line_vertices_data *out;
+    int start, size;
+  } lines[MAX_LINES];
+  int line_count = 0;
+};
+
+// adds both sides of the line, y_off to the left and right of each point
+static void add_line(LineBatch &b, const cereal::ModelDataV2::XYZTData::Reader &line,
+                     float y_off, float z_off, line_vertices_data *pvd, int max_idx) {
+  assert(b.line_count < LineBatch::MAX_LINES);
   const auto line_x = line.getX(), line_y = line.getY(), line_z = line.getZ();
-  vertex_data *v = &pvd->v[0];
+  b.lines[b.line_count++] = {pvd, b.size, (max_idx + 1) * 2};
   for (int i = 0; i <= max_idx; i++) {
-    v += calib_frame_to_full_frame(s, line_x[i], line_y[i] - y_off, line_z[i] + z_off, v);
+    for (float side : {-y_off, y_off}) {
+      b.x[b.size] = line_x[i];
+      b.y[b.size] = line_y[i] + side;
+      b.z[b.size] = line_z[i] + z_off;
+      b.size++;
+    }
   }
-  for (int i = max_idx; i >= 0; i--) {
-    v += calib_frame_to_full_frame(s, line_x[i], line_y[i] + y_off, line_z[i] + z_off, v);
+}
+
+static void project_lines(const UIState *s, LineBatch &b) {
+  const float *t = s->car_space_transform;
+  const mat3 car_space = {{t[0], t[2], t[4],
+                           t[1], t[3], t[5],
+                           0.0f, 0.0f, 1.0f}};
+  const mat3 intrinsics = s->wide_camera ? ecam_intrinsic_matrix : fcam_intrinsic_matrix;
+  const mat3 m = matmul3(car_space, matmul3(intrinsics, s->scene.view_from_calib));
+
+  const float margin = 500.0f;
+  const float min_x = -margin, max_x = s->fb_w + margin;
+  const float min_y = -margin, max_y = s->fb_h + margin;
+  for (int i = 0; i < b.size; i++) {
+    const float px = m.v[0] * b.x[i] + m.v[1] * b.y[i] + m.v[2] * b.z[i];
+    const float py = m.v[3] * b.x[i] + m.v[4] * b.y[i] + m.v[5] * b.z[i];
+    const float pz = m.v[6] * b.x[i] + m.v[7] * b.y[i] + m.v[8] * b.z[i];
+    b.screen_x[i] = px / pz;
+    b.screen_y[i] = py / pz;
+    b.visible[i] = b.screen_x[i] >= min_x && b.screen_x[i] <= max_x && b.screen_y[i] >= min_y && b.screen_y[i] <= max_y;
+  }
+
+  // points that are far off screen are dropped together with the other side
+  for (int l = 0; l < b.line_count; l++) {
+    const LineBatch::Line &line = b.lines[l];
+    vertex_data *v = &line.out->v[0];
+    for (int i = line.start; i < line.start + line.size; i += 2) {
+      if (b.visible[i] && b.visible[i + 1]) {
+        *v++ = {b.screen_x[i], b.screen_y[i]};
+        *v++ = {b.screen_x[i + 1], b.screen_y[i + 1]};
+      }
+    }
+    line.out->cnt = v - line.out->v;
+    assert(line.out->cnt <= std::size(line.out->v));
   }
-  pvd->cnt = v - pvd->v;
-  assert(pvd->cnt <= std::size(pvd->v));
 }
 
 static void update_model(UIState *s, const cereal::ModelDataV2::Reader &model) {
@@ -72,6 +130,7 @@ static void update_model(UIState *s, const cereal::ModelDataV2::Reader &model) {
   auto model_position = model.getPosition();
   float max_distance = std::clamp(model_position.getX()[TRAJECTORY_SIZE - 1],
                                   MIN_DRAW_DISTANCE, MAX_DRAW_DISTANCE);
+  LineBatch batch;
 
   // update lane lines
   const auto lane_lines = model.getLaneLines();
@@ -79,7 +138,7 @@ static void update_model(UIState *s, const cereal::ModelDataV2::Reader &model) {
   int max_idx = get_path_length_idx(lane_lines[0], max_distance);
   for (int i = 0; i < std::size(scene.lane_line_vertices); i++) {
     scene.lane_line_probs[i] = lane_line_probs[i];
-    update_line_data(s, lane_lines[i], 0.025 * scene.lane_line_probs[i], 0, &scene.lane_line_vertices[i], max_idx);
+    add_line(batch, lane_lines[i], 0.025 * scene.lane_line_probs[i], 0, &scene.lane_line_vertices[i], max_idx);
   }
 
   // update road edges
@@ -87,7 +146,7 @@ static void update_model(UIState *s, const cereal::ModelDataV2::Reader &model) {
   const auto road_edge_stds = model.getRoadEdgeStds();
   for (int i = 0; i < std::size(scene.road_edge_vertices); i++) {
     scene.road_edge_stds[i] = road_edge_stds[i];
-    update_line_data(s, road_edges[i], 0.025, 0, &scene.road_edge_vertices[i], max_idx);
+    add_line(batch, road_edges[i], 0.025, 0, &scene.road_edge_vertices[i], max_idx);
   }
 
   // update path
@@ -97,7 +156,9 @@ static void update_model(UIState *s, const cereal::ModelDataV2::Reader &model) {
     max_distance = std::clamp((float)(lead_d - fmin(lead_d * 0.35, 10.)), 0.0f, max_distance);
   }
   max_idx = get_path_length_idx(model_position, max_distance);
-  update_line_data(s, model_position, 0.5, 1.22, &scene.track_vertices, max_idx);
+  add_line(batch, model_position, 0.5, 1.22, &scene.track_vertices, max_idx);
+
+  project_lines(s, batch);
 }
 
 static void update_sockets(UIState *s) {
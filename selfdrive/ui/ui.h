@@ -113,6 +113,7 @@ typedef struct {
   float x, y;
 } vertex_data;
 
+// a triangle strip, the left and right side of each point of the line in turn
 typedef struct {
   vertex_data v[TRAJECTORY_SIZE * 2];
   int cnt;